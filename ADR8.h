@@ -32,21 +32,74 @@
 
 #define ADR8_IMPLEMENTATION
 
+// hooks for tools that observe execution, empty unless defined before
+// including this file
+
+// a taken branch, subroutine call or return from the instruction at from
+// to the address to, used to record edge coverage
+#ifndef ADR8_BRANCH_HOOK
+#define ADR8_BRANCH_HOOK(core, from, to) ((void)0)
+#endif
+
+// size bytes written from address on by the core, including the writes
+// block memory ops and DMA of devices make on the host, used to track dirty
+// memory
+#ifndef ADR8_WRITE_HOOK
+#define ADR8_WRITE_HOOK(bus, address, size) ((void)0)
+#endif
+
 // ADR8_Bus
 
+#ifndef ADR8_BUS_MAX_REGIONS
+#define ADR8_BUS_MAX_REGIONS 8
+#endif
+
+#ifndef ADR8_BUS_MAX_DEVICES
+#define ADR8_BUS_MAX_DEVICES 16
+#endif
+
+// memory directly accessible by the host, used by instructions that touch
+// many bytes at once
+typedef struct{
+  uint16_t address;
+  uint16_t size;
+  uint8_t* data;
+} ADR8_BusRegion;
+
+// device clocked by ADR8_Bus_clock only when an access falls in its range
+typedef struct{
+  uint16_t address;
+  uint32_t size;
+  void (*clock)(void* device);
+  void* device;
+} ADR8_BusDevice;
+
 typedef struct{
   uint16_t address;
   uint8_t data;
   bool read;
+  ADR8_BusRegion regions[ADR8_BUS_MAX_REGIONS];
+  uint8_t region_count;
+  ADR8_BusDevice devices[ADR8_BUS_MAX_DEVICES];
+  uint8_t device_count;
+  // set by a device that can't complete the access yet, such as a read of
+  // input that hasn't arrived, ADR8_Scheduler_run returns and completes the
+  // access when it is called again
+  void* blocked;
 } ADR8_Bus;
 
 void ADR8_Bus_write(ADR8_Bus* bus, uint16_t address, uint8_t data);
 void ADR8_Bus_read(ADR8_Bus* bus, uint16_t address);
 uint32_t ADR8_Bus_get_data(ADR8_Bus* bus);
+int ADR8_Bus_add_region(ADR8_Bus* bus, uint16_t address, uint16_t size, uint8_t* data);
+uint8_t* ADR8_Bus_get_region(ADR8_Bus* bus, uint16_t address, uint32_t size);
+void ADR8_Bus_attach(ADR8_Bus* bus, uint16_t address, uint32_t size, void (*clock)(void* device), void* device);
+void ADR8_Bus_clock(ADR8_Bus* bus);
 
 #ifdef ADR8_IMPLEMENTATION
 
 void ADR8_Bus_write(ADR8_Bus* bus, uint16_t address, uint8_t data){
+  ADR8_WRITE_HOOK(bus, address, 1);
   bus->address = address;
   bus->data = data;
   bus->read = false;
@@ -54,6 +107,7 @@ void ADR8_Bus_write(ADR8_Bus* bus, uint16_t address, uint8_t data){
 
 void ADR8_Bus_read(ADR8_Bus* bus, uint16_t address){
   bus->address = address;
+  bus->data = 0; // addresses without a device read as zero
   bus->read = true;
 }
 
@@ -61,6 +115,45 @@ uint32_t ADR8_Bus_get_data(ADR8_Bus* bus){
   return bus->data;
 }
 
+// returns the index of the region, which devices that move their memory
+// update in place, or -1 if there is no room left
+int ADR8_Bus_add_region(ADR8_Bus* bus, uint16_t address, uint16_t size, uint8_t* data){
+  if(bus->region_count == ADR8_BUS_MAX_REGIONS){
+    ADR8_DEBUG_LOG("bus: no room for region at %04hX, block instructions will use the bus\n",address);
+    return -1;
+  }
+  bus->regions[bus->region_count] = (ADR8_BusRegion){address, size, data};
+  return bus->region_count++;
+}
+
+// host pointer to address if all size bytes from it lie in a single region
+uint8_t* ADR8_Bus_get_region(ADR8_Bus* bus, uint16_t address, uint32_t size){
+  for(uint8_t i = 0; i < bus->region_count; ++i){
+    ADR8_BusRegion* region = &bus->regions[i];
+    uint16_t offset = address - region->address;
+    if(offset < region->size && offset + size <= region->size){
+      return region->data + offset;
+    }
+  }
+  return NULL;
+}
+
+void ADR8_Bus_attach(ADR8_Bus* bus, uint16_t address, uint32_t size, void (*clock)(void* device), void* device){
+  assert(bus->device_count < ADR8_BUS_MAX_DEVICES && "too many devices on the bus");
+  bus->devices[bus->device_count++] = (ADR8_BusDevice){address, size, clock, device};
+}
+
+// clocks the devices the current access falls in, instead of the host
+// clocking every device each cycle
+void ADR8_Bus_clock(ADR8_Bus* bus){
+  for(uint8_t i = 0; i < bus->device_count; ++i){
+    ADR8_BusDevice* device = &bus->devices[i];
+    if((uint16_t)(bus->address - device->address) < device->size){
+      device->clock(device->device);
+    }
+  }
+}
+
 #endif // ADR8_IMPLEMENTATION
 
 
@@ -74,17 +167,27 @@ typedef struct{
 } ADR8_Memory;
 
 void ADR8_Memory_init(ADR8_Memory* mem, ADR8_Bus* bus, uint16_t size, uint16_t mount_address);
+void ADR8_Memory_init_data(ADR8_Memory* mem, ADR8_Bus* bus, uint8_t* data, uint16_t size, uint16_t mount_address);
 void ADR8_Memory_print(ADR8_Memory* mem, uint16_t n);
 void ADR8_Memory_clock(ADR8_Memory* mem);
+void ADR8_Memory_bus_clock(void* mem);
 
 #ifdef ADR8_IMPLEMENTATION
 
 void ADR8_Memory_init(ADR8_Memory* mem, ADR8_Bus* bus, uint16_t size, uint16_t mount_address){
+  uint8_t* data = malloc(size);
+  assert(data);
+  ADR8_Memory_init_data(mem, bus, data, size, mount_address);
+}
+
+// uses data owned by the caller instead of allocating it
+void ADR8_Memory_init_data(ADR8_Memory* mem, ADR8_Bus* bus, uint8_t* data, uint16_t size, uint16_t mount_address){
   mem->bus = bus;
   mem->mount_address = mount_address;
   mem->size = size;
-  mem->data = malloc(size);
-  assert(mem->data);
+  mem->data = data;
+  ADR8_Bus_add_region(bus, mount_address, size, mem->data);
+  ADR8_Bus_attach(bus, mount_address, size, ADR8_Memory_bus_clock, mem);
 }
 
 void ADR8_Memory_print(ADR8_Memory* mem, uint16_t n){
@@ -107,129 +210,254 @@ void ADR8_Memory_clock(ADR8_Memory* mem){
     }
   }
 }
+
+void ADR8_Memory_bus_clock(void* mem){
+  ADR8_Memory_clock(mem);
+}
+#endif // ADR8_IMPLEMENTATION
+
+// ADR8_PagedMemory
+
+// Memory allocated a page at a time. Untouched pages all point at one shared
+// zero page and get their own page on the first write to them, so a program
+// only pays for the memory it writes. There is no flat data array, so it
+// isn't a bus region: block instructions go over the bus and DMA devices
+// can't reach it.
+
+#define ADR8_PAGE_SIZE 0x100
+#define ADR8_PAGE_COUNT (0x10000/ADR8_PAGE_SIZE)
+
+typedef struct{
+  uint16_t mount_address;
+  uint32_t size; // up to the whole address space
+  uint8_t* pages[ADR8_PAGE_COUNT];
+  size_t resident_pages; // pages that have been written
+  ADR8_Bus* bus;
+} ADR8_PagedMemory;
+
+void ADR8_PagedMemory_init(ADR8_PagedMemory* mem, ADR8_Bus* bus, uint32_t size, uint16_t mount_address);
+void ADR8_PagedMemory_free(ADR8_PagedMemory* mem);
+uint8_t ADR8_PagedMemory_get(ADR8_PagedMemory* mem, uint16_t offset);
+void ADR8_PagedMemory_set(ADR8_PagedMemory* mem, uint16_t offset, uint8_t value);
+void ADR8_PagedMemory_load(ADR8_PagedMemory* mem, uint16_t offset, const uint8_t* data, size_t size);
+size_t ADR8_PagedMemory_resident(ADR8_PagedMemory* mem);
+void ADR8_PagedMemory_clock(ADR8_PagedMemory* mem);
+void ADR8_PagedMemory_bus_clock(void* mem);
+
+#ifdef ADR8_IMPLEMENTATION
+
+// read-only, pages are checked against it before every write and a write
+// that slipped past the check faults instead of changing every page
+static const uint8_t ADR8_zero_page[ADR8_PAGE_SIZE];
+
+void ADR8_PagedMemory_init(ADR8_PagedMemory* mem, ADR8_Bus* bus, uint32_t size, uint16_t mount_address){
+  assert(size <= 0x10000);
+  mem->bus = bus;
+  mem->mount_address = mount_address;
+  mem->size = size;
+  mem->resident_pages = 0;
+  for(size_t i = 0; i < ADR8_PAGE_COUNT; ++i) mem->pages[i] = (uint8_t*)ADR8_zero_page;
+  ADR8_Bus_attach(bus, mount_address, size, ADR8_PagedMemory_bus_clock, mem);
+}
+
+void ADR8_PagedMemory_free(ADR8_PagedMemory* mem){
+  for(size_t i = 0; i < ADR8_PAGE_COUNT; ++i){
+    if(mem->pages[i] != ADR8_zero_page) free(mem->pages[i]);
+    mem->pages[i] = (uint8_t*)ADR8_zero_page;
+  }
+  mem->resident_pages = 0;
+}
+
+uint8_t ADR8_PagedMemory_get(ADR8_PagedMemory* mem, uint16_t offset){
+  return mem->pages[offset / ADR8_PAGE_SIZE][offset % ADR8_PAGE_SIZE];
+}
+
+void ADR8_PagedMemory_set(ADR8_PagedMemory* mem, uint16_t offset, uint8_t value){
+  uint8_t** page = &mem->pages[offset / ADR8_PAGE_SIZE];
+  if(*page == ADR8_zero_page){
+    // writing a zero keeps reading as zero without a page of its own
+    if(!value) return;
+    *page = calloc(ADR8_PAGE_SIZE, 1);
+    assert(*page);
+    mem->resident_pages++;
+  }
+  (*page)[offset % ADR8_PAGE_SIZE] = value;
+}
+
+void ADR8_PagedMemory_load(ADR8_PagedMemory* mem, uint16_t offset, const uint8_t* data, size_t size){
+  for(size_t i = 0; i < size && offset + i < mem->size; ++i){
+    ADR8_PagedMemory_set(mem, offset + i, data[i]);
+  }
+}
+
+// bytes of memory allocated for written pages
+size_t ADR8_PagedMemory_resident(ADR8_PagedMemory* mem){
+  return mem->resident_pages * ADR8_PAGE_SIZE;
+}
+
+void ADR8_PagedMemory_clock(ADR8_PagedMemory* mem){
+  uint16_t mem_address = mem->bus->address - mem->mount_address;
+  if(mem_address < mem->size){
+    if(mem->bus->read){
+      mem->bus->data = ADR8_PagedMemory_get(mem, mem_address);
+      ADR8_DEBUG_LOG("MEM READ  %04hX: %02hX\n",mem_address,mem->bus->data);
+    }else{
+      ADR8_PagedMemory_set(mem, mem_address, mem->bus->data);
+      ADR8_DEBUG_LOG("MEM WRITE %04hX: %02hX\n",mem_address,mem->bus->data);
+    }
+  }
+}
+
+void ADR8_PagedMemory_bus_clock(void* mem){
+  ADR8_PagedMemory_clock(mem);
+}
 #endif // ADR8_IMPLEMENTATION
 
 // ADR8_Core
 
+// Every instruction in one place: mnemonic, opcode, operand, cycles including
+// the fetch cycle, what adds to those cycles and its description.
+// ADR8_OpCode and ADR8_OpInfoTable are built from it below, `make generate`
+// builds the mnemonic hash of the assembler and the instruction table of the
+// README from it.
+// X(name, opcode, operand, cycles, timing, description)
+#define ADR8_OPCODES(X) \
+  /* Misc ops */ \
+  X(NOP,  0x00, NONE,      2, FIXED, "Do nothing") \
+  X(HALT, 0x01, NONE,      2, FIXED, "Stop CPU execution") \
+  /* transfer ops */ \
+  X(TRAK, 0x02, NONE,      2, FIXED, "Transfer content of A to STK") \
+  X(TRAB, 0x03, NONE,      2, FIXED, "Transfer content of A to B") \
+  X(TRBA, 0x04, NONE,      2, FIXED, "Transfer content of B to A") \
+  X(TRAX, 0x05, NONE,      2, FIXED, "Transfer content of A to X") \
+  X(TRXA, 0x06, NONE,      2, FIXED, "Transfer content of X to A") \
+  X(TRAY, 0x07, NONE,      2, FIXED, "Transfer content of A to Y") \
+  X(TRYA, 0x08, NONE,      2, FIXED, "Transfer content of Y to A") \
+  /* set register */ \
+  X(SETK, 0x09, IMMEDIATE, 4, FIXED, "Set content of STK to xxxx") \
+  X(SETA, 0x0A, IMMEDIATE, 4, FIXED, "Set content of A to xxxx") \
+  X(SETB, 0x0B, IMMEDIATE, 4, FIXED, "Set content of B to xxxx") \
+  X(SETX, 0x0C, IMMEDIATE, 4, FIXED, "Set content of X to xxxx") \
+  X(SETY, 0x0D, IMMEDIATE, 4, FIXED, "Set content of Y to xxxx") \
+  /* subroutines */ \
+  X(JSR,  0x0E, ADDRESS,   5, FIXED, "Push content of PC on the stack and jump to mmmm") \
+  X(RSR,  0x0F, NONE,      4, FIXED, "Pop dword of the stack into PC") \
+  /* load word from memory */ \
+  X(LDAL, 0x10, ADDRESS,   5, FIXED, "Load word from mmmm into lower word of A") \
+  X(LDAH, 0x11, ADDRESS,   5, FIXED, "Load word from mmmm into higher word of A") \
+  X(LDBL, 0x12, ADDRESS,   5, FIXED, "Load word from mmmm into lower word of B") \
+  X(LDBH, 0x13, ADDRESS,   5, FIXED, "Load word from mmmm into higher word of B") \
+  /* load word by pointer */ \
+  X(LXAL, 0x14, NONE,      3, FIXED, "Load word from address stored in X into lower word of A") \
+  X(LXAH, 0x15, NONE,      3, FIXED, "Load word from address stored in X into higher word of A") \
+  X(LYBL, 0x16, NONE,      3, FIXED, "Load word from address stored in Y into lower word of B") \
+  X(LYBH, 0x17, NONE,      3, FIXED, "Load word from address stored in Y into higher word of B") \
+  /* load dword from memory */ \
+  X(LDA,  0x1A, ADDRESS,   6, FIXED, "Load dword from mmmm into A") \
+  X(LDB,  0x1B, ADDRESS,   6, FIXED, "Load dword from mmmm into B") \
+  X(LDX,  0x1C, ADDRESS,   6, FIXED, "Load dword from mmmm into X") \
+  X(LDY,  0x1D, ADDRESS,   6, FIXED, "Load dword from mmmm into Y") \
+  /* load dword by pointer */ \
+  X(LXA,  0x1E, NONE,      4, FIXED, "Load dword from address stored in X into A") \
+  X(LYB,  0x1F, NONE,      4, FIXED, "Load dword from address stored in Y into B") \
+  /* store word to memory */ \
+  X(STAL, 0x20, ADDRESS,   4, FIXED, "Store lower word of A to mmmm") \
+  X(STAH, 0x21, ADDRESS,   4, FIXED, "Store higher word of A to mmmm") \
+  X(STBL, 0x22, ADDRESS,   4, FIXED, "Store lower word of B to mmmm") \
+  X(STBH, 0x23, ADDRESS,   4, FIXED, "Store higher word of B to mmmm") \
+  /* store word by pointer */ \
+  X(SXAL, 0x24, NONE,      2, FIXED, "Store lower word of A to address stored in X") \
+  X(SXAH, 0x25, NONE,      2, FIXED, "Store higher word of A to address stored in X") \
+  X(SYBL, 0x26, NONE,      2, FIXED, "Store lower word of B to address stored in Y") \
+  X(SYBH, 0x27, NONE,      2, FIXED, "Store higher word of B to address stored in Y") \
+  /* store dword to memory */ \
+  X(STA,  0x2A, ADDRESS,   5, FIXED, "Store dword from A to mmmm") \
+  X(STB,  0x2B, ADDRESS,   5, FIXED, "Store dword from B to mmmm") \
+  X(STX,  0x2C, ADDRESS,   5, FIXED, "Store dword from X to mmmm") \
+  X(STY,  0x2D, ADDRESS,   5, FIXED, "Store dword from Y to mmmm") \
+  /* store dword by pointer */ \
+  X(SXA,  0x2E, NONE,      3, FIXED, "Store dword from A to address stored in X") \
+  X(SYB,  0x2F, NONE,      3, FIXED, "Store dword from B to address stored in Y") \
+  /* ALU ops */ \
+  X(ADD,  0x30, NONE,      2, FIXED, "Add the contents of A and B and store the result in A") \
+  X(SUB,  0x31, NONE,      2, FIXED, "Subtract the contents of A and B and store the result in A") \
+  X(MUL,  0x32, NONE,      2, FIXED, "Multiply the contents of A and B and store the result in A") \
+  X(DIV,  0x33, NONE,      2, FIXED, "Divide the contents of A and B and store the result in A, dividing by zero stores FFFF") \
+  X(INC,  0x34, NONE,      2, FIXED, "Increment A by one") \
+  X(DEC,  0x35, NONE,      2, FIXED, "Decrement A by one") \
+  /* pointer arithmatic */ \
+  X(INCX, 0x36, NONE,      2, FIXED, "Increment X by one") \
+  X(INCY, 0x37, NONE,      2, FIXED, "Increment Y by one") \
+  X(DECX, 0x38, NONE,      2, FIXED, "Decrement X by one") \
+  X(DECY, 0x39, NONE,      2, FIXED, "Decrement Y by one") \
+  /* block memory ops */ \
+  X(BCPY, 0x3A, NONE,      2, BLOCK, "Copy A words from the address stored in X to the address stored in Y, adding A to X and Y and setting A to zero") \
+  X(BFIL, 0x3B, NONE,      2, BLOCK, "Fill A words from the address stored in X with the lower word of B, adding A to X and setting A to zero") \
+  X(BCMP, 0x3C, NONE,      2, BLOCK, "Compare A words at the addresses stored in X and Y, stopping at the first word that differs with X and Y pointing at it and A set to the number of words left") \
+  /* relative control flow */ \
+  X(JMPR, 0x40, OFFSET,    3, FIXED, "Add dd to PC") \
+  X(JEQR, 0x41, OFFSET,    3, FIXED, "Add dd to PC if the content A is equal to the content of B") \
+  X(JGTR, 0x42, OFFSET,    3, FIXED, "Add dd to PC if the content A is greater than the content of B") \
+  X(JLTR, 0x43, OFFSET,    3, FIXED, "Add dd to PC if the content A is less than the content of B") \
+  /* absolute control flow */ \
+  X(JMPA, 0x44, ADDRESS,   4, FIXED, "Set PC to mmmm") \
+  X(JEQA, 0x45, ADDRESS,   4, FIXED, "Set PC to mmmm if the content A is equal to the content of B") \
+  X(JGTA, 0x46, ADDRESS,   4, FIXED, "Set PC to mmmm if the content A is greater than the content of B") \
+  X(JLTA, 0x47, ADDRESS,   4, FIXED, "Set PC to mmmm if the content A is less than the content of B") \
+  /* stack push word */ \
+  X(PUAL, 0x50, NONE,      2, FIXED, "Push the lower word of A onto the stack and decrement STK by one") \
+  X(PUAH, 0x51, NONE,      2, FIXED, "Push the higher word of A onto the stack and decrement STK by one") \
+  X(PUBL, 0x52, NONE,      2, FIXED, "Push the lower word of B onto the stack and decrement STK by one") \
+  X(PUBH, 0x53, NONE,      2, FIXED, "Push the higher word of B onto the stack and decrement STK by one") \
+  /* stack push dword */ \
+  X(PUA,  0x5A, NONE,      3, FIXED, "Push the dword from A onto the stack and decrement STK by two") \
+  X(PUB,  0x5B, NONE,      3, FIXED, "Push the dword from B onto the stack and decrement STK by two") \
+  X(PUX,  0x5C, NONE,      3, FIXED, "Push the dword from X onto the stack and decrement STK by two") \
+  X(PUY,  0x5D, NONE,      3, FIXED, "Push the dword from Y onto the stack and decrement STK by two") \
+  /* stack pop word */ \
+  X(POAL, 0x60, NONE,      3, FIXED, "Pop word off the stack into the lower word of A and increment STK by one") \
+  X(POAH, 0x61, NONE,      3, FIXED, "Pop word off the stack into the higher word of A and increment STK by one") \
+  X(POBL, 0x62, NONE,      3, FIXED, "Pop word off the stack into the lower word of B and increment STK by one") \
+  X(POBH, 0x63, NONE,      3, FIXED, "Pop word off the stack into the higher word of B and increment STK by one") \
+  /* stack pop dword */ \
+  X(POA,  0x6A, NONE,      4, FIXED, "Pop dword off the stack into A and increment STK by two") \
+  X(POB,  0x6B, NONE,      4, FIXED, "Pop dword off the stack into B and increment STK by two") \
+  X(POX,  0x6C, NONE,      4, FIXED, "Pop dword off the stack into X and increment STK by two") \
+  X(POY,  0x6D, NONE,      4, FIXED, "Pop dword off the stack into Y and increment STK by two") \
+  /* interrupts */ \
+  X(SETV, 0x70, ADDRESS,   4, FIXED, "Set the address of the interrupt vector table to mmmm") \
+  X(EI,   0x71, NONE,      2, FIXED, "Enable interrupts") \
+  X(DI,   0x72, NONE,      2, FIXED, "Disable interrupts") \
+  X(RTI,  0x73, NONE,      4, FIXED, "Pop dword of the stack into PC and enable interrupts") \
+  X(WAIT, 0x74, NONE,      2, WAIT,  "Wait until an interrupt line is raised")
+
+#define ADR8_OP_ENUM(name, opcode, operand, cycles, timing, description) ADR8_Op_##name = opcode,
+
 typedef enum{ // ADR8_OpCode
-  // Misc ops
-  ADR8_Op_NOP  = 0x00,
-  ADR8_Op_HALT = 0x01,
-  
-  ADR8_Op_TRAK = 0x02, // transfer A to STK
-  ADR8_Op_TRAB = 0x03, // transfer A to B
-  ADR8_Op_TRBA = 0x04, // transfer B to A
-  ADR8_Op_TRAX = 0x05, // transfer A to X
-  ADR8_Op_TRXA = 0x06, // transfer X to A
-  ADR8_Op_TRAY = 0x07, // transfer A to Y
-  ADR8_Op_TRYA = 0x08, // transfer Y to A
-  
-  ADR8_Op_SETK = 0x09, // stack set
-  ADR8_Op_SETA = 0x0A,
-  ADR8_Op_SETB = 0x0B,
-  ADR8_Op_SETX = 0x0C,
-  ADR8_Op_SETY = 0x0D,
-  
-  ADR8_Op_JSR  = 0x0E, // jump subroutine
-  ADR8_Op_RSR  = 0x0F, // return from subroutine
-
-  // load word from memory
-  ADR8_Op_LDAL = 0x10,
-  ADR8_Op_LDAH = 0x11,
-  ADR8_Op_LDBL = 0x12,
-  ADR8_Op_LDBH = 0x13,
-
-  // load word by pointer
-  ADR8_Op_LXAL = 0x14,
-  ADR8_Op_LXAH = 0x15,
-  ADR8_Op_LYBL = 0x16,
-  ADR8_Op_LYBH = 0x17,
-
-  // load dword from memory
-  ADR8_Op_LDA  = 0x1A,
-  ADR8_Op_LDB  = 0x1B,
-  ADR8_Op_LDX  = 0x1C,
-  ADR8_Op_LDY  = 0x1D,
-
-  // load dword by pointer
-  ADR8_Op_LXA  = 0x1E,
-  ADR8_Op_LYB  = 0x1F,
-  
-  // store word to memory
-  ADR8_Op_STAL = 0x20,
-  ADR8_Op_STAH = 0x21,
-  ADR8_Op_STBL = 0x22,
-  ADR8_Op_STBH = 0x23,
-  
-  // store word by pointer
-  ADR8_Op_SXAL = 0x24,
-  ADR8_Op_SXAH = 0x25,
-  ADR8_Op_SYBL = 0x26,
-  ADR8_Op_SYBH = 0x27,
-
-  // store dword to memory
-  ADR8_Op_STA  = 0x2A,
-  ADR8_Op_STB  = 0x2B,
-  ADR8_Op_STX  = 0x2C,
-  ADR8_Op_STY  = 0x2D,
-  
-  // store dword by pointer
-  ADR8_Op_SXA  = 0x2E,
-  ADR8_Op_SYB  = 0x2F,
-  
-  // ALU ops
-  ADR8_Op_ADD  = 0x30,
-  ADR8_Op_SUB  = 0x31,
-  ADR8_Op_MUL  = 0x32,
-  ADR8_Op_DIV  = 0x33,
-  ADR8_Op_INC  = 0x34,
-  ADR8_Op_DEC  = 0x35,
-  
-  // pointer arithmatic
-  ADR8_Op_INCX = 0x36,
-  ADR8_Op_INCY = 0x37,
-  ADR8_Op_DECX = 0x38,
-  ADR8_Op_DECY = 0x39,
-
-  // relative control flow
-  ADR8_Op_JMPR = 0x40,
-  ADR8_Op_JEQR = 0x41,
-  ADR8_Op_JGTR = 0x42,
-  ADR8_Op_JLTR = 0x43,
-
-  // absolute control flow
-  ADR8_Op_JMPA = 0x44,
-  ADR8_Op_JEQA = 0x45,
-  ADR8_Op_JGTA = 0x46,
-  ADR8_Op_JLTA = 0x47,
-
-
-  // stack push word
-  ADR8_Op_PUAL = 0x50,
-  ADR8_Op_PUAH = 0x51,
-  ADR8_Op_PUBL = 0x52,
-  ADR8_Op_PUBH = 0x53,
-
-  // stack push dword
-  ADR8_Op_PUA  = 0x5A,
-  ADR8_Op_PUB  = 0x5B,
-  ADR8_Op_PUX  = 0x5C,
-  ADR8_Op_PUY  = 0x5D,
-
-  // stack pop word
-  ADR8_Op_POAL = 0x60,
-  ADR8_Op_POAH = 0x61,
-  ADR8_Op_POBL = 0x62,
-  ADR8_Op_POBH = 0x63,
-
-  // stack pop dword
-  ADR8_Op_POA  = 0x6A,
-  ADR8_Op_POB  = 0x6B,
-  ADR8_Op_POX  = 0x6C,
-  ADR8_Op_POY  = 0x6D,
-  
+  ADR8_OPCODES(ADR8_OP_ENUM)
 }ADR8_OpCode;
 
+#undef ADR8_OP_ENUM
+
+typedef enum{
+  ADR8_OPERAND_NONE,
+  ADR8_OPERAND_IMMEDIATE, // xxxx, a dword
+  ADR8_OPERAND_ADDRESS,   // mmmm, a dword bus address
+  ADR8_OPERAND_OFFSET,    // dd, a signed word added to the address of the next instruction
+}ADR8_OperandType;
+
+// bytes following the opcode
+#define ADR8_OPERAND_SIZE_NONE      0
+#define ADR8_OPERAND_SIZE_IMMEDIATE 2
+#define ADR8_OPERAND_SIZE_ADDRESS   2
+#define ADR8_OPERAND_SIZE_OFFSET    1
+
+typedef enum{
+  ADR8_TIMING_FIXED,
+  ADR8_TIMING_BLOCK, // plus block_cycles per word
+  ADR8_TIMING_WAIT,  // plus the cycles spent waiting
+}ADR8_Timing;
+
 typedef union{
   uint16_t full;
   struct{
@@ -251,27 +479,78 @@ typedef struct{
   Reg16_t b;
   Reg16_t x;
   Reg16_t y;
+  Reg16_t ivt; // interrupt vector table
 }ADR8_Registers;
 
+#ifndef ADR8_BLOCK_CYCLES
+#define ADR8_BLOCK_CYCLES 2
+#endif
+
+#define ADR8_CORE_IRQ_LINES 8
+
 typedef struct{
   ADR8_Registers reg;
   bool fetch;
   bool halt;
+  uint64_t cycles; // clock cycles executed since init
+  uint8_t block_cycles; // cycles charged per word by the block memory ops
+  uint32_t stall; // cycles left before the core continues
+  uint8_t irq_pending; // raised interrupt lines, bit n for line n
+  uint8_t irq_line; // line of the interrupt being entered
+  bool irq_enabled;
+  bool interrupt; // entering an interrupt handler
+  bool waiting; // executing WAIT without a raised interrupt
   ADR8_Bus* bus;
 } ADR8_Core;
 
+typedef struct{
+  const char* name;     // mnemonic, NULL if not implemented
+  uint8_t operand;      // ADR8_OperandType
+  uint8_t length;       // bytes including the opcode (0 if not implemented)
+  uint8_t cycles;       // cycles including the fetch cycle (0 if not implemented)
+  uint8_t timing;       // ADR8_Timing
+} ADR8_OpInfo;
+
+extern const ADR8_OpInfo ADR8_OpInfoTable[0x100];
+
+uint8_t ADR8_OpTiming_cycles(uint8_t opcode);
+
 void ADR8_Core_init(ADR8_Core* core, ADR8_Bus* bus);
 void ADR8_Core_print(ADR8_Core* core);
 void ADR8_Core_next_instruction(ADR8_Core* core);
 void ADR8_Core_fetch_next_operand(ADR8_Core* core);
 uint8_t ADR8_Core_get_operand_data(ADR8_Core* core);
+void ADR8_Core_raise_irq(ADR8_Core* core, uint8_t line);
+void ADR8_Core_clear_irq(ADR8_Core* core, uint8_t line);
 void ADR8_Core_clock(ADR8_Core* core);
 
 #ifdef ADR8_IMPLEMENTATION
 
+// conditional branches take as long whether they are taken or not
+#define ADR8_OP_INFO(name, opcode, operand, cycles, timing, description) \
+  [opcode] = {#name, ADR8_OPERAND_##operand, 1 + ADR8_OPERAND_SIZE_##operand, cycles, ADR8_TIMING_##timing},
+
+// the authoritative cycle counts of the ADR8_Core_clock state machine
+const ADR8_OpInfo ADR8_OpInfoTable[0x100] = {
+  ADR8_OPCODES(ADR8_OP_INFO)
+};
+
+#undef ADR8_OP_INFO
+
+uint8_t ADR8_OpTiming_cycles(uint8_t opcode){
+  return ADR8_OpInfoTable[opcode].cycles;
+}
+
 void ADR8_Core_init(ADR8_Core* core, ADR8_Bus* bus){
   core->bus = bus;
   core->fetch = true;
+  core->cycles = 0;
+  core->block_cycles = ADR8_BLOCK_CYCLES;
+  core->stall = 0;
+  core->irq_pending = 0;
+  core->irq_enabled = false;
+  core->interrupt = false;
+  core->waiting = false;
   memset(&core->reg, 0, sizeof(ADR8_Registers));
 }
 
@@ -301,6 +580,15 @@ void ADR8_Core_clear_bus(ADR8_Core* core){
 }
 
 void ADR8_Core_next_instruction(ADR8_Core* core){
+#if ADR8_LOG_LEVEL == ADR8_LOG_LEVEL_DEBUG
+  // fetch cycle + states 0..state must match the timing table, the block
+  // memory ops take a state per word when they can't use the host memory
+  uint8_t cycles = core->reg.cmd.state + 2;
+  if(cycles != ADR8_OpTiming_cycles(core->reg.cmd.opcode)
+      && ADR8_OpInfoTable[core->reg.cmd.opcode].timing != ADR8_TIMING_BLOCK){
+    ADR8_ERROR_LOG("timing table mismatch for [%02X]: took %hhu cycles\n", core->reg.cmd.opcode, cycles);
+  }
+#endif
   core->reg.pc.full++;
   core->fetch = true;
 }
@@ -314,18 +602,135 @@ uint8_t ADR8_Core_get_operand_data(ADR8_Core* core){
   return ADR8_Bus_get_data(core->bus);
 }
 
+// charges the cycles of words processed at once by a block memory op, on
+// top of the bus accesses already spent on them
+void ADR8_Core_block_stall(ADR8_Core* core, uint32_t words, uint8_t bus_cycles){
+  if(core->block_cycles > bus_cycles){
+    core->stall += words * (core->block_cycles - bus_cycles);
+  }
+}
+
+// runs the rest of a block memory op on the host if all words it touches
+// are in memory regions of the bus
+bool ADR8_Core_block_host(ADR8_Core* core){
+  uint16_t count = core->reg.a.full;
+  uint8_t* x = ADR8_Bus_get_region(core->bus, core->reg.x.full, count);
+  if(!x) return false;
+  switch(core->reg.cmd.opcode){
+    case ADR8_Op_BCPY:{
+      uint8_t* y = ADR8_Bus_get_region(core->bus, core->reg.y.full, count);
+      if(!y) return false;
+      ADR8_WRITE_HOOK(core->bus, core->reg.y.full, count);
+      if(y > x && y < x + count){
+        // the same result as copying word by word
+        for(uint16_t i = 0; i < count; ++i) y[i] = x[i];
+      }else{
+        memmove(y, x, count);
+      }
+      core->reg.x.full += count;
+      core->reg.y.full += count;
+      core->reg.a.full = 0;
+    } break;
+    case ADR8_Op_BFIL:{
+      ADR8_WRITE_HOOK(core->bus, core->reg.x.full, count);
+      memset(x, core->reg.b.half.l, count);
+      core->reg.x.full += count;
+      core->reg.a.full = 0;
+    } break;
+    case ADR8_Op_BCMP:{
+      uint8_t* y = ADR8_Bus_get_region(core->bus, core->reg.y.full, count);
+      if(!y) return false;
+      uint16_t equal = count;
+      if(memcmp(x, y, count) != 0){
+        equal = 0;
+        while(x[equal] == y[equal]) equal++;
+      }
+      core->reg.x.full += equal;
+      core->reg.y.full += equal;
+      core->reg.a.full -= equal;
+      count = equal + (equal != count);
+    } break;
+  }
+  ADR8_Core_block_stall(core, count, 0);
+  return true;
+}
+
+void ADR8_Core_raise_irq(ADR8_Core* core, uint8_t line){
+  assert(line < ADR8_CORE_IRQ_LINES);
+  core->irq_pending |= 1 << line;
+}
+
+// withdraws a raised line that wasn't taken yet
+void ADR8_Core_clear_irq(ADR8_Core* core, uint8_t line){
+  assert(line < ADR8_CORE_IRQ_LINES);
+  core->irq_pending &= ~(1 << line);
+}
+
+// takes the place of the fetch cycle and pushes the return address like
+// JSR before jumping to the vector of the lowest raised line
+void ADR8_Core_interrupt(ADR8_Core* core){
+  switch(core->reg.cmd.state){
+    case 0:{
+      core->irq_line = 0;
+      while(!(core->irq_pending & (1 << core->irq_line))) core->irq_line++;
+      core->irq_pending &= ~(1 << core->irq_line);
+      core->irq_enabled = false;
+      core->interrupt = true;
+      core->fetch = false;
+      // RTI returns to the address after the popped one
+      core->reg.adr.full = core->reg.pc.full - 1;
+      ADR8_Bus_write(core->bus, core->reg.stk.full, core->reg.adr.half.h);
+      core->reg.stk.full--;
+    } break;
+    case 1:{
+      ADR8_Bus_write(core->bus, core->reg.stk.full, core->reg.adr.half.l);
+      core->reg.stk.full--;
+    } break;
+    case 2:{
+      core->reg.adr.full = core->reg.ivt.full + 2*core->irq_line;
+      ADR8_Bus_read(core->bus, core->reg.adr.full);
+    } break;
+    case 3:{
+      core->reg.pc.half.l = ADR8_Bus_get_data(core->bus);
+      core->reg.adr.full++;
+      ADR8_Bus_read(core->bus, core->reg.adr.full);
+    } break;
+    case 4:{
+      core->reg.pc.half.h = ADR8_Bus_get_data(core->bus);
+      core->interrupt = false;
+      core->fetch = true;
+    } break;
+  }
+  core->reg.cmd.state++;
+}
+
 void ADR8_Core_clock(ADR8_Core* core){
   ADR8_Core_clear_bus(core);
   if(core->halt) return;
+  core->cycles++;
+
+  if(core->stall){
+    core->stall--;
+    return;
+  }
 
   if(core->fetch){
     core->reg.cmd.opcode = 0;
     core->reg.cmd.state = 0;
+    if(core->irq_enabled && core->irq_pending){
+      ADR8_Core_interrupt(core);
+      return;
+    }
     ADR8_Bus_read(core->bus, core->reg.pc.full);
     core->fetch = false;
     return;
   }
 
+  if(core->interrupt){
+    ADR8_Core_interrupt(core);
+    return;
+  }
+
   if(!core->reg.cmd.opcode){
     core->reg.cmd.opcode = ADR8_Bus_get_data(core->bus);
   }
@@ -333,7 +738,28 @@ void ADR8_Core_clock(ADR8_Core* core){
   switch (core->reg.cmd.opcode) {
     case ADR8_Op_NOP: ADR8_Core_next_instruction(core); break;
     case ADR8_Op_HALT: core->halt = true; break;
+
+    // transfer ops
+    case ADR8_Op_TRAK: core->reg.stk = core->reg.a; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_TRAB: core->reg.b = core->reg.a; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_TRBA: core->reg.a = core->reg.b; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_TRAX: core->reg.x = core->reg.a; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_TRXA: core->reg.a = core->reg.x; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_TRAY: core->reg.y = core->reg.a; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_TRYA: core->reg.a = core->reg.y; ADR8_Core_next_instruction(core); break;
     
+    // interrupts
+    case ADR8_Op_EI: core->irq_enabled = true; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_DI: core->irq_enabled = false; ADR8_Core_next_instruction(core); break;
+    case ADR8_Op_WAIT:{
+      core->waiting = !core->irq_pending;
+      if(!core->waiting){
+        ADR8_Core_next_instruction(core);
+        break;
+      }
+      core->reg.cmd.state = UINT8_MAX; // stay in state 0 until a line is raised
+    } break;
+
     // subroutines
     case ADR8_Op_JSR:{
       switch(core->reg.cmd.state){
@@ -352,12 +778,14 @@ void ADR8_Core_clock(ADR8_Core* core){
         case 3:{
           ADR8_Bus_write(core->bus, core->reg.stk.full, core->reg.pc.half.l);
           core->reg.stk.full--;
+          ADR8_BRANCH_HOOK(core, core->reg.pc.full, core->reg.adr.full);
           core->reg.pc.full = core->reg.adr.full;
           ADR8_Core_next_instruction(core);
         }break;
       }
     }break;
-    case ADR8_Op_RSR:{
+    case ADR8_Op_RSR:
+    case ADR8_Op_RTI:{
       switch(core->reg.cmd.state){
         case 0:{
           core->reg.stk.full++;
@@ -370,7 +798,9 @@ void ADR8_Core_clock(ADR8_Core* core){
         }break;
         case 2:{
           core->reg.adr.half.h = ADR8_Bus_get_data(core->bus);
+          ADR8_BRANCH_HOOK(core, core->reg.pc.full, core->reg.adr.full);
           core->reg.pc.full = core->reg.adr.full;
+          if(core->reg.cmd.opcode == ADR8_Op_RTI) core->irq_enabled = true;
           ADR8_Core_next_instruction(core);
         }break;
       }
@@ -435,6 +865,60 @@ void ADR8_Core_clock(ADR8_Core* core){
 
     }break;
 
+    // dword load ops
+    case ADR8_Op_LDA:
+    case ADR8_Op_LDB:
+    case ADR8_Op_LDX:
+    case ADR8_Op_LDY:
+    {
+      Reg16_t* reg = &core->reg.a + (core->reg.cmd.opcode - ADR8_Op_LDA);
+      switch(core->reg.cmd.state){
+        case 0:{
+          ADR8_Core_fetch_next_operand(core);
+        } break;
+        case 1:{
+          core->reg.adr.half.l = ADR8_Core_get_operand_data(core);
+          ADR8_Core_fetch_next_operand(core);
+        } break;
+        case 2:{
+          core->reg.adr.half.h = ADR8_Core_get_operand_data(core);
+          ADR8_Bus_read(core->bus, core->reg.adr.full);
+        } break;
+        case 3:{
+          reg->half.l = ADR8_Bus_get_data(core->bus);
+          core->reg.adr.full++;
+          ADR8_Bus_read(core->bus, core->reg.adr.full);
+        } break;
+        case 4:{
+          reg->half.h = ADR8_Bus_get_data(core->bus);
+          ADR8_Core_next_instruction(core);
+        } break;
+      }
+    } break;
+
+    // dword pointer load ops
+    case ADR8_Op_LXA:
+    case ADR8_Op_LYB:
+    {
+      Reg16_t* ptr_reg = core->reg.cmd.opcode == ADR8_Op_LXA ? &core->reg.x : &core->reg.y;
+      Reg16_t* reg = core->reg.cmd.opcode == ADR8_Op_LXA ? &core->reg.a : &core->reg.b;
+      switch(core->reg.cmd.state){
+        case 0:{
+          core->reg.adr = *ptr_reg;
+          ADR8_Bus_read(core->bus, core->reg.adr.full);
+        } break;
+        case 1:{
+          reg->half.l = ADR8_Bus_get_data(core->bus);
+          core->reg.adr.full++;
+          ADR8_Bus_read(core->bus, core->reg.adr.full);
+        } break;
+        case 2:{
+          reg->half.h = ADR8_Bus_get_data(core->bus);
+          ADR8_Core_next_instruction(core);
+        } break;
+      }
+    } break;
+
     // Store ops
     case ADR8_Op_STAL:
     case ADR8_Op_STAH:
@@ -476,6 +960,52 @@ void ADR8_Core_clock(ADR8_Core* core){
       ADR8_Core_next_instruction(core);
     }break;
 
+    // dword store ops
+    case ADR8_Op_STA:
+    case ADR8_Op_STB:
+    case ADR8_Op_STX:
+    case ADR8_Op_STY:
+    {
+      Reg16_t* reg = &core->reg.a + (core->reg.cmd.opcode - ADR8_Op_STA);
+      switch(core->reg.cmd.state){
+        case 0:{
+          ADR8_Core_fetch_next_operand(core);
+        } break;
+        case 1:{
+          core->reg.adr.half.l = ADR8_Core_get_operand_data(core);
+          ADR8_Core_fetch_next_operand(core);
+        } break;
+        case 2:{
+          core->reg.adr.half.h = ADR8_Core_get_operand_data(core);
+          ADR8_Bus_write(core->bus, core->reg.adr.full, reg->half.l);
+        } break;
+        case 3:{
+          core->reg.adr.full++;
+          ADR8_Bus_write(core->bus, core->reg.adr.full, reg->half.h);
+          ADR8_Core_next_instruction(core);
+        } break;
+      }
+    } break;
+
+    // dword pointer store ops
+    case ADR8_Op_SXA:
+    case ADR8_Op_SYB:
+    {
+      Reg16_t* ptr_reg = core->reg.cmd.opcode == ADR8_Op_SXA ? &core->reg.x : &core->reg.y;
+      Reg16_t* reg = core->reg.cmd.opcode == ADR8_Op_SXA ? &core->reg.a : &core->reg.b;
+      switch(core->reg.cmd.state){
+        case 0:{
+          core->reg.adr = *ptr_reg;
+          ADR8_Bus_write(core->bus, core->reg.adr.full, reg->half.l);
+        } break;
+        case 1:{
+          core->reg.adr.full++;
+          ADR8_Bus_write(core->bus, core->reg.adr.full, reg->half.h);
+          ADR8_Core_next_instruction(core);
+        } break;
+      }
+    } break;
+
     // ALU Ops
     case ADR8_Op_ADD:{
       core->reg.a.full += core->reg.b.full;
@@ -490,7 +1020,8 @@ void ADR8_Core_clock(ADR8_Core* core){
       ADR8_Core_next_instruction(core);
     } break;
     case ADR8_Op_DIV:{
-      core->reg.a.full /= core->reg.b.full;
+      // dividing by zero gives all ones instead of trapping the host
+      core->reg.a.full = core->reg.b.full ? core->reg.a.full / core->reg.b.full : 0xFFFF;
       ADR8_Core_next_instruction(core);
     } break;
     case ADR8_Op_INC:{
@@ -521,6 +1052,80 @@ void ADR8_Core_clock(ADR8_Core* core){
     } break;
 
 
+    // block memory ops, words are processed on the host when possible and
+    // otherwise one bus access at a time, state 0 is restarted per word
+    case ADR8_Op_BCPY:
+    {
+      switch(core->reg.cmd.state){
+        case 0:{
+          if(!core->reg.a.full || ADR8_Core_block_host(core)){
+            ADR8_Core_next_instruction(core);
+            break;
+          }
+          ADR8_Bus_read(core->bus, core->reg.x.full);
+        } break;
+        case 1:{
+          ADR8_Bus_write(core->bus, core->reg.y.full, ADR8_Bus_get_data(core->bus));
+          core->reg.x.full++;
+          core->reg.y.full++;
+          core->reg.a.full--;
+          ADR8_Core_block_stall(core, 1, 2);
+          core->reg.cmd.state = UINT8_MAX;
+        } break;
+      }
+    } break;
+    case ADR8_Op_BFIL:
+    {
+      if(!core->reg.a.full || ADR8_Core_block_host(core)){
+        ADR8_Core_next_instruction(core);
+        break;
+      }
+      ADR8_Bus_write(core->bus, core->reg.x.full, core->reg.b.half.l);
+      core->reg.x.full++;
+      core->reg.a.full--;
+      ADR8_Core_block_stall(core, 1, 1);
+      core->reg.cmd.state = UINT8_MAX;
+    } break;
+    case ADR8_Op_BCMP:
+    {
+      switch(core->reg.cmd.state){
+        case 0:{
+          if(!core->reg.a.full || ADR8_Core_block_host(core)){
+            ADR8_Core_next_instruction(core);
+            break;
+          }
+          ADR8_Bus_read(core->bus, core->reg.x.full);
+        } break;
+        case 1:{
+          core->reg.adr.half.l = ADR8_Bus_get_data(core->bus);
+          ADR8_Bus_read(core->bus, core->reg.y.full);
+        } break;
+        case 2:{
+          if(core->reg.adr.half.l != ADR8_Bus_get_data(core->bus)){
+            ADR8_Core_block_stall(core, 1, 2);
+            ADR8_Core_next_instruction(core);
+            break;
+          }
+          core->reg.x.full++;
+          core->reg.y.full++;
+          core->reg.a.full--;
+          if(!core->reg.a.full){
+            ADR8_Core_block_stall(core, 1, 2);
+            ADR8_Core_next_instruction(core);
+          }else if(core->block_cycles > 2){
+            // a stall would lose the data of a read, so the next word
+            // starts at state 0 after it
+            ADR8_Core_block_stall(core, 1, 3);
+            core->reg.cmd.state = UINT8_MAX;
+          }else{
+            // the next word is read right away, continuing at state 1
+            ADR8_Bus_read(core->bus, core->reg.x.full);
+            core->reg.cmd.state = 0;
+          }
+        } break;
+      }
+    } break;
+
     // relative control flow
     case ADR8_Op_JMPR:
     case ADR8_Op_JEQR:
@@ -539,6 +1144,7 @@ void ADR8_Core_clock(ADR8_Core* core){
             case ADR8_Op_JGTR: offset *= (core->reg.a.full > core->reg.b.full); break;
             case ADR8_Op_JLTR: offset *= (core->reg.a.full < core->reg.b.full); break;
           }
+          if(offset) ADR8_BRANCH_HOOK(core, core->reg.pc.full, core->reg.pc.full + offset);
           core->reg.pc.full += offset;
           ADR8_Core_next_instruction(core);
         } break;
@@ -569,6 +1175,7 @@ void ADR8_Core_clock(ADR8_Core* core){
             case ADR8_Op_JLTA: jmp = (core->reg.a.full < core->reg.b.full); break;
           }
           if(jmp){
+            ADR8_BRANCH_HOOK(core, core->reg.pc.full, core->reg.adr.full);
             core->reg.pc = core->reg.adr;
             core->reg.pc.full--;
           }
@@ -588,6 +1195,27 @@ void ADR8_Core_clock(ADR8_Core* core){
       ADR8_Core_next_instruction(core);
     } break;
 
+    // stack push dword, the higher word is pushed first like the return
+    // address of JSR
+    case ADR8_Op_PUA:
+    case ADR8_Op_PUB:
+    case ADR8_Op_PUX:
+    case ADR8_Op_PUY:
+    {
+      Reg16_t* reg = &core->reg.a + (core->reg.cmd.opcode - ADR8_Op_PUA);
+      switch(core->reg.cmd.state){
+        case 0:{
+          ADR8_Bus_write(core->bus, core->reg.stk.full, reg->half.h);
+          core->reg.stk.full--;
+        } break;
+        case 1:{
+          ADR8_Bus_write(core->bus, core->reg.stk.full, reg->half.l);
+          core->reg.stk.full--;
+          ADR8_Core_next_instruction(core);
+        } break;
+      }
+    } break;
+
     // stack pop
     case ADR8_Op_POAL:
     case ADR8_Op_POAH:
@@ -606,11 +1234,36 @@ void ADR8_Core_clock(ADR8_Core* core){
         } break;
       }
     } break;
+
+    // stack pop dword
+    case ADR8_Op_POA:
+    case ADR8_Op_POB:
+    case ADR8_Op_POX:
+    case ADR8_Op_POY:
+    {
+      Reg16_t* reg = &core->reg.a + (core->reg.cmd.opcode - ADR8_Op_POA);
+      switch(core->reg.cmd.state){
+        case 0:{
+          core->reg.stk.full++;
+          ADR8_Bus_read(core->bus, core->reg.stk.full);
+        } break;
+        case 1:{
+          reg->half.l = ADR8_Bus_get_data(core->bus);
+          core->reg.stk.full++;
+          ADR8_Bus_read(core->bus, core->reg.stk.full);
+        } break;
+        case 2:{
+          reg->half.h = ADR8_Bus_get_data(core->bus);
+          ADR8_Core_next_instruction(core);
+        } break;
+      }
+    } break;
     case ADR8_Op_SETK:
     case ADR8_Op_SETA:
     case ADR8_Op_SETB:
     case ADR8_Op_SETX:
     case ADR8_Op_SETY:
+    case ADR8_Op_SETV:
     {
       Reg16_t* reg = NULL;
       switch(core->reg.cmd.opcode){
@@ -619,6 +1272,7 @@ void ADR8_Core_clock(ADR8_Core* core){
         case ADR8_Op_SETB: reg = &core->reg.b; break;
         case ADR8_Op_SETX: reg = &core->reg.x; break;
         case ADR8_Op_SETY: reg = &core->reg.y; break;
+        case ADR8_Op_SETV: reg = &core->reg.ivt; break;
       }
 
       switch (core->reg.cmd.state) {
@@ -649,4 +1303,227 @@ void ADR8_Core_clock(ADR8_Core* core){
 #endif // ADR8_IMPLEMENTATION
 
 
+// ADR8_Scheduler
+
+// Runs a core together with devices that act at future cycles, such as
+// timers, instead of clocking them every cycle. Devices schedule events on a
+// min-heap of cycles and the core runs uninterrupted until the next one,
+// skipping ahead while it waits or stalls. Bus devices are clocked through
+// ADR8_Bus_clock on the cycles they are accessed.
+//
+// A device that would block the host sets bus->blocked instead, the run
+// returns in the middle of that cycle and resumes where it left off on the
+// next call, so one thread can run many cores and move on to another one
+// while input is missing.
+
+typedef void (*ADR8_EventHandler)(void* device, uint64_t cycle);
+
+typedef struct{
+  uint64_t cycle;
+  uint64_t seq;    // orders events of the same cycle by scheduling order
+  uint64_t period; // reschedules the event every period cycles, 0 for once
+  ADR8_EventHandler handler;
+  void* device;
+} ADR8_Event;
+
+typedef struct{
+  ADR8_Event* events; // min-heap ordered by cycle and seq
+  size_t count;
+  size_t capacity;
+  uint64_t seq;
+  uint64_t idle; // cycles skipped while the core waited with no event left to wake it
+} ADR8_Scheduler;
+
+void ADR8_Scheduler_init(ADR8_Scheduler* sched);
+void ADR8_Scheduler_free(ADR8_Scheduler* sched);
+void ADR8_Scheduler_add(ADR8_Scheduler* sched, uint64_t cycle, uint64_t period, ADR8_EventHandler handler, void* device);
+size_t ADR8_Scheduler_cancel(ADR8_Scheduler* sched, ADR8_EventHandler handler, void* device);
+uint64_t ADR8_Scheduler_next(ADR8_Scheduler* sched);
+void ADR8_Scheduler_dispatch(ADR8_Scheduler* sched, uint64_t cycle);
+void ADR8_Scheduler_run(ADR8_Scheduler* sched, ADR8_Core* core, uint64_t until);
+
+#ifdef ADR8_IMPLEMENTATION
+
+void ADR8_Scheduler_init(ADR8_Scheduler* sched){
+  memset(sched, 0, sizeof(ADR8_Scheduler));
+}
+
+void ADR8_Scheduler_free(ADR8_Scheduler* sched){
+  free(sched->events);
+  memset(sched, 0, sizeof(ADR8_Scheduler));
+}
+
+static bool ADR8_Event_before(ADR8_Event* a, ADR8_Event* b){
+  return a->cycle < b->cycle || (a->cycle == b->cycle && a->seq < b->seq);
+}
+
+static void ADR8_Scheduler_sift_up(ADR8_Scheduler* sched, size_t i){
+  while(i > 0){
+    size_t parent = (i-1)/2;
+    if(!ADR8_Event_before(&sched->events[i], &sched->events[parent])) break;
+    ADR8_Event tmp = sched->events[i];
+    sched->events[i] = sched->events[parent];
+    sched->events[parent] = tmp;
+    i = parent;
+  }
+}
+
+static void ADR8_Scheduler_sift_down(ADR8_Scheduler* sched, size_t i){
+  for(;;){
+    size_t first = i;
+    size_t left = 2*i + 1;
+    size_t right = left + 1;
+    if(left < sched->count && ADR8_Event_before(&sched->events[left], &sched->events[first])) first = left;
+    if(right < sched->count && ADR8_Event_before(&sched->events[right], &sched->events[first])) first = right;
+    if(first == i) break;
+    ADR8_Event tmp = sched->events[i];
+    sched->events[i] = sched->events[first];
+    sched->events[first] = tmp;
+    i = first;
+  }
+}
+
+static void ADR8_Scheduler_push(ADR8_Scheduler* sched, ADR8_Event event){
+  if(sched->count == sched->capacity){
+    sched->capacity = sched->capacity ? sched->capacity*2 : 16;
+    sched->events = realloc(sched->events, sched->capacity*sizeof(ADR8_Event));
+    assert(sched->events);
+  }
+  event.seq = sched->seq++;
+  sched->events[sched->count] = event;
+  ADR8_Scheduler_sift_up(sched, sched->count++);
+}
+
+static ADR8_Event ADR8_Scheduler_pop(ADR8_Scheduler* sched){
+  ADR8_Event event = sched->events[0];
+  sched->events[0] = sched->events[--sched->count];
+  ADR8_Scheduler_sift_down(sched, 0);
+  return event;
+}
+
+// runs handler at cycle and then every period cycles if period isn't 0, a
+// clock divider of n is an event with a period of n
+void ADR8_Scheduler_add(ADR8_Scheduler* sched, uint64_t cycle, uint64_t period, ADR8_EventHandler handler, void* device){
+  ADR8_Scheduler_push(sched, (ADR8_Event){.cycle = cycle, .period = period, .handler = handler, .device = device});
+}
+
+// removes the pending events of handler for device, returns how many
+size_t ADR8_Scheduler_cancel(ADR8_Scheduler* sched, ADR8_EventHandler handler, void* device){
+  size_t removed = 0;
+  for(size_t i = 0; i < sched->count;){
+    if(sched->events[i].handler == handler && sched->events[i].device == device){
+      sched->events[i] = sched->events[--sched->count];
+      removed++;
+    }else{
+      i++;
+    }
+  }
+  if(removed){
+    for(size_t i = sched->count/2; i-- > 0;) ADR8_Scheduler_sift_down(sched, i);
+  }
+  return removed;
+}
+
+// cycle of the next event, UINT64_MAX if there is none
+uint64_t ADR8_Scheduler_next(ADR8_Scheduler* sched){
+  return sched->count ? sched->events[0].cycle : UINT64_MAX;
+}
+
+// runs the events due at or before cycle
+void ADR8_Scheduler_dispatch(ADR8_Scheduler* sched, uint64_t cycle){
+  while(sched->count && sched->events[0].cycle <= cycle){
+    ADR8_Event event = ADR8_Scheduler_pop(sched);
+    if(event.period){
+      ADR8_Event next = event;
+      next.cycle += event.period;
+      ADR8_Scheduler_push(sched, next);
+    }
+    event.handler(event.device, event.cycle);
+  }
+}
+
+// runs the core until it halts or executed until cycles, events run after
+// the cycle they are scheduled at, returns early if the core waits without
+// any event left
+void ADR8_Scheduler_run(ADR8_Scheduler* sched, ADR8_Core* core, uint64_t until){
+  ADR8_Bus* bus = core->bus;
+  if(bus->blocked){
+    // the core already made its access, only the device is clocked again
+    bus->blocked = NULL;
+    ADR8_Bus_clock(bus);
+    if(bus->blocked) return;
+    ADR8_Scheduler_dispatch(sched, core->cycles);
+  }
+  while(!core->halt && core->cycles < until){
+    uint64_t next = ADR8_Scheduler_next(sched);
+    uint64_t stop = next < until ? next : until;
+    while(!core->halt && core->cycles < stop){
+      // nothing on the bus changes while the core waits or stalls
+      if(core->waiting && !core->irq_pending){
+        if(stop == UINT64_MAX) return; // nothing left that could wake it
+        if(!sched->count) sched->idle += stop - core->cycles;
+        core->cycles = stop;
+        break;
+      }
+      if(core->stall){
+        uint64_t skip = stop - core->cycles;
+        if(skip > core->stall) skip = core->stall;
+        core->cycles += skip;
+        core->stall -= skip;
+        continue;
+      }
+      ADR8_Core_clock(core);
+      ADR8_Bus_clock(bus);
+      if(bus->blocked) return;
+      // a device accessed in this cycle may have scheduled an earlier event
+      if(sched->count && sched->events[0].cycle < stop) stop = sched->events[0].cycle;
+    }
+    ADR8_Scheduler_dispatch(sched, core->cycles);
+  }
+}
+
+#endif // ADR8_IMPLEMENTATION
+
+// ADR8_Machine
+
+// A core, its bus and memory in one allocation. The core comes first so its
+// registers and decode state share the first cache line, the memory data
+// follows the structs starting at a cache line of its own. Creating or
+// freeing a machine is a single allocation, devices are attached to
+// machine->bus as usual.
+
+#define ADR8_CACHE_LINE 64
+
+typedef struct{
+  ADR8_Core core;
+  ADR8_Bus bus;
+  ADR8_Memory mem;
+  size_t size; // bytes allocated, a copy of them is a snapshot of the machine
+  _Alignas(ADR8_CACHE_LINE) uint8_t ram[];
+} ADR8_Machine;
+
+ADR8_Machine* ADR8_Machine_new(uint16_t ram_size, uint16_t mount_address);
+void ADR8_Machine_free(ADR8_Machine* machine);
+
+#ifdef ADR8_IMPLEMENTATION
+
+// zeroes the machine including its memory, returns NULL when out of memory
+ADR8_Machine* ADR8_Machine_new(uint16_t ram_size, uint16_t mount_address){
+  size_t size = sizeof(ADR8_Machine) + ram_size;
+  size = (size + ADR8_CACHE_LINE - 1) / ADR8_CACHE_LINE * ADR8_CACHE_LINE;
+  ADR8_Machine* machine = aligned_alloc(ADR8_CACHE_LINE, size);
+  if(!machine) return NULL;
+  memset(machine, 0, size);
+  machine->size = size;
+  ADR8_Memory_init_data(&machine->mem, &machine->bus, machine->ram, ram_size, mount_address);
+  ADR8_Core_init(&machine->core, &machine->bus);
+  return machine;
+}
+
+// devices attached to the machine's bus must be freed separately
+void ADR8_Machine_free(ADR8_Machine* machine){
+  free(machine);
+}
+#endif // ADR8_IMPLEMENTATION
+
 #endif // ADR8_H_
@@ -0,0 +1,102 @@
+// translated from ./build/examples/hello_world.bin by the ADR8 recompiler, compile with -I utilities
+#define ADR8_IMPLEMENTATION
+#include "recompiler.h"
+
+static const uint8_t image[59] = {
+  0x39, 0x00, 0x10, 0x00, 0x10, 0x11, 0x00, 0x10, 0x0D, 0x00, 0x00, 0x12, 0x00, 0x10, 0x26, 0x37,
+  0x35, 0x0B, 0x00, 0x00, 0x46, 0x09, 0x00, 0x44, 0x27, 0x00, 0x00, 0x68, 0x65, 0x6C, 0x6C, 0x6F,
+  0x20, 0x77, 0x6F, 0x72, 0x6C, 0x64, 0x21, 0x0A, 0x00, 0x0C, 0x19, 0x00, 0x0B, 0x00, 0x00, 0x14,
+  0x45, 0x38, 0x00, 0x20, 0x00, 0x10, 0x36, 0x44, 0x2D, 0x00, 0x01,
+};
+
+static const ADR8_RecompiledSegment segments[] = {
+  {0x0015, 0x0018},
+  {0x0027, 0x002D},
+  {0x002D, 0x0031},
+  {0x0031, 0x0038},
+  {0x0038, 0x0039},
+};
+
+static void execute(ADR8_Recompiled* rt){
+  ADR8_Core* core = &rt->machine->core;
+  uint8_t* ram = rt->machine->mem.data;
+  uint64_t cycles;
+  uint16_t pc, a, b, x, y, k;
+  uint8_t t;
+  (void)t;
+  RECOMPILED_LOAD();
+
+dispatch:
+  switch(pc){
+    case 0x0015: goto S_0015;
+    case 0x0027: goto S_0027;
+    case 0x002D: goto S_002D;
+    case 0x0031: goto S_0031;
+    case 0x0038: goto S_0038;
+  }
+
+interpret:
+  RECOMPILED_STORE();
+  if(!ADR8_Recompiled_interpret(rt)) return;
+  RECOMPILED_LOAD();
+  goto dispatch;
+
+S_0015:
+  RECOMPILED_CHECK(0x0015, 4);
+  //  0015: JMPA PROGRAM_ENTRY (0x0027)
+  cycles += 4;
+  goto S_0027;
+
+S_0027: // PROGRAM_ENTRY
+  RECOMPILED_CHECK(0x0027, 8);
+  //  0027: SETX 0x0019
+  x = 0x0019;
+  cycles += 4;
+  //  002A: SETB 0x0000
+  b = 0x0000;
+  cycles += 4;
+  goto S_002D;
+
+S_002D: // LOOP
+  RECOMPILED_CHECK(0x002D, 7);
+  //  002D: LXAL
+  RECOMPILED_SET_L(a, RECOMPILED_READ(x, 2));
+  cycles += 3;
+  RECOMPILED_CHECK(0x002E, 4);
+  //  002E: JEQA STOP (0x0038)
+  cycles += 4;
+  if(a == b){
+    goto S_0038;
+  }
+  goto S_0031;
+
+S_0031:
+  RECOMPILED_CHECK(0x0031, 10);
+  //  0031: STAL 0x1000
+  RECOMPILED_WRITE(0x1000, a & 0xFF, 4);
+  cycles += 4;
+  RECOMPILED_CHECK(0x0034, 6);
+  //  0034: INCX
+  x++;
+  cycles += 2;
+  //  0035: JMPA LOOP (0x002D)
+  cycles += 4;
+  goto S_002D;
+
+S_0038: // STOP
+  RECOMPILED_CHECK(0x0038, 2);
+  //  0038: HALT
+  cycles += 2;
+  core->halt = true;
+  RECOMPILED_EXIT(0x0038);
+}
+
+const ADR8_RecompiledProgram ADR8_recompiled_program = {
+  .image = image,
+  .size = sizeof(image),
+  .bootstrapped = true,
+  .entry = 0x0015,
+  .segments = segments,
+  .segment_count = 5,
+  .execute = execute,
+};
@@ -0,0 +1,145 @@
+#ifndef ADR8_BANK_H
+#define ADR8_BANK_H
+
+#include "../ADR8.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Maps one of many banks of host memory into a window of the address space.
+// The bank is selected by writing its number to a dword register, which only
+// moves a pointer. The banks are either allocated or a memory mapped file so
+// data sets larger than the address space don't have to be streamed in.
+
+typedef struct{
+  uint16_t window_address;
+  uint16_t window_size;  // bytes per bank
+  uint16_t select_address; // lower word of the select register, higher word follows
+  uint8_t* data;     // all banks back to back
+  size_t data_size;
+  uint32_t bank_count;
+  Reg16_t select;
+  uint8_t* window;   // selected bank, NULL if select is out of range
+  int region;        // bus region of the window, -1 if it has none
+  bool mapped;
+  ADR8_Bus* bus;
+} ADR8_Bank;
+
+void ADR8_Bank_init(ADR8_Bank* bank, ADR8_Bus* bus, uint32_t bank_count, uint16_t window_size, uint16_t window_address, uint16_t select_address);
+bool ADR8_Bank_init_file(ADR8_Bank* bank, ADR8_Bus* bus, const char* path, bool shared, uint16_t window_size, uint16_t window_address, uint16_t select_address);
+void ADR8_Bank_free(ADR8_Bank* bank);
+void ADR8_Bank_select(ADR8_Bank* bank, uint16_t index);
+void ADR8_Bank_clock(ADR8_Bank* bank);
+void ADR8_Bank_bus_clock(void* bank);
+
+#ifdef ADR8_IMPLEMENTATION
+
+static void ADR8_Bank_attach(ADR8_Bank* bank, ADR8_Bus* bus, uint16_t window_size, uint16_t window_address, uint16_t select_address){
+  assert(window_size > 0);
+  bank->bus = bus;
+  bank->window_size = window_size;
+  bank->window_address = window_address;
+  bank->select_address = select_address;
+  bank->region = ADR8_Bus_add_region(bus, window_address, window_size, bank->data);
+  ADR8_Bus_attach(bus, window_address, window_size, ADR8_Bank_bus_clock, bank);
+  ADR8_Bus_attach(bus, select_address, 2, ADR8_Bank_bus_clock, bank);
+  ADR8_Bank_select(bank, 0);
+}
+
+void ADR8_Bank_init(ADR8_Bank* bank, ADR8_Bus* bus, uint32_t bank_count, uint16_t window_size, uint16_t window_address, uint16_t select_address){
+  memset(bank, 0, sizeof(ADR8_Bank));
+  bank->bank_count = bank_count;
+  bank->data_size = (size_t)bank_count*window_size;
+  bank->data = calloc(bank->data_size, 1);
+  assert(bank->data);
+  ADR8_Bank_attach(bank, bus, window_size, window_address, select_address);
+}
+
+// maps the file at path as banks, shared writes go to the file while
+// otherwise they only change the mapping, a last partial bank reads zeros
+// after the end of the file
+bool ADR8_Bank_init_file(ADR8_Bank* bank, ADR8_Bus* bus, const char* path, bool shared, uint16_t window_size, uint16_t window_address, uint16_t select_address){
+  memset(bank, 0, sizeof(ADR8_Bank));
+  int fd = open(path, shared ? O_RDWR : O_RDONLY);
+  if(fd < 0){
+    ADR8_ERROR_LOG("bank: unable to open '%s': %s\n", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size == 0){
+    ADR8_ERROR_LOG("bank: unable to map empty or unreadable file '%s'\n", path);
+    close(fd);
+    return false;
+  }
+  bank->bank_count = (st.st_size + window_size - 1)/window_size;
+  bank->data_size = (size_t)bank->bank_count*window_size;
+  // reserve every bank so the end of a partial bank doesn't fault
+  bank->data = mmap(NULL, bank->data_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(bank->data == MAP_FAILED
+      || mmap(bank->data, st.st_size, PROT_READ | PROT_WRITE, (shared ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fd, 0) == MAP_FAILED){
+    ADR8_ERROR_LOG("bank: unable to map '%s': %s\n", path, strerror(errno));
+    if(bank->data != MAP_FAILED) munmap(bank->data, bank->data_size);
+    close(fd);
+    return false;
+  }
+  close(fd);
+  bank->mapped = true;
+  ADR8_Bank_attach(bank, bus, window_size, window_address, select_address);
+  return true;
+}
+
+void ADR8_Bank_free(ADR8_Bank* bank){
+  if(bank->mapped){
+    munmap(bank->data, bank->data_size);
+  }else{
+    free(bank->data);
+  }
+  bank->data = NULL;
+  bank->window = NULL;
+}
+
+void ADR8_Bank_select(ADR8_Bank* bank, uint16_t index){
+  bank->select.full = index;
+  bank->window = index < bank->bank_count ? bank->data + (size_t)index*bank->window_size : NULL;
+  if(bank->region >= 0){
+    // block instructions use the bus for a window without a bank
+    ADR8_BusRegion* region = &bank->bus->regions[bank->region];
+    region->data = bank->window;
+    region->size = bank->window ? bank->window_size : 0;
+  }
+}
+
+void ADR8_Bank_clock(ADR8_Bank* bank){
+  uint16_t select_reg = bank->bus->address - bank->select_address;
+  if(select_reg < 2){
+    if(bank->bus->read){
+      bank->bus->data = select_reg ? bank->select.half.h : bank->select.half.l;
+    }else{
+      Reg16_t select = bank->select;
+      if(select_reg) select.half.h = bank->bus->data;
+      else select.half.l = bank->bus->data;
+      ADR8_Bank_select(bank, select.full);
+      ADR8_DEBUG_LOG("bank: selected %04hX\n", select.full);
+    }
+    return;
+  }
+  uint16_t offset = bank->bus->address - bank->window_address;
+  if(offset < bank->window_size && bank->window){
+    if(bank->bus->read){
+      bank->bus->data = bank->window[offset];
+    }else{
+      bank->window[offset] = bank->bus->data;
+    }
+  }
+}
+
+void ADR8_Bank_bus_clock(void* bank){
+  ADR8_Bank_clock(bank);
+}
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_BANK_H
@@ -0,0 +1,324 @@
+#ifndef ADR8_NETWORK_H
+#define ADR8_NETWORK_H
+
+#include "../ADR8.h"
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Network connecting machines in one process, each through a network card
+// (ADR8_Nic) on its bus. Frames are copied from and to memory at once (DMA)
+// like sectors of the block storage, so the memory has to be an ADR8_Memory
+// or another bus region. Every node has a lock-free queue that any other
+// node pushes its frames to and only the node itself takes them from, so
+// nodes can run on their own threads without a lock between them.
+//
+// A frame arrives latency cycles after its last byte was sent, sending takes
+// cycles_per_byte cycles per byte and a node's frames are sent one after
+// another. Every node counts its own cycles, a frame is stamped with the
+// cycle of its sender and arrives when the receiver reaches that cycle, so
+// the host has to keep the nodes close together, see ADR8_Nic_poll.
+
+#ifndef ADR8_NETWORK_MAX_NODES
+#define ADR8_NETWORK_MAX_NODES 255
+#endif
+
+#define ADR8_NETWORK_MTU 0xFF // bytes in a frame
+
+typedef struct{
+  uint64_t cycle; // arrives once the receiver reaches it
+  uint64_t seq;   // frames the sender sent before
+  uint8_t source;
+  uint8_t length;
+  uint8_t data[ADR8_NETWORK_MTU];
+} ADR8_Frame;
+
+// a frame in a queue, allocated by its sender and freed by its receiver
+typedef struct ADR8_QueuedFrame{
+  struct ADR8_QueuedFrame* next;
+  ADR8_Frame frame;
+} ADR8_QueuedFrame;
+
+// unbounded stack with many producers and a single consumer that takes all
+// of it at once, so no frame is dropped and the consumer never pops a frame
+// a producer could push again (no ABA)
+typedef struct{
+  _Alignas(ADR8_CACHE_LINE) _Atomic(ADR8_QueuedFrame*) top;
+} ADR8_FrameQueue;
+
+typedef struct{
+  uint16_t node_count;
+  uint64_t latency;
+  uint64_t cycles_per_byte;
+  ADR8_FrameQueue* queues; // one for every node
+} ADR8_Network;
+
+bool ADR8_Network_init(ADR8_Network* network, uint16_t node_count, uint64_t latency, uint64_t cycles_per_byte);
+void ADR8_Network_free(ADR8_Network* network);
+bool ADR8_FrameQueue_push(ADR8_FrameQueue* queue, const ADR8_Frame* frame);
+ADR8_QueuedFrame* ADR8_FrameQueue_take(ADR8_FrameQueue* queue);
+
+// register offsets from the mount address
+#define ADR8_NIC_DEST      0 // node to send to
+#define ADR8_NIC_LENGTH    1 // bytes to send, the length of the frame after a receive
+#define ADR8_NIC_ADDRESS_L 2 // memory address to send from or receive to
+#define ADR8_NIC_ADDRESS_H 3
+#define ADR8_NIC_COMMAND   4 // writing a command runs it
+#define ADR8_NIC_STATUS    5 // cleared when read
+#define ADR8_NIC_RECEIVED  6 // frames that arrived and weren't received yet
+#define ADR8_NIC_SOURCE    7 // node the received frame came from
+#define ADR8_NIC_NODE      8 // read only
+#define ADR8_NIC_NODES     9 // nodes on the network, read only
+#define ADR8_NIC_REGISTERS 10
+
+#define ADR8_NIC_CMD_SEND    0x1 // memory to a frame for DEST
+#define ADR8_NIC_CMD_RECEIVE 0x2 // the first frame that arrived to memory
+
+#define ADR8_NIC_DONE  0x1
+#define ADR8_NIC_ERROR 0x2
+
+typedef struct{
+  uint16_t mount_address;
+  ADR8_Bus* bus;
+  ADR8_Scheduler* sched;
+  ADR8_Core* core; // raises irq_line when a frame arrives
+  uint8_t irq_line;
+  ADR8_Network* network;
+  uint8_t node;
+  uint8_t dest;
+  uint8_t length;
+  Reg16_t address;
+  uint8_t status;
+  uint8_t source;
+  uint64_t sent;    // cycle the link finishes sending the frames so far
+  uint64_t seq;
+  ADR8_Frame* pending; // taken from the queue, ordered by arrival
+  size_t pending_count;
+  size_t pending_capacity;
+  uint64_t delivery; // cycle of the scheduled arrival event, UINT64_MAX if none
+} ADR8_Nic;
+
+bool ADR8_Nic_init(ADR8_Nic* nic, ADR8_Network* network, uint8_t node, ADR8_Bus* bus, ADR8_Scheduler* sched, ADR8_Core* core, uint8_t irq_line, uint16_t mount_address);
+void ADR8_Nic_free(ADR8_Nic* nic);
+void ADR8_Nic_poll(ADR8_Nic* nic);
+void ADR8_Nic_poll_event(void* nic, uint64_t cycle);
+void ADR8_Nic_arrive(void* nic, uint64_t cycle);
+void ADR8_Nic_clock(ADR8_Nic* nic);
+void ADR8_Nic_bus_clock(void* nic);
+
+#ifdef ADR8_IMPLEMENTATION
+
+bool ADR8_Network_init(ADR8_Network* network, uint16_t node_count, uint64_t latency, uint64_t cycles_per_byte){
+  assert(node_count > 0 && node_count <= ADR8_NETWORK_MAX_NODES);
+  network->node_count = node_count;
+  network->latency = latency;
+  network->cycles_per_byte = cycles_per_byte;
+  network->queues = aligned_alloc(ADR8_CACHE_LINE, node_count*sizeof(ADR8_FrameQueue));
+  if(!network->queues) return false;
+  for(uint16_t i = 0; i < node_count; ++i) atomic_init(&network->queues[i].top, NULL);
+  return true;
+}
+
+// frames that were never taken are freed as well
+void ADR8_Network_free(ADR8_Network* network){
+  for(uint16_t i = 0; network->queues && i < network->node_count; ++i){
+    ADR8_QueuedFrame* queued = ADR8_FrameQueue_take(&network->queues[i]);
+    while(queued){
+      ADR8_QueuedFrame* next = queued->next;
+      free(queued);
+      queued = next;
+    }
+  }
+  free(network->queues);
+  network->queues = NULL;
+}
+
+// safe from any number of threads, returns false when out of memory
+bool ADR8_FrameQueue_push(ADR8_FrameQueue* queue, const ADR8_Frame* frame){
+  ADR8_QueuedFrame* queued = malloc(sizeof(ADR8_QueuedFrame));
+  if(!queued) return false;
+  queued->frame = *frame;
+  queued->next = atomic_load_explicit(&queue->top, memory_order_relaxed);
+  // on failure next is updated to the current top
+  while(!atomic_compare_exchange_weak_explicit(&queue->top, &queued->next, queued, memory_order_release, memory_order_relaxed));
+  return true;
+}
+
+// only from the thread of the node the queue belongs to, empties the queue
+// and returns its frames, the last one pushed first, for the caller to free
+ADR8_QueuedFrame* ADR8_FrameQueue_take(ADR8_FrameQueue* queue){
+  return atomic_exchange_explicit(&queue->top, NULL, memory_order_acquire);
+}
+
+// returns false when out of memory
+bool ADR8_Nic_init(ADR8_Nic* nic, ADR8_Network* network, uint8_t node, ADR8_Bus* bus, ADR8_Scheduler* sched, ADR8_Core* core, uint8_t irq_line, uint16_t mount_address){
+  memset(nic, 0, sizeof(ADR8_Nic));
+  assert(node < network->node_count);
+  nic->pending_capacity = 16;
+  nic->pending = malloc(nic->pending_capacity*sizeof(ADR8_Frame));
+  if(!nic->pending) return false;
+  nic->network = network;
+  nic->node = node;
+  nic->bus = bus;
+  nic->sched = sched;
+  nic->core = core;
+  nic->irq_line = irq_line;
+  nic->delivery = UINT64_MAX;
+  nic->mount_address = mount_address;
+  ADR8_Bus_attach(bus, mount_address, ADR8_NIC_REGISTERS, ADR8_Nic_bus_clock, nic);
+  return true;
+}
+
+void ADR8_Nic_free(ADR8_Nic* nic){
+  free(nic->pending);
+  nic->pending = NULL;
+}
+
+// by arrival, then by sender and the order it sent them in
+static int ADR8_Frame_compare(const void* x, const void* y){
+  const ADR8_Frame* a = x;
+  const ADR8_Frame* b = y;
+  if(a->cycle != b->cycle) return (a->cycle > b->cycle) - (a->cycle < b->cycle);
+  if(a->source != b->source) return (a->source > b->source) - (a->source < b->source);
+  return (a->seq > b->seq) - (a->seq < b->seq);
+}
+
+static size_t ADR8_Nic_arrived(ADR8_Nic* nic){
+  size_t n = 0;
+  while(n < nic->pending_count && nic->pending[n].cycle <= nic->core->cycles) n++;
+  return n;
+}
+
+// schedules the arrival of the first pending frame, frames that arrived
+// already raise the interrupt right away
+static void ADR8_Nic_schedule(ADR8_Nic* nic){
+  uint64_t cycle = nic->pending_count ? nic->pending[0].cycle : UINT64_MAX;
+  if(cycle < nic->core->cycles) cycle = nic->core->cycles;
+  if(cycle == nic->delivery) return;
+  ADR8_Scheduler_cancel(nic->sched, ADR8_Nic_arrive, nic);
+  nic->delivery = cycle;
+  if(cycle != UINT64_MAX) ADR8_Scheduler_add(nic->sched, cycle, 0, ADR8_Nic_arrive, nic);
+}
+
+void ADR8_Nic_arrive(void* nic_ptr, uint64_t cycle){
+  ADR8_Nic* nic = nic_ptr;
+  (void)cycle;
+  nic->delivery = UINT64_MAX;
+  ADR8_Core_raise_irq(nic->core, nic->irq_line);
+}
+
+// takes the frames sent to the node from its queue, ordered by arrival so
+// the order doesn't depend on when the senders' threads ran. Every frame
+// arriving at a cycle must be taken before the node runs past it, a host
+// running the nodes in steps of at most latency cycles polls before every
+// step, frames sent during a step arrive after it ends, so it doesn't
+// matter whether they are taken in that poll already.
+void ADR8_Nic_poll(ADR8_Nic* nic){
+  ADR8_QueuedFrame* queued = ADR8_FrameQueue_take(&nic->network->queues[nic->node]);
+  size_t count = nic->pending_count;
+  while(queued){
+    if(nic->pending_count == nic->pending_capacity){
+      nic->pending_capacity *= 2;
+      nic->pending = realloc(nic->pending, nic->pending_capacity*sizeof(ADR8_Frame));
+      assert(nic->pending);
+    }
+    nic->pending[nic->pending_count++] = queued->frame;
+    ADR8_QueuedFrame* next = queued->next;
+    free(queued);
+    queued = next;
+  }
+  if(nic->pending_count != count) qsort(nic->pending, nic->pending_count, sizeof(ADR8_Frame), ADR8_Frame_compare);
+  ADR8_Nic_schedule(nic);
+}
+
+void ADR8_Nic_poll_event(void* nic, uint64_t cycle){
+  (void)cycle;
+  ADR8_Nic_poll(nic);
+}
+
+static bool ADR8_Nic_send(ADR8_Nic* nic){
+  ADR8_Network* network = nic->network;
+  uint8_t* memory = ADR8_Bus_get_region(nic->bus, nic->address.full, nic->length);
+  if(!memory || nic->dest >= network->node_count) return false;
+  ADR8_Frame frame;
+  frame.source = nic->node;
+  frame.seq = nic->seq;
+  frame.length = nic->length;
+  memcpy(frame.data, memory, nic->length);
+  // the link sends one frame after another
+  uint64_t start = nic->sent > nic->core->cycles ? nic->sent : nic->core->cycles;
+  uint64_t sent = start + nic->length*network->cycles_per_byte;
+  frame.cycle = sent + network->latency;
+  // a frame that couldn't be queued takes neither link time nor a number
+  if(!ADR8_FrameQueue_push(&network->queues[nic->dest], &frame)) return false;
+  nic->seq++;
+  nic->sent = sent;
+  return true;
+}
+
+static bool ADR8_Nic_receive(ADR8_Nic* nic){
+  if(!ADR8_Nic_arrived(nic)) return false;
+  ADR8_Frame* frame = &nic->pending[0];
+  uint8_t* memory = ADR8_Bus_get_region(nic->bus, nic->address.full, frame->length);
+  if(!memory) return false;
+  memcpy(memory, frame->data, frame->length);
+  nic->length = frame->length;
+  nic->source = frame->source;
+  nic->pending_count--;
+  memmove(nic->pending, nic->pending + 1, nic->pending_count*sizeof(ADR8_Frame));
+  ADR8_Nic_schedule(nic);
+  if(ADR8_Nic_arrived(nic)) ADR8_Core_raise_irq(nic->core, nic->irq_line);
+  return true;
+}
+
+static void ADR8_Nic_command(ADR8_Nic* nic, uint8_t command){
+  bool done = false;
+  switch(command){
+    case ADR8_NIC_CMD_SEND: done = ADR8_Nic_send(nic); break;
+    case ADR8_NIC_CMD_RECEIVE: done = ADR8_Nic_receive(nic); break;
+  }
+  if(!done){
+    ADR8_DEBUG_LOG("nic: command %02X of node %02X failed\n", command, nic->node);
+  }
+  nic->status = ADR8_NIC_DONE | (done ? 0 : ADR8_NIC_ERROR);
+}
+
+void ADR8_Nic_clock(ADR8_Nic* nic){
+  uint16_t reg = nic->bus->address - nic->mount_address;
+  if(reg >= ADR8_NIC_REGISTERS) return;
+  if(nic->bus->read){
+    switch(reg){
+      case ADR8_NIC_DEST: nic->bus->data = nic->dest; break;
+      case ADR8_NIC_LENGTH: nic->bus->data = nic->length; break;
+      case ADR8_NIC_ADDRESS_L: nic->bus->data = nic->address.half.l; break;
+      case ADR8_NIC_ADDRESS_H: nic->bus->data = nic->address.half.h; break;
+      case ADR8_NIC_COMMAND: nic->bus->data = 0; break;
+      case ADR8_NIC_STATUS:{
+        nic->bus->data = nic->status;
+        nic->status = 0;
+      } break;
+      case ADR8_NIC_RECEIVED:{
+        size_t arrived = ADR8_Nic_arrived(nic);
+        nic->bus->data = arrived < UINT8_MAX ? arrived : UINT8_MAX;
+      } break;
+      case ADR8_NIC_SOURCE: nic->bus->data = nic->source; break;
+      case ADR8_NIC_NODE: nic->bus->data = nic->node; break;
+      case ADR8_NIC_NODES: nic->bus->data = nic->network->node_count; break;
+    }
+  }else{
+    switch(reg){
+      case ADR8_NIC_DEST: nic->dest = nic->bus->data; break;
+      case ADR8_NIC_LENGTH: nic->length = nic->bus->data; break;
+      case ADR8_NIC_ADDRESS_L: nic->address.half.l = nic->bus->data; break;
+      case ADR8_NIC_ADDRESS_H: nic->address.half.h = nic->bus->data; break;
+      case ADR8_NIC_COMMAND: ADR8_Nic_command(nic, nic->bus->data); break;
+      default: break;
+    }
+  }
+}
+
+void ADR8_Nic_bus_clock(void* nic){
+  ADR8_Nic_clock(nic);
+}
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_NETWORK_H
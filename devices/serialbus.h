@@ -4,16 +4,65 @@
 #include "../ADR8.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
+#ifndef ADR8_SERIAL_BUFFER_SIZE
+#define ADR8_SERIAL_BUFFER_SIZE 4096
+#endif
+
+// Reads in_fp and writes out_fp, blocking the host when input is missing.
+// A serial bus made with ADR8_SerialBus_init_fd uses non-blocking file
+// descriptors and buffers instead, it sets bus->blocked on a read with no
+// input available or on a write with its output buffer full and the
+// descriptor not taking more, see ADR8_Scheduler_run, ADR8_SerialBus_wait
+// blocks until it can go on.
+// ADR8_SerialBus_set_input reads the input from memory instead, as if it
+// had all arrived on a descriptor that was closed afterwards.
 typedef struct{
   uint16_t mount_address;
   ADR8_Bus* bus;
   FILE* in_fp;
   FILE* out_fp;
+  ADR8_Core* core; // raises irq_line when input is ready, NULL if not connected
+  uint8_t irq_line;
+  bool ready; // input is ready and its interrupt was raised
+  bool eof;
+  int in_fd;  // -1 unless made with ADR8_SerialBus_init_fd
+  int out_fd;
+  uint8_t* in_buffer; // in_start to in_end not read by the core yet
+  bool in_borrowed; // in_buffer was given to ADR8_SerialBus_set_input and isn't freed
+  size_t in_start;
+  size_t in_end;
+  bool in_closed; // in_fd reached its end
+  uint8_t* out_buffer; // out_size bytes not written to out_fd yet
+  size_t out_size;
+  bool out_closed; // writing out_fd failed, further output is dropped
 } ADR8_SerialBus;
 
 void ADR8_SerialBus_init(ADR8_SerialBus* serial, FILE* in_fp, FILE* out_fp, ADR8_Bus* bus, uint16_t mount_address);
+bool ADR8_SerialBus_init_fd(ADR8_SerialBus* serial, int in_fd, int out_fd, ADR8_Bus* bus, uint16_t mount_address);
+void ADR8_SerialBus_free(ADR8_SerialBus* serial);
+void ADR8_SerialBus_set_input(ADR8_SerialBus* serial, uint8_t* data, size_t size);
+void ADR8_SerialBus_connect_irq(ADR8_SerialBus* serial, ADR8_Core* core, uint8_t irq_line);
+bool ADR8_SerialBus_poll(ADR8_SerialBus* serial, int timeout_ms);
+bool ADR8_SerialBus_flush(ADR8_SerialBus* serial);
+void ADR8_SerialBus_wait(ADR8_SerialBus* serial, bool input);
 void ADR8_SerialBus_clock(ADR8_SerialBus* serial);
+void ADR8_SerialBus_bus_clock(void* serial);
+
+// scheduler event that polls a serial bus connected to an interrupt line,
+// add it with a period to check for input every period cycles
+typedef struct{
+  ADR8_SerialBus* serial;
+  ADR8_Scheduler* sched;
+  ADR8_Core* core;
+  bool paced; // the core sleeps between batches, so waiting never blocks
+} ADR8_SerialPoll;
+
+void ADR8_SerialPoll_event(void* poll, uint64_t cycle);
 
 #ifdef ADR8_IMPLEMENTATION
 
@@ -22,23 +71,203 @@ void ADR8_SerialBus_init(ADR8_SerialBus* serial, FILE* in_fp, FILE* out_fp, ADR8
   serial->out_fp = out_fp;
   serial->bus = bus;
   serial->mount_address = mount_address;
+  serial->core = NULL;
+  serial->ready = false;
+  serial->eof = false;
+  serial->in_fd = -1;
+  serial->out_fd = -1;
+  serial->in_buffer = NULL;
+  serial->out_buffer = NULL;
+  serial->in_start = serial->in_end = serial->out_size = 0;
+  serial->in_closed = serial->out_closed = false;
+  serial->in_borrowed = false;
+  ADR8_Bus_attach(bus, mount_address, 1, ADR8_SerialBus_bus_clock, serial);
+}
+
+// makes both descriptors non-blocking, they stay open after
+// ADR8_SerialBus_free, returns false when out of memory
+bool ADR8_SerialBus_init_fd(ADR8_SerialBus* serial, int in_fd, int out_fd, ADR8_Bus* bus, uint16_t mount_address){
+  ADR8_SerialBus_init(serial, NULL, NULL, bus, mount_address);
+  serial->in_buffer = malloc(ADR8_SERIAL_BUFFER_SIZE);
+  serial->out_buffer = malloc(ADR8_SERIAL_BUFFER_SIZE);
+  if(!serial->in_buffer || !serial->out_buffer){
+    ADR8_SerialBus_free(serial);
+    return false;
+  }
+  serial->in_fd = in_fd;
+  serial->out_fd = out_fd;
+  fcntl(in_fd, F_SETFL, fcntl(in_fd, F_GETFL) | O_NONBLOCK);
+  fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+// buffered output that wasn't flushed is dropped
+void ADR8_SerialBus_free(ADR8_SerialBus* serial){
+  if(!serial->in_borrowed) free(serial->in_buffer);
+  free(serial->out_buffer);
+  serial->in_buffer = NULL;
+  serial->out_buffer = NULL;
+}
+
+// reads the size bytes at data instead of in_fp, data isn't copied and
+// must stay valid until the serial bus reads other input or is freed, an
+// empty input reads as its end right away
+void ADR8_SerialBus_set_input(ADR8_SerialBus* serial, uint8_t* data, size_t size){
+  static uint8_t empty[1];
+  assert(serial->in_fd < 0);
+  serial->in_fp = NULL;
+  serial->in_buffer = size ? data : empty;
+  serial->in_borrowed = true;
+  serial->in_start = 0;
+  serial->in_end = size;
+  serial->in_closed = true;
+  serial->eof = false;
+}
+
+// must be called before anything is read from in_fp, input is read
+// unbuffered from then on so the file descriptor tells when input is ready,
+// a serial bus made with ADR8_SerialBus_init_fd buffers its input instead
+void ADR8_SerialBus_connect_irq(ADR8_SerialBus* serial, ADR8_Core* core, uint8_t irq_line){
+  if(serial->in_fp) setvbuf(serial->in_fp, NULL, _IONBF, 0);
+  serial->core = core;
+  serial->irq_line = irq_line;
+}
+
+// refills the empty input buffer, returns false when in_fd has nothing to
+// read yet
+static bool ADR8_SerialBus_fill(ADR8_SerialBus* serial){
+  if(serial->in_closed) return true;
+  ssize_t n;
+  while((n = read(serial->in_fd, serial->in_buffer, ADR8_SERIAL_BUFFER_SIZE)) < 0 && errno == EINTR);
+  if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return false;
+  if(n <= 0){
+    serial->in_closed = true;
+  }else{
+    serial->in_start = 0;
+    serial->in_end = n;
+  }
+  return true;
+}
+
+// writes as much buffered output as out_fd takes, returns false when some
+// of it is left because out_fd would block
+bool ADR8_SerialBus_flush(ADR8_SerialBus* serial){
+  size_t written = 0;
+  while(written < serial->out_size && !serial->out_closed){
+    ssize_t n = write(serial->out_fd, serial->out_buffer + written, serial->out_size - written);
+    if(n >= 0){
+      written += n;
+    }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+      break;
+    }else if(errno != EINTR){
+      serial->out_closed = true;
+    }
+  }
+  if(serial->out_closed) written = serial->out_size;
+  memmove(serial->out_buffer, serial->out_buffer + written, serial->out_size - written);
+  serial->out_size -= written;
+  return serial->out_size == 0;
+}
+
+// blocks a serial bus made with ADR8_SerialBus_init_fd until in_fd has input
+// when input is set and until all buffered output is written otherwise,
+// output is written whenever out_fd takes it in the meantime
+void ADR8_SerialBus_wait(ADR8_SerialBus* serial, bool input){
+  while(!ADR8_SerialBus_flush(serial) || input){
+    struct pollfd pfd[2];
+    nfds_t count = 0;
+    if(input) pfd[count++] = (struct pollfd){.fd = serial->in_fd, .events = POLLIN};
+    if(serial->out_size) pfd[count++] = (struct pollfd){.fd = serial->out_fd, .events = POLLOUT};
+    int n;
+    while((n = poll(pfd, count, -1)) < 0 && errno == EINTR);
+    if(n < 0) return;
+    if(input && pfd[0].revents){
+      ADR8_SerialBus_flush(serial);
+      return;
+    }
+  }
+}
+
+// raises the interrupt once input is ready, waiting up to timeout_ms (-1 to
+// wait forever) for it, returns false when no more input can arrive
+bool ADR8_SerialBus_poll(ADR8_SerialBus* serial, int timeout_ms){
+  if(!serial->core || serial->eof) return false;
+  if(serial->ready) return true;
+  if(serial->in_buffer && (serial->in_start < serial->in_end || ADR8_SerialBus_fill(serial))){
+    // the input or its end is buffered already
+    serial->ready = true;
+    ADR8_Core_raise_irq(serial->core, serial->irq_line);
+    return true;
+  }
+  if(serial->in_fd < 0 && !serial->in_fp) return false; // no input at all
+  // output the input may be an answer to isn't left in the buffer
+  if(serial->in_fd >= 0 && timeout_ms < 0) ADR8_SerialBus_wait(serial, true);
+  struct pollfd pfd = {.fd = serial->in_fd >= 0 ? serial->in_fd : fileno(serial->in_fp), .events = POLLIN};
+  int n;
+  while((n = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR);
+  if(n > 0){
+    // end of input is reported as well, reading it returns 0
+    serial->ready = true;
+    ADR8_Core_raise_irq(serial->core, serial->irq_line);
+  }
+  return true;
 }
 
 void ADR8_SerialBus_clock(ADR8_SerialBus* serial){
   if(serial->bus->address == serial->mount_address){
     if(serial->bus->read){
-      int c = fgetc(serial->in_fp);
+      int c;
+      if(!serial->in_buffer){
+        c = serial->in_fp ? fgetc(serial->in_fp) : EOF;
+      }else if(serial->in_start < serial->in_end || ADR8_SerialBus_fill(serial)){
+        c = serial->in_start < serial->in_end ? serial->in_buffer[serial->in_start++] : EOF;
+      }else{
+        serial->bus->blocked = serial;
+        return;
+      }
+      if(serial->ready){
+        // input read without taking its interrupt
+        ADR8_Core_clear_irq(serial->core, serial->irq_line);
+        serial->ready = false;
+      }
       if(c == EOF){
         serial->bus->data = 0;
+        serial->eof = true;
       }else{
         serial->bus->data = c;
         ADR8_DEBUG_LOG("serial: read [%02X]\n",c);
       }
-    }else{
+      if(serial->core && !serial->eof && serial->in_buffer && (serial->in_start < serial->in_end || serial->in_closed)){
+        // buffered input or its end is ready without polling
+        serial->ready = true;
+        ADR8_Core_raise_irq(serial->core, serial->irq_line);
+      }
+    }else if(serial->out_fd < 0){
       fputc(serial->bus->data, serial->out_fp);
+    }else{
+      if(serial->out_size == ADR8_SERIAL_BUFFER_SIZE && !ADR8_SerialBus_flush(serial)){
+        serial->bus->blocked = serial;
+        return;
+      }
+      serial->out_buffer[serial->out_size++] = serial->bus->data;
     }
   }
 }
+
+void ADR8_SerialBus_bus_clock(void* serial){
+  ADR8_SerialBus_clock(serial);
+}
+
+void ADR8_SerialPoll_event(void* ptr, uint64_t cycle){
+  ADR8_SerialPoll* poll = ptr;
+  (void)cycle;
+  // block on input instead of spinning while the core waits for nothing
+  // else, a paced core sleeps between batches anyway
+  bool block = poll->core->waiting && !poll->paced && poll->sched->count == 1;
+  if(!ADR8_SerialBus_poll(poll->serial, block ? -1 : 0)){
+    ADR8_Scheduler_cancel(poll->sched, ADR8_SerialPoll_event, poll);
+  }
+}
 #endif // ADR8_IMPLEMENTATION
 
 #endif // ADR8_SERIAL_H
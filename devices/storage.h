@@ -0,0 +1,149 @@
+#ifndef ADR8_STORAGE_H
+#define ADR8_STORAGE_H
+
+#include "../ADR8.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Block storage backed by a memory mapped disk image. A command transfers a
+// whole sector between the image and memory at once (DMA), so the memory it
+// transfers from or to has to be an ADR8_Memory or another bus region.
+
+#define ADR8_STORAGE_SECTOR_SIZE 0x100
+
+// register offsets from the mount address
+#define ADR8_STORAGE_SECTOR_L  0 // sector to transfer
+#define ADR8_STORAGE_SECTOR_H  1
+#define ADR8_STORAGE_ADDRESS_L 2 // memory address to transfer from or to
+#define ADR8_STORAGE_ADDRESS_H 3
+#define ADR8_STORAGE_COMMAND   4 // writing a command starts the transfer
+#define ADR8_STORAGE_STATUS    5 // cleared when read
+
+#define ADR8_STORAGE_CMD_READ  0x1 // sector to memory
+#define ADR8_STORAGE_CMD_WRITE 0x2 // memory to sector
+
+#define ADR8_STORAGE_DONE  0x1
+#define ADR8_STORAGE_ERROR 0x2
+
+typedef struct{
+  uint16_t mount_address;
+  ADR8_Bus* bus;
+  uint8_t* image;
+  size_t image_size;
+  uint32_t sector_count;
+  bool shared; // written sectors end up in the image file
+  Reg16_t sector;
+  Reg16_t address;
+  uint8_t status;
+  ADR8_Core* core; // raises irq_line when a transfer completes, NULL if not connected
+  uint8_t irq_line;
+} ADR8_Storage;
+
+bool ADR8_Storage_init(ADR8_Storage* storage, ADR8_Bus* bus, const char* path, bool shared, uint16_t mount_address);
+void ADR8_Storage_free(ADR8_Storage* storage);
+void ADR8_Storage_connect_irq(ADR8_Storage* storage, ADR8_Core* core, uint8_t irq_line);
+void ADR8_Storage_clock(ADR8_Storage* storage);
+void ADR8_Storage_bus_clock(void* storage);
+
+#ifdef ADR8_IMPLEMENTATION
+
+// shared writes go to the file while otherwise they only change the mapping
+bool ADR8_Storage_init(ADR8_Storage* storage, ADR8_Bus* bus, const char* path, bool shared, uint16_t mount_address){
+  memset(storage, 0, sizeof(ADR8_Storage));
+  int fd = open(path, shared ? O_RDWR : O_RDONLY);
+  if(fd < 0){
+    ADR8_ERROR_LOG("storage: unable to open '%s': %s\n", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < ADR8_STORAGE_SECTOR_SIZE){
+    ADR8_ERROR_LOG("storage: '%s' is unreadable or smaller than a sector\n", path);
+    close(fd);
+    return false;
+  }
+  // a partial sector at the end of the image is left out
+  storage->sector_count = st.st_size/ADR8_STORAGE_SECTOR_SIZE;
+  if(storage->sector_count > 0x10000) storage->sector_count = 0x10000;
+  storage->image_size = (size_t)storage->sector_count*ADR8_STORAGE_SECTOR_SIZE;
+  storage->image = mmap(NULL, storage->image_size, PROT_READ | PROT_WRITE,
+      shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(storage->image == MAP_FAILED){
+    ADR8_ERROR_LOG("storage: unable to map '%s': %s\n", path, strerror(errno));
+    return false;
+  }
+  storage->shared = shared;
+  storage->bus = bus;
+  storage->mount_address = mount_address;
+  ADR8_Bus_attach(bus, mount_address, 6, ADR8_Storage_bus_clock, storage);
+  return true;
+}
+
+void ADR8_Storage_free(ADR8_Storage* storage){
+  munmap(storage->image, storage->image_size);
+  storage->image = NULL;
+}
+
+void ADR8_Storage_connect_irq(ADR8_Storage* storage, ADR8_Core* core, uint8_t irq_line){
+  storage->core = core;
+  storage->irq_line = irq_line;
+}
+
+static void ADR8_Storage_transfer(ADR8_Storage* storage, uint8_t command){
+  uint8_t* memory = ADR8_Bus_get_region(storage->bus, storage->address.full, ADR8_STORAGE_SECTOR_SIZE);
+  bool valid = memory && storage->sector.full < storage->sector_count
+    && (command == ADR8_STORAGE_CMD_READ || command == ADR8_STORAGE_CMD_WRITE);
+  if(valid){
+    uint8_t* sector = storage->image + (size_t)storage->sector.full*ADR8_STORAGE_SECTOR_SIZE;
+    if(command == ADR8_STORAGE_CMD_READ){
+      // memory changes without the core writing it
+      ADR8_WRITE_HOOK(storage->bus, storage->address.full, ADR8_STORAGE_SECTOR_SIZE);
+      memcpy(memory, sector, ADR8_STORAGE_SECTOR_SIZE);
+    }else{
+      memcpy(sector, memory, ADR8_STORAGE_SECTOR_SIZE);
+    }
+  }else{
+    ADR8_DEBUG_LOG("storage: command %02X for sector %04hX at %04hX failed\n", command, storage->sector.full, storage->address.full);
+  }
+  storage->status = ADR8_STORAGE_DONE | (valid ? 0 : ADR8_STORAGE_ERROR);
+  if(storage->core) ADR8_Core_raise_irq(storage->core, storage->irq_line);
+}
+
+void ADR8_Storage_clock(ADR8_Storage* storage){
+  uint16_t reg = storage->bus->address - storage->mount_address;
+  if(reg >= 6) return;
+  if(storage->bus->read){
+    switch(reg){
+      case ADR8_STORAGE_SECTOR_L: storage->bus->data = storage->sector.half.l; break;
+      case ADR8_STORAGE_SECTOR_H: storage->bus->data = storage->sector.half.h; break;
+      case ADR8_STORAGE_ADDRESS_L: storage->bus->data = storage->address.half.l; break;
+      case ADR8_STORAGE_ADDRESS_H: storage->bus->data = storage->address.half.h; break;
+      case ADR8_STORAGE_COMMAND: storage->bus->data = 0; break;
+      case ADR8_STORAGE_STATUS:{
+        storage->bus->data = storage->status;
+        storage->status = 0;
+      } break;
+    }
+  }else{
+    switch(reg){
+      case ADR8_STORAGE_SECTOR_L: storage->sector.half.l = storage->bus->data; break;
+      case ADR8_STORAGE_SECTOR_H: storage->sector.half.h = storage->bus->data; break;
+      case ADR8_STORAGE_ADDRESS_L: storage->address.half.l = storage->bus->data; break;
+      case ADR8_STORAGE_ADDRESS_H: storage->address.half.h = storage->bus->data; break;
+      case ADR8_STORAGE_COMMAND: ADR8_Storage_transfer(storage, storage->bus->data); break;
+      case ADR8_STORAGE_STATUS: break;
+    }
+  }
+}
+
+void ADR8_Storage_bus_clock(void* storage){
+  ADR8_Storage_clock(storage);
+}
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_STORAGE_H
@@ -0,0 +1,95 @@
+#ifndef ADR8_TIMER_H
+#define ADR8_TIMER_H
+
+#include "../ADR8.h"
+#include <stdint.h>
+
+// register offsets from the mount address
+#define ADR8_TIMER_RELOAD_L 0 // ticks until expiry
+#define ADR8_TIMER_RELOAD_H 1
+#define ADR8_TIMER_CONTROL  2 // ADR8_TIMER_ENABLE | ADR8_TIMER_REPEAT
+#define ADR8_TIMER_STATUS   3 // number of expiries since the last read
+
+#define ADR8_TIMER_ENABLE 0x1
+#define ADR8_TIMER_REPEAT 0x2
+
+typedef struct{
+  uint16_t mount_address;
+  ADR8_Bus* bus;
+  ADR8_Scheduler* sched;
+  ADR8_Core* core; // raises irq_line on expiry
+  uint8_t irq_line;
+  uint64_t divider; // core cycles per tick
+  Reg16_t reload;
+  uint8_t control;
+  uint8_t expired;
+} ADR8_Timer;
+
+void ADR8_Timer_init(ADR8_Timer* timer, ADR8_Bus* bus, ADR8_Scheduler* sched, ADR8_Core* core, uint8_t irq_line, uint64_t divider, uint16_t mount_address);
+void ADR8_Timer_clock(ADR8_Timer* timer);
+void ADR8_Timer_bus_clock(void* timer);
+void ADR8_Timer_expire(void* timer, uint64_t cycle);
+
+#ifdef ADR8_IMPLEMENTATION
+
+void ADR8_Timer_init(ADR8_Timer* timer, ADR8_Bus* bus, ADR8_Scheduler* sched, ADR8_Core* core, uint8_t irq_line, uint64_t divider, uint16_t mount_address){
+  memset(timer, 0, sizeof(ADR8_Timer));
+  assert(divider > 0);
+  timer->bus = bus;
+  timer->sched = sched;
+  timer->core = core;
+  timer->irq_line = irq_line;
+  timer->divider = divider;
+  timer->mount_address = mount_address;
+  ADR8_Bus_attach(bus, mount_address, 4, ADR8_Timer_bus_clock, timer);
+}
+
+void ADR8_Timer_expire(void* timer_ptr, uint64_t cycle){
+  ADR8_Timer* timer = timer_ptr;
+  (void)cycle;
+  if(timer->expired < UINT8_MAX) timer->expired++;
+  if(!(timer->control & ADR8_TIMER_REPEAT)) timer->control &= ~ADR8_TIMER_ENABLE;
+  ADR8_Core_raise_irq(timer->core, timer->irq_line);
+}
+
+// (re)starts the timer from the current cycle according to control
+static void ADR8_Timer_start(ADR8_Timer* timer){
+  ADR8_Scheduler_cancel(timer->sched, ADR8_Timer_expire, timer);
+  if(!(timer->control & ADR8_TIMER_ENABLE) || !timer->reload.full) return;
+  uint64_t period = timer->reload.full * timer->divider;
+  ADR8_Scheduler_add(timer->sched, timer->core->cycles + period,
+      timer->control & ADR8_TIMER_REPEAT ? period : 0, ADR8_Timer_expire, timer);
+}
+
+void ADR8_Timer_clock(ADR8_Timer* timer){
+  uint16_t reg = timer->bus->address - timer->mount_address;
+  if(reg >= 4) return;
+  if(timer->bus->read){
+    switch(reg){
+      case ADR8_TIMER_RELOAD_L: timer->bus->data = timer->reload.half.l; break;
+      case ADR8_TIMER_RELOAD_H: timer->bus->data = timer->reload.half.h; break;
+      case ADR8_TIMER_CONTROL: timer->bus->data = timer->control; break;
+      case ADR8_TIMER_STATUS:{
+        timer->bus->data = timer->expired;
+        timer->expired = 0;
+      } break;
+    }
+  }else{
+    switch(reg){
+      case ADR8_TIMER_RELOAD_L: timer->reload.half.l = timer->bus->data; break;
+      case ADR8_TIMER_RELOAD_H: timer->reload.half.h = timer->bus->data; break;
+      case ADR8_TIMER_CONTROL:{
+        timer->control = timer->bus->data & (ADR8_TIMER_ENABLE | ADR8_TIMER_REPEAT);
+        ADR8_Timer_start(timer);
+      } break;
+      case ADR8_TIMER_STATUS: break;
+    }
+  }
+}
+
+void ADR8_Timer_bus_clock(void* timer){
+  ADR8_Timer_clock(timer);
+}
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_TIMER_H
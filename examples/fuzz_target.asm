@@ -0,0 +1,26 @@
+// reads from the serial bus and runs into a byte that isn't an instruction
+// when the input starts with "FUZZ", a target for tools/fuzz.c to find
+.equ SERIAL 0x1000
+
+PROGRAM_ENTRY:
+  SETA 0x0000
+  LDAL SERIAL
+  SETB 0x0046 // 'F'
+  JEQA U
+  HALT
+U:
+  LDAL SERIAL
+  SETB 0x0055 // 'U'
+  JEQA Z
+  HALT
+Z:
+  LDAL SERIAL
+  SETB 0x005A // 'Z'
+  JEQA ZZ
+  HALT
+ZZ:
+  LDAL SERIAL
+  JEQA CRASH
+  HALT
+CRASH:
+  0xFF
@@ -0,0 +1,77 @@
+// passes a token around the nodes of a cluster, every node increments it
+// and sends it on to the next node, run with the cluster runner
+.equ SERIAL 0x1000
+.equ NIC_DEST 0x1040
+.equ NIC_LENGTH 0x1041
+.equ NIC_ADDRESS 0x1042
+.equ NIC_COMMAND 0x1044
+.equ NIC_STATUS 0x1045
+.equ NIC_RECEIVED 0x1046
+.equ NIC_NODE 0x1048
+.equ NIC_NODES 0x1049
+.equ HOPS 0x03E8
+
+PROGRAM_ENTRY:
+  // frames are the token dword
+  SETA TOKEN
+  STA NIC_ADDRESS
+  SETA 0x0002
+  STAL NIC_LENGTH
+  // the next node, the last node sends to the first
+  SETA 0x0000
+  LDAL NIC_NODE
+  INC
+  SETB 0x0000
+  LDBL NIC_NODES
+  JLTA NEXT_NODE
+  SETA 0x0000
+NEXT_NODE:
+  STAL NIC_DEST
+  // the first node starts with a token of 0
+  SETA 0x0000
+  LDAL NIC_NODE
+  SETB 0x0000
+  JEQA SEND
+
+RECEIVE:
+  SETA 0x0000
+  SETB 0x0000
+  LDAL NIC_RECEIVED
+  JEQA RECEIVE
+  SETA 0x0002
+  STAL NIC_COMMAND
+  LDA TOKEN
+  INC
+  STA TOKEN
+  SETB HOPS
+  JLTA SEND
+  // after HOPS the token goes around once more, every node passes it on and
+  // stops, except the last one to get it
+  SUB
+  INC
+  SETB 0x0000
+  LDBL NIC_NODES
+  JLTA SEND_LAST
+  JMPA DONE
+SEND_LAST:
+  SETA 0x0001
+  STAL NIC_COMMAND
+DONE:
+  // prints A for the first node, B for the second and so on
+  SETA 0x0000
+  LDAL NIC_NODE
+  SETB 0x0041
+  ADD
+  STAL SERIAL
+  SETA 0x000A
+  STAL SERIAL
+  HALT
+
+SEND:
+  SETA 0x0001
+  STAL NIC_COMMAND
+  LDAL NIC_STATUS
+  JMPA RECEIVE
+
+TOKEN:
+  0x0000
@@ -0,0 +1,115 @@
+// BCPY, BFIL and BCMP
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+
+  SETX SOURCE
+  SETY COPY
+  SETA (4)
+  BCPY
+  STX SAVED_X
+  STY SAVED_Y
+  SETB 0x0000
+  SETX NAME_BCPY_A
+  JSR (CHECK - 1)
+  LDA SAVED_X
+  SETB (SOURCE+4)
+  SETX NAME_BCPY_X
+  JSR (CHECK - 1)
+  LDA SAVED_Y
+  SETB (COPY+4)
+  SETX NAME_BCPY_Y
+  JSR (CHECK - 1)
+  LDA COPY
+  SETB 0x2211
+  SETX NAME_BCPY_LOW
+  JSR (CHECK - 1)
+  LDA (COPY+2)
+  SETB 0x4433
+  SETX NAME_BCPY_HIGH
+  JSR (CHECK - 1)
+
+  // a destination inside the source repeats its first word like a copy
+  // word by word would
+  SETX COPY
+  SETY (COPY+1)
+  SETA (3)
+  BCPY
+  LDA (COPY+2)
+  SETB 0x1111
+  SETX NAME_BCPY_OVERLAP
+  JSR (CHECK - 1)
+
+  SETX FILL
+  SETA (3)
+  SETB (0x5A)
+  BFIL
+  STX SAVED_X
+  SETB 0x0000
+  SETX NAME_BFIL_A
+  JSR (CHECK - 1)
+  LDA SAVED_X
+  SETB (FILL+3)
+  SETX NAME_BFIL_X
+  JSR (CHECK - 1)
+  LDA (FILL+1)
+  SETB 0x5A5A
+  SETX NAME_BFIL_DATA
+  JSR (CHECK - 1)
+  // the word after the block is left alone
+  LDA (FILL+2)
+  SETB 0x005A
+  SETX NAME_BFIL_END
+  JSR (CHECK - 1)
+
+  SETX SOURCE
+  SETY SAME
+  SETA (4)
+  BCMP
+  SETB 0x0000
+  SETX NAME_BCMP_EQUAL
+  JSR (CHECK - 1)
+
+  // stops at the third word with two words left
+  SETX SOURCE
+  SETY OTHER
+  SETA (4)
+  BCMP
+  STX SAVED_X
+  STY SAVED_Y
+  SETB (2)
+  SETX NAME_BCMP_A
+  JSR (CHECK - 1)
+  LDA SAVED_X
+  SETB (SOURCE+2)
+  SETX NAME_BCMP_X
+  JSR (CHECK - 1)
+  LDA SAVED_Y
+  SETB (OTHER+2)
+  SETX NAME_BCMP_Y
+  JSR (CHECK - 1)
+
+  HALT
+
+SOURCE: 0x11 0x22 0x33 0x44
+SAME: 0x11 0x22 0x33 0x44
+OTHER: 0x11 0x22 0x99 0x44
+COPY: 0x00 0x00 0x00 0x00
+FILL: 0x00 0x00 0x00 0x00
+SAVED_X: 0x0000
+SAVED_Y: 0x0000
+
+NAME_BCPY_A: "BCPY A"
+NAME_BCPY_X: "BCPY X"
+NAME_BCPY_Y: "BCPY Y"
+NAME_BCPY_LOW: "BCPY first words"
+NAME_BCPY_HIGH: "BCPY last words"
+NAME_BCPY_OVERLAP: "BCPY overlapping"
+NAME_BFIL_A: "BFIL A"
+NAME_BFIL_X: "BFIL X"
+NAME_BFIL_DATA: "BFIL words"
+NAME_BFIL_END: "BFIL end"
+NAME_BCMP_EQUAL: "BCMP equal"
+NAME_BCMP_A: "BCMP A"
+NAME_BCMP_X: "BCMP X"
+NAME_BCMP_Y: "BCMP Y"
@@ -0,0 +1,117 @@
+// LDA, LDB, LDX, LDY, LXA, LYB, STA, STB, STX, STY, SXA and SYB, dwords
+// are stored with their lower word first
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+
+  SETA 0x0000
+  LDA DATA
+  SETB 0x1234
+  SETX NAME_LDA
+  JSR (CHECK - 1)
+
+  SETB 0x0000
+  LDB DATA
+  SETA 0x1234
+  SETX NAME_LDB
+  JSR (CHECK - 1)
+
+  LDX DATA
+  TRXA
+  SETB 0x1234
+  SETX NAME_LDX
+  JSR (CHECK - 1)
+
+  LDY DATA
+  TRYA
+  SETB 0x1234
+  SETX NAME_LDY
+  JSR (CHECK - 1)
+
+  SETA 0x0000
+  SETX DATA
+  LXA
+  SETB 0x1234
+  SETX NAME_LXA
+  JSR (CHECK - 1)
+
+  SETB 0x0000
+  SETY DATA
+  LYB
+  SETA 0x1234
+  SETX NAME_LYB
+  JSR (CHECK - 1)
+
+  SETA 0x2345
+  STA SLOT
+  SETA 0x0000
+  LDAL SLOT
+  LDAH (SLOT+1)
+  SETB 0x2345
+  SETX NAME_STA
+  JSR (CHECK - 1)
+
+  SETB 0x3456
+  STB SLOT
+  SETA 0x0000
+  LDAL SLOT
+  LDAH (SLOT+1)
+  SETB 0x3456
+  SETX NAME_STB
+  JSR (CHECK - 1)
+
+  SETX 0x4567
+  STX SLOT
+  SETA 0x0000
+  LDAL SLOT
+  LDAH (SLOT+1)
+  SETB 0x4567
+  SETX NAME_STX
+  JSR (CHECK - 1)
+
+  SETY 0x5678
+  STY SLOT
+  SETA 0x0000
+  LDAL SLOT
+  LDAH (SLOT+1)
+  SETB 0x5678
+  SETX NAME_STY
+  JSR (CHECK - 1)
+
+  SETA 0x6789
+  SETX SLOT
+  SXA
+  SETA 0x0000
+  LDAL SLOT
+  LDAH (SLOT+1)
+  SETB 0x6789
+  SETX NAME_SXA
+  JSR (CHECK - 1)
+
+  SETB 0x789A
+  SETY SLOT
+  SYB
+  SETA 0x0000
+  LDAL SLOT
+  LDAH (SLOT+1)
+  SETB 0x789A
+  SETX NAME_SYB
+  JSR (CHECK - 1)
+
+  HALT
+
+DATA: 0x34 0x12
+SLOT: 0x0000
+
+NAME_LDA: "LDA"
+NAME_LDB: "LDB"
+NAME_LDX: "LDX"
+NAME_LDY: "LDY"
+NAME_LXA: "LXA"
+NAME_LYB: "LYB"
+NAME_STA: "STA"
+NAME_STB: "STB"
+NAME_STX: "STX"
+NAME_STY: "STY"
+NAME_SXA: "SXA"
+NAME_SYB: "SYB"
@@ -0,0 +1,28 @@
+// .equ constants keep their value when the optimizer removes bytes before
+// them. SERIAL comes from tests/lib/check.asm, whose jumps are relaxed.
+
+.equ STARS 3
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+  SETA SERIAL
+  SETB 0x1000
+  SETX NAME_SERIAL
+  JSR (CHECK - 1)
+
+  SETY (STARS)
+LOOP:
+  SETA (0x2A)
+  STAL SERIAL
+  TRYA
+  DEC
+  TRAY
+  SETB 0x0000
+  JEQA DONE
+  JMPA LOOP
+DONE:
+  SETA (0x0A)
+  STAL SERIAL
+  HALT
+
+NAME_SERIAL: "SERIAL"
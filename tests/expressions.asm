@@ -0,0 +1,60 @@
+// subtraction, negation and negative numbers in and outside of expressions
+
+.equ BASE 0x0100
+
+.macro BYTE value
+  value
+.endm
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+
+  SETA (5-0x10)
+  SETB 0xFFF5
+  SETX NAME_HEX
+  JSR (CHECK - 1)
+
+  SETA (DATA-0x10)
+  SETB (DATA - 16)
+  SETX NAME_LABEL
+  JSR (CHECK - 1)
+
+  SETA (BASE-1)
+  SETB 0x00FF
+  SETX NAME_CONSTANT
+  JSR (CHECK - 1)
+
+  SETA (10-2-3)
+  SETB (5)
+  SETX NAME_ORDER
+  JSR (CHECK - 1)
+
+  SETA (2*-3)
+  SETB 0xFFFA
+  SETX NAME_NEGATE
+  JSR (CHECK - 1)
+
+  SETA 0x0000
+  LDAL DATA
+  SETB 0x00FB
+  SETX NAME_WORD
+  JSR (CHECK - 1)
+
+  SETA 0x0000
+  LDAL (DATA+1)
+  SETB 0x00F9
+  SETX NAME_MACRO
+  JSR (CHECK - 1)
+
+  HALT
+
+DATA: -5
+  BYTE -7
+
+NAME_HEX: "(5-0x10)"
+NAME_LABEL: "(DATA-0x10)"
+NAME_CONSTANT: "(BASE-1)"
+NAME_ORDER: "(10-2-3)"
+NAME_NEGATE: "(2*-3)"
+NAME_WORD: "-5"
+NAME_MACRO: "BYTE -7"
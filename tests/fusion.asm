@@ -0,0 +1,55 @@
+// LDAL and LDAH of neighbouring words, and LDBL and LDBH, which -O fuses
+// into LDA and LDB unless code can get to the second load another way
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+
+  SETA 0x0000
+  LDAL DATA
+  LDAH (DATA+1)
+  SETB 0x2211
+  SETX NAME_LDA
+  JSR (CHECK - 1)
+
+  SETB 0x0000
+  LDBL (DATA+1)
+  LDBH (DATA+2)
+  SETA 0x3322
+  SETX NAME_LDB
+  JSR (CHECK - 1)
+
+  // not the next address, stays two loads
+  LDAL DATA
+  LDAH (DATA+2)
+  SETB 0x3311
+  SETX NAME_APART
+  JSR (CHECK - 1)
+
+  // jumped to the label of the second load, which has to stay on its own
+  SETA 0x00FF
+  JMPA SECOND_LABEL
+  LDAL DATA
+SECOND_LABEL:
+  LDAH (DATA+1)
+  SETB 0x22FF
+  SETX NAME_LABEL
+  JSR (CHECK - 1)
+
+  // skips the 3 bytes of the first load to the second one
+  SETA 0x00EE
+  JMPR 0x03
+  LDAL DATA
+  LDAH (DATA+1)
+  SETB 0x22EE
+  SETX NAME_LITERAL
+  JSR (CHECK - 1)
+
+  HALT
+
+DATA: 0x11 0x22 0x33
+
+NAME_LDA: "LDAL LDAH"
+NAME_LDB: "LDBL LDBH"
+NAME_APART: "LDAL LDAH apart"
+NAME_LABEL: "LDAH label"
+NAME_LITERAL: "LDAH jump target"
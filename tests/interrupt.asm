@@ -0,0 +1,92 @@
+// SETV, EI, DI, RTI and WAIT with the timer on interrupt line 1. The
+// program loader also raises line 0 once its input ended, so waits are
+// repeated until the timer expired.
+
+.equ TIMER_RELOAD 0x1010
+.equ TIMER_CONTROL 0x1012
+.equ TIMER_STATUS 0x1013
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+  SETV VECTORS
+
+  // the handler runs once the timer wakes the core
+  SETA 0x0040
+  STA TIMER_RELOAD
+  SETA (1)
+  STAL TIMER_CONTROL
+  EI
+WAIT_FIRST:
+  WAIT
+  SETA 0x0000
+  LDAL COUNT
+  SETB 0x0000
+  JEQA WAIT_FIRST
+  SETB (1)
+  SETX NAME_WAIT
+  JSR (CHECK - 1)
+
+  // RTI enabled interrupts again
+  SETA (1)
+  STAL TIMER_CONTROL
+WAIT_SECOND:
+  WAIT
+  SETA 0x0000
+  LDAL COUNT
+  SETB (1)
+  JEQA WAIT_SECOND
+  SETB (2)
+  SETX NAME_RTI
+  JSR (CHECK - 1)
+
+  // a wait wakes up without running the handler
+  DI
+  SETA (1)
+  STAL TIMER_CONTROL
+WAIT_DISABLED:
+  WAIT
+  SETA 0x0000
+  LDAL TIMER_STATUS
+  SETB 0x0000
+  JEQA WAIT_DISABLED
+  SETA 0x0000
+  LDAL COUNT
+  SETB (2)
+  SETX NAME_DI
+  JSR (CHECK - 1)
+
+  // the interrupt still raised is taken right away
+  EI
+  NOP
+  SETA 0x0000
+  LDAL COUNT
+  SETB (3)
+  SETX NAME_EI
+  JSR (CHECK - 1)
+
+  HALT
+
+SERIAL_HANDLER:
+  PUA
+  LDAL 0x1000
+  POA
+  RTI
+
+TIMER_HANDLER:
+  PUA
+  SETA 0x0000
+  LDAL COUNT
+  INC
+  STAL COUNT
+  POA
+  RTI
+
+COUNT: 0x00
+VECTORS:
+  SERIAL_HANDLER
+  TIMER_HANDLER
+
+NAME_WAIT: "SETV EI WAIT"
+NAME_RTI: "RTI"
+NAME_DI: "DI"
+NAME_EI: "EI"
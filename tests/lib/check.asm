@@ -0,0 +1,32 @@
+// Linked after every test: JSR (CHECK - 1) prints the name X points to
+// followed by ok if A equals B and FAIL otherwise.
+
+.equ SERIAL 0x1000
+
+CHECK:
+  JEQA CHECK_OK
+  JSR (PRINT - 1)
+  SETX CHECK_FAIL
+  JSR (PRINT - 1)
+  RSR
+CHECK_OK:
+  JSR (PRINT - 1)
+  SETX CHECK_PASS
+  JSR (PRINT - 1)
+  RSR
+
+// prints the string X points to
+PRINT:
+  SETA 0x0000
+  SETB 0x0000
+PRINT_LOOP:
+  LXAL
+  JEQA PRINT_END
+  STAL SERIAL
+  INCX
+  JMPA PRINT_LOOP
+PRINT_END:
+  RSR
+
+CHECK_PASS: " ok\n"
+CHECK_FAIL: " FAIL\n"
@@ -0,0 +1,31 @@
+// hand written relative jumps keep their targets when the optimizer
+// shortens an absolute jump between a jump and its target
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+
+  // skips the 3 bytes of the JMPA, 2 once it is relaxed
+  SETA 0x0000
+  JMPR 0x03
+  JMPA FORWARD_TARGET
+  SETA (1)
+FORWARD_TARGET:
+  SETB (1)
+  SETX NAME_FORWARD
+  JSR (CHECK - 1)
+
+  // back to the INCY, 11 bytes including the JEQA and the JMPR itself
+  SETY 0x0000
+  INCY
+  TRYA
+  SETB (3)
+  JEQA BACKWARD_DONE
+  JMPR -11
+BACKWARD_DONE:
+  SETX NAME_BACKWARD
+  JSR (CHECK - 1)
+
+  HALT
+
+NAME_FORWARD: "JMPR 0x03"
+NAME_BACKWARD: "JMPR -11"
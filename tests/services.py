@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# Runs programs through the server, the multiplexer and the cluster runner
+# and checks their output, run by `make test` after the programs in tests.
+
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+BUILD = "./build"
+ASSEMBLER = BUILD + "/utilities/assembler"
+
+failures = []
+
+def check(name, got, expected):
+    if got != expected:
+        failures.append(name)
+        print(f"{name}: expected {expected!r}, got {got!r}")
+
+def assemble(source, binary):
+    subprocess.run([ASSEMBLER, source, "-o", binary, "-b"], check=True)
+    with open(binary, "rb") as f:
+        return f.read()
+
+def request(program, data, budget=0):
+    return struct.pack("<IIQ", len(program), len(data), budget) + program + data
+
+def responses(stream):
+    result = []
+    while stream:
+        status, cycles, size = struct.unpack("<BQI", stream[:13])
+        result.append((status, stream[13:13 + size]))
+        stream = stream[13 + size:]
+    return result
+
+def test_server(hello, echo):
+    # an empty input first, the server has no input buffer allocated yet
+    requests = [(hello, b""), (echo, b"abc\n"), (echo, b""), (hello, b"unread"), (echo, b"x" * 5000)]
+    stream = b"".join(request(program, data) for program, data in requests)
+    run = subprocess.run([BUILD + "/utilities/server"], input=stream, capture_output=True, timeout=30)
+    check("server exit", run.returncode, 0)
+    check("server responses", responses(run.stdout), [
+        (0, b"hello world!\n"), (0, b"abc\n"), (0, b""), (0, b"hello world!\n"), (0, b"x" * 5000),
+    ])
+
+def talk(path, data):
+    client = socket.socket(socket.AF_UNIX)
+    client.settimeout(30)
+    # the socket is there before the multiplexer listens on it
+    for attempt in range(100):
+        try:
+            client.connect(path)
+            break
+        except (FileNotFoundError, ConnectionRefusedError):
+            if attempt == 99:
+                raise
+            time.sleep(0.05)
+    client.sendall(data)
+    client.shutdown(socket.SHUT_WR)
+    received = b""
+    while chunk := client.recv(4096):
+        received += chunk
+    client.close()
+    return received
+
+def test_multiplexer(directory, echo_path):
+    path = os.path.join(directory, "multiplexer.sock")
+    for flags in ([], ["-p"]):
+        multiplexer = subprocess.Popen([BUILD + "/utilities/multiplexer", "-u", path, "-t", "2", *flags, echo_path])
+        try:
+            name = "multiplexer" + "".join(" " + flag for flag in flags)
+            check(name + " empty", talk(path, b""), b"")
+            check(name + " echo", talk(path, b"hello\n"), b"hello\n")
+            check(name + " long", talk(path, b"y" * 10000), b"y" * 10000)
+        finally:
+            multiplexer.kill()
+            multiplexer.wait()
+
+def test_cluster(flood_path):
+    run = subprocess.run([BUILD + "/utilities/cluster", "-N", "4", BUILD + "/examples/ring.bin"],
+        capture_output=True, timeout=60)
+    check("cluster exit", run.returncode, 0)
+    check("cluster output", run.stdout, b"A\nB\nC\nD\n")
+    # far more frames than a step takes to one node, none may be dropped and
+    # every run takes the same cycles
+    runs = [subprocess.run([BUILD + "/utilities/cluster", "-N", "8", "-c", flood_path],
+        capture_output=True, timeout=60) for _ in range(2)]
+    check("cluster flood output", runs[0].stdout, b"XAAAAAAA")
+    check("cluster flood cycles", runs[1].stderr, runs[0].stderr)
+
+with tempfile.TemporaryDirectory() as directory:
+    echo_path = os.path.join(directory, "echo.bin")
+    echo = assemble("./tests/services/echo.asm", echo_path)
+    with open(BUILD + "/examples/hello_world.bin", "rb") as f:
+        hello = f.read()
+    test_server(hello, echo)
+    test_multiplexer(directory, echo_path)
+    flood_path = os.path.join(directory, "flood.bin")
+    assemble("./tests/services/flood.asm", flood_path)
+    test_cluster(flood_path)
+
+if failures:
+    sys.exit(1)
+print("server, multiplexer and cluster pass")
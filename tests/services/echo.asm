@@ -0,0 +1,21 @@
+// writes back every word of its input as the serial interrupt reports it
+// and halts at the end of the input
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+  SETV VECTORS
+  EI
+IDLE:
+  WAIT
+  JMPA IDLE
+ON_INPUT:
+  SETA 0x0000
+  LDAL 0x1000
+  SETB 0x0000
+  JEQA DONE
+  STAL 0x1000
+  RTI
+DONE:
+  HALT
+
+VECTORS: ON_INPUT
@@ -0,0 +1,79 @@
+// every node but the first sends 200 frames to the first one as fast as its
+// link allows and prints A plus the number of sends that failed, the first
+// node only starts taking them after a while and prints X once it has all
+.equ SERIAL 0x1000
+.equ NIC_DEST 0x1040
+.equ NIC_LENGTH 0x1041
+.equ NIC_ADDRESS 0x1042
+.equ NIC_COMMAND 0x1044
+.equ NIC_STATUS 0x1045
+.equ NIC_RECEIVED 0x1046
+.equ NIC_NODE 0x1048
+.equ NIC_NODES 0x1049
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+  SETA BUFFER
+  STA NIC_ADDRESS
+  SETA 0x0001
+  STAL NIC_LENGTH
+  SETA 0x0000
+  STAL NIC_DEST
+  SETA 0x0000
+  LDAL NIC_NODE
+  SETB 0x0000
+  JEQA RECEIVER
+  SETX 0x0000
+  SETY 0x0000
+SEND:
+  SETA 0x0001
+  STAL NIC_COMMAND
+  LDAL NIC_STATUS
+  SETB 0x0001
+  JEQA SENT
+  // failed, counted in Y
+  INCY
+SENT:
+  INCX
+  TRXA
+  SETB 0x00C8
+  JLTA SEND
+  TRYA
+  SETB 0x0041
+  ADD
+  STAL SERIAL
+  HALT
+
+RECEIVER:
+  // wait for 20000 cycles
+  SETX 0x0000
+DELAY:
+  INCX
+  TRXA
+  SETB 0x0FA0
+  JLTA DELAY
+  // (NODES-1)*200 frames
+  SETA 0x0000
+  LDAL NIC_NODES
+  DEC
+  SETB 0x00C8
+  MUL
+  STA EXPECTED
+  SETY 0x0000
+RECEIVE:
+  SETA 0x0000
+  SETB 0x0000
+  LDAL NIC_RECEIVED
+  JEQA RECEIVE
+  SETA 0x0002
+  STAL NIC_COMMAND
+  INCY
+  TRYA
+  LDB EXPECTED
+  JLTA RECEIVE
+  SETA 0x0058
+  STAL SERIAL
+  HALT
+
+EXPECTED: 0x0000
+BUFFER: 0x00
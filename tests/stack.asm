@@ -0,0 +1,104 @@
+// PUA, PUB, PUX, PUY, POA, POB, POX and POY, a pushed dword has its higher
+// word at the stack pointer and its lower word below it
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+  SETA 0x1234
+  PUA
+  SETA 0x0000
+  LDAL 0x0FEF
+  LDAH 0x0FF0
+  SETB 0x1234
+  SETX NAME_PUA
+  JSR (CHECK - 1)
+
+  SETK 0x0FF0
+  SETB 0x2345
+  PUB
+  SETA 0x0000
+  LDAL 0x0FEF
+  LDAH 0x0FF0
+  SETB 0x2345
+  SETX NAME_PUB
+  JSR (CHECK - 1)
+
+  SETK 0x0FF0
+  SETX 0x3456
+  PUX
+  SETA 0x0000
+  LDAL 0x0FEF
+  LDAH 0x0FF0
+  SETB 0x3456
+  SETX NAME_PUX
+  JSR (CHECK - 1)
+
+  SETK 0x0FF0
+  SETY 0x4567
+  PUY
+  SETA 0x0000
+  LDAL 0x0FEF
+  LDAH 0x0FF0
+  SETB 0x4567
+  SETX NAME_PUY
+  JSR (CHECK - 1)
+
+  // pops read what the pushes above wrote
+  SETA 0x5678
+  STA 0x0FEF
+  SETK 0x0FEE
+  SETA 0x0000
+  POA
+  SETB 0x5678
+  SETX NAME_POA
+  JSR (CHECK - 1)
+
+  SETA 0x6789
+  STA 0x0FEF
+  SETK 0x0FEE
+  SETB 0x0000
+  POB
+  SETA 0x6789
+  SETX NAME_POB
+  JSR (CHECK - 1)
+
+  SETA 0x789A
+  STA 0x0FEF
+  SETK 0x0FEE
+  POX
+  TRXA
+  SETB 0x789A
+  SETX NAME_POX
+  JSR (CHECK - 1)
+
+  SETA 0x89AB
+  STA 0x0FEF
+  SETK 0x0FEE
+  POY
+  TRYA
+  SETB 0x89AB
+  SETX NAME_POY
+  JSR (CHECK - 1)
+
+  // both pointers are back where they started
+  SETK 0x0FF0
+  SETA 0x9ABC
+  PUA
+  SETB 0x0000
+  POB
+  PUB
+  POA
+  SETB 0x9ABC
+  SETX NAME_BALANCE
+  JSR (CHECK - 1)
+
+  HALT
+
+NAME_PUA: "PUA"
+NAME_PUB: "PUB"
+NAME_PUX: "PUX"
+NAME_PUY: "PUY"
+NAME_POA: "POA"
+NAME_POB: "POB"
+NAME_POX: "POX"
+NAME_POY: "POY"
+NAME_BALANCE: "PUA POB PUB POA"
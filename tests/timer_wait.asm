@@ -0,0 +1,71 @@
+// A timer started while the core runs wakes it from WAIT in time. The
+// timer repeats every 0x40 cycles, so its handler sees a single expiry
+// unless the wake up comes late and more of them pile up. The rounds
+// start the timer at different distances from the next serial poll of
+// the program loader.
+
+.equ TIMER_RELOAD 0x1010
+.equ TIMER_CONTROL 0x1012
+.equ TIMER_STATUS 0x1013
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+  SETV VECTORS
+  SETA 0x0040
+  STA TIMER_RELOAD
+ROUND:
+  SETA 0x0000
+  STAL EXPIRIES
+  SETA (3)
+  STAL TIMER_CONTROL
+  EI
+WAIT_TIMER:
+  WAIT
+  SETA 0x0000
+  LDAL EXPIRIES
+  SETB 0x0000
+  JEQA WAIT_TIMER
+  // the expiry raised after the handler is dropped with the status
+  DI
+  SETA 0x0000
+  STAL TIMER_CONTROL
+  LDAL TIMER_STATUS
+  SETA 0x0000
+  LDAL EXPIRIES
+  SETB (1)
+  JEQA NEXT_ROUND
+  JMPA REPORT
+NEXT_ROUND:
+  SETA 0x0000
+  LDAL ROUNDS
+  DEC
+  STAL ROUNDS
+  SETB 0x0000
+  JEQA REPORT
+  JMPA ROUND
+REPORT:
+  SETX NAME_WAIT
+  JSR (CHECK - 1)
+  HALT
+
+SERIAL_HANDLER:
+  PUA
+  LDAL 0x1000
+  POA
+  RTI
+
+TIMER_HANDLER:
+  PUA
+  SETA 0x0000
+  LDAL TIMER_STATUS
+  STAL EXPIRIES
+  POA
+  RTI
+
+EXPIRIES: 0x00
+ROUNDS: 16
+VECTORS:
+  SERIAL_HANDLER
+  TIMER_HANDLER
+
+NAME_WAIT: "timer expiry during WAIT"
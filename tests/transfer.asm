@@ -0,0 +1,68 @@
+// TRAK, TRAB, TRBA, TRAX, TRXA, TRAY and TRYA
+
+PROGRAM_ENTRY:
+  SETK 0x0FF0
+
+  SETA 0x1234
+  SETB 0x0000
+  TRAB
+  SETX NAME_TRAB
+  JSR (CHECK - 1)
+
+  SETA 0x0000
+  SETB 0x2345
+  TRBA
+  SETX NAME_TRBA
+  JSR (CHECK - 1)
+
+  SETA 0x0000
+  SETB 0x3456
+  SETX 0x3456
+  TRXA
+  SETX NAME_TRXA
+  JSR (CHECK - 1)
+
+  SETA 0x4567
+  TRAX
+  SETA 0x0000
+  TRXA
+  SETB 0x4567
+  SETX NAME_TRAX
+  JSR (CHECK - 1)
+
+  SETA 0x0000
+  SETB 0x5678
+  SETY 0x5678
+  TRYA
+  SETX NAME_TRYA
+  JSR (CHECK - 1)
+
+  SETA 0x6789
+  TRAY
+  SETA 0x0000
+  TRYA
+  SETB 0x6789
+  SETX NAME_TRAY
+  JSR (CHECK - 1)
+
+  // the next push lands where A points
+  SETA 0x0F00
+  TRAK
+  SETA 0x00AB
+  PUAL
+  SETK 0x0FF0
+  SETA 0x0000
+  LDAL 0x0F00
+  SETB 0x00AB
+  SETX NAME_TRAK
+  JSR (CHECK - 1)
+
+  HALT
+
+NAME_TRAB: "TRAB"
+NAME_TRBA: "TRBA"
+NAME_TRXA: "TRXA"
+NAME_TRAX: "TRAX"
+NAME_TRYA: "TRYA"
+NAME_TRAY: "TRAY"
+NAME_TRAK: "TRAK"
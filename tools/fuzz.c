@@ -0,0 +1,431 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stddef.h>
+
+// In-process coverage guided fuzzing of programs running on the emulator.
+// The program is booted once up to its first read from the serial bus and
+// snapshotted there, every input is then fed to it over the serial bus after
+// restoring the machine from that snapshot. Only the pages written since the
+// snapshot are copied back. Taken branches are recorded as edges in a
+// coverage map and a program running into an opcode that doesn't exist
+// counts as a crash.
+//
+// Built with -DFUZZ_LIBFUZZER it only provides the libFuzzer entry points,
+// the map is then placed where libFuzzer picks it up as extra counters and
+// the program is read from the path in the ADR8_FUZZ_PROGRAM variable.
+// Otherwise main runs a mutational fuzzer of its own.
+
+#define FUZZ_MAP_SIZE (1 << 14)
+
+#ifdef FUZZ_LIBFUZZER
+__attribute__((section("__libfuzzer_extra_counters")))
+#endif
+static uint8_t fuzz_coverage[FUZZ_MAP_SIZE];
+
+static uint8_t fuzz_dirty[0x100]; // per page of the address space
+static uint8_t fuzz_dirty_pages[0x100];
+static size_t fuzz_dirty_count;
+
+static inline void Fuzz_edge(uint16_t from, uint16_t to){
+  fuzz_coverage[(from * 0x9E37u ^ to) & (FUZZ_MAP_SIZE - 1)]++;
+}
+
+static inline void Fuzz_write(uint16_t address, uint16_t size){
+  uint8_t page = address >> 8;
+  uint16_t pages = ((address & 0xFF) + size + 0xFF) >> 8;
+  for(uint16_t i = 0; i < pages; ++i, ++page){
+    if(!fuzz_dirty[page]){
+      fuzz_dirty[page] = 1;
+      fuzz_dirty_pages[fuzz_dirty_count++] = page;
+    }
+  }
+}
+
+#define ADR8_BRANCH_HOOK(core, from, to) Fuzz_edge(from, to)
+#define ADR8_WRITE_HOOK(bus, address, size) Fuzz_write(address, size)
+// inputs run into unknown opcodes all the time, which are reported as crashes
+#define ADR8_LOG_PRINTF(...) ((void)0)
+#define ADR8_IMPLEMENTATION
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "../utilities/bootstrapper.h"
+#include <time.h>
+
+#define FUZZ_MEMORY_SIZE 0x1000
+#define FUZZ_DEFAULT_CYCLES 100000
+#define FUZZ_MAX_INPUT 4096
+
+typedef enum{
+  Fuzz_OK,     // halted, ran out of cycles or waits for nothing
+  Fuzz_CRASH,  // ran into an opcode that doesn't exist
+} Fuzz_Result;
+
+typedef struct{
+  ADR8_Machine* machine;
+  ADR8_SerialBus serial;
+  ADR8_Scheduler sched;
+  ADR8_Timer timer;
+  uint64_t cycles; // per input, from the snapshot on
+
+  // the serial input reads from input through a cookie stream
+  FILE* in_fp;
+  const uint8_t* input;
+  size_t input_size;
+  size_t input_pos;
+
+  // taken right before the program's first read from the serial bus
+  uint8_t* snapshot;
+  size_t snapshot_header; // bytes of the machine in front of its memory
+  ADR8_Event* events;
+  size_t event_count;
+  uint64_t event_seq;
+  ADR8_Timer timer_snapshot;
+} Fuzz;
+
+static Fuzz fuzz;
+
+static ssize_t Fuzz_read_input(void* cookie, char* buffer, size_t size){
+  (void)cookie;
+  size_t left = fuzz.input_size - fuzz.input_pos;
+  if(size > left) size = left;
+  memcpy(buffer, fuzz.input + fuzz.input_pos, size);
+  fuzz.input_pos += size;
+  return size;
+}
+
+static bool Fuzz_init(const char* path, uint64_t cycles){
+  FILE* fp = fopen(path, "rb");
+  if(!fp){
+    fprintf(stderr, "unable to open '%s'\n", path);
+    return false;
+  }
+  static uint8_t binary[FUZZ_MEMORY_SIZE + 2];
+  size_t size = fread(binary, 1, sizeof(binary), fp);
+  fclose(fp);
+
+  fuzz.cycles = cycles;
+  fuzz.machine = ADR8_Machine_new(FUZZ_MEMORY_SIZE, 0x0);
+  assert(fuzz.machine);
+  ADR8_Machine* machine = fuzz.machine;
+  if(!ADR8_Bootstrapper_load(machine, binary, size)){
+    fprintf(stderr, "'%s' wasn't assembled with -b or doesn't fit in memory\n", path);
+    return false;
+  }
+
+  // unbuffered so a stream is never read ahead of the program
+  fuzz.in_fp = fopencookie(NULL, "r", (cookie_io_functions_t){.read = Fuzz_read_input});
+  assert(fuzz.in_fp);
+  setvbuf(fuzz.in_fp, NULL, _IONBF, 0);
+  FILE* out_fp = fopen("/dev/null", "w");
+  assert(out_fp);
+
+  // the same devices as the program loader
+  ADR8_Bus* bus = &machine->bus;
+  ADR8_SerialBus_init(&fuzz.serial, fuzz.in_fp, out_fp, bus, 0x1000);
+  ADR8_Scheduler_init(&fuzz.sched);
+  ADR8_Timer_init(&fuzz.timer, bus, &fuzz.sched, &machine->core, 1, 1, 0x1010);
+
+  // boot up to the cycle the serial bus would read the first input
+  ADR8_Core* core = &machine->core;
+  while(!core->halt && core->cycles < cycles){
+    ADR8_Core_clock(core);
+    if(bus->read && bus->address == fuzz.serial.mount_address) break;
+    ADR8_Bus_clock(bus);
+    if(ADR8_Scheduler_next(&fuzz.sched) <= core->cycles){
+      ADR8_Scheduler_dispatch(&fuzz.sched, core->cycles);
+    }
+  }
+  if(core->halt || core->cycles >= cycles){
+    fprintf(stderr, "'%s' never reads from the serial bus\n", path);
+    return false;
+  }
+
+  fuzz.snapshot_header = offsetof(ADR8_Machine, ram);
+  fuzz.snapshot = malloc(machine->size);
+  assert(fuzz.snapshot);
+  memcpy(fuzz.snapshot, machine, machine->size);
+  fuzz.event_count = fuzz.sched.count;
+  fuzz.event_seq = fuzz.sched.seq;
+  fuzz.events = malloc(fuzz.event_count * sizeof(ADR8_Event) + 1);
+  assert(fuzz.events);
+  if(fuzz.event_count) memcpy(fuzz.events, fuzz.sched.events, fuzz.event_count * sizeof(ADR8_Event));
+  fuzz.timer_snapshot = fuzz.timer;
+  memset(fuzz_dirty, 0, sizeof(fuzz_dirty));
+  fuzz_dirty_count = 0;
+  return true;
+}
+
+// copies back the machine and the pages of memory written since the snapshot
+static void Fuzz_restore(void){
+  ADR8_Machine* machine = fuzz.machine;
+  memcpy(machine, fuzz.snapshot, fuzz.snapshot_header);
+  for(size_t i = 0; i < fuzz_dirty_count; ++i){
+    uint8_t page = fuzz_dirty_pages[i];
+    fuzz_dirty[page] = 0;
+    size_t offset = (size_t)page << 8;
+    if(offset < machine->mem.size){
+      memcpy(machine->ram + offset, fuzz.snapshot + fuzz.snapshot_header + offset, 0x100);
+    }
+  }
+  fuzz_dirty_count = 0;
+
+  // the event array never shrinks, so the snapshot's events still fit
+  if(fuzz.event_count) memcpy(fuzz.sched.events, fuzz.events, fuzz.event_count * sizeof(ADR8_Event));
+  fuzz.sched.count = fuzz.event_count;
+  fuzz.sched.seq = fuzz.event_seq;
+  fuzz.timer = fuzz.timer_snapshot;
+  fuzz.serial.ready = false;
+  fuzz.serial.eof = false;
+}
+
+static Fuzz_Result Fuzz_run(const uint8_t* input, size_t size){
+  Fuzz_restore();
+  fuzz.input = input;
+  fuzz.input_size = size;
+  fuzz.input_pos = 0;
+  clearerr(fuzz.in_fp);
+
+  // finish the read the snapshot was taken in front of
+  ADR8_Core* core = &fuzz.machine->core;
+  ADR8_Bus_clock(core->bus);
+  ADR8_Scheduler_run(&fuzz.sched, core, core->cycles + fuzz.cycles);
+  if(core->halt && !ADR8_OpTiming_cycles(core->reg.cmd.opcode)) return Fuzz_CRASH;
+  return Fuzz_OK;
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+int LLVMFuzzerInitialize(int* argc, char*** argv){
+  (void)argc;
+  (void)argv;
+  const char* path = getenv("ADR8_FUZZ_PROGRAM");
+  const char* cycles = getenv("ADR8_FUZZ_CYCLES");
+  if(!path){
+    fprintf(stderr, "set ADR8_FUZZ_PROGRAM to a program assembled with -b\n");
+    exit(1);
+  }
+  if(!Fuzz_init(path, cycles ? strtoull(cycles, NULL, 0) : FUZZ_DEFAULT_CYCLES)) exit(1);
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+  if(Fuzz_run(data, size) == Fuzz_CRASH){
+    fprintf(stderr, "program crashed at [%04hX]\n", (uint16_t)(fuzz.machine->core.reg.pc.full));
+    abort();
+  }
+  return 0;
+}
+
+#else
+
+// coverage of all inputs so far, a bit per hit count bucket of every edge
+static uint8_t fuzz_seen[FUZZ_MAP_SIZE];
+
+typedef struct{
+  uint8_t* data;
+  size_t size;
+} Fuzz_Input;
+
+static uint64_t Fuzz_now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static uint8_t Fuzz_bucket(uint8_t count){
+  if(count <= 3) return 1 << (count - 1);
+  if(count < 8) return 1 << 3;
+  if(count < 16) return 1 << 4;
+  if(count < 32) return 1 << 5;
+  if(count < 128) return 1 << 6;
+  return 1 << 7;
+}
+
+// adds the coverage of the last run to fuzz_seen and clears it, returns the
+// number of new edges and hit count buckets
+static size_t Fuzz_collect(void){
+  size_t new_bits = 0;
+  uint64_t* words = (uint64_t*)fuzz_coverage;
+  for(size_t w = 0; w < FUZZ_MAP_SIZE/8; ++w){
+    if(!words[w]) continue;
+    for(size_t i = w*8; i < w*8 + 8; ++i){
+      if(!fuzz_coverage[i]) continue;
+      uint8_t bucket = Fuzz_bucket(fuzz_coverage[i]);
+      if(!(fuzz_seen[i] & bucket)){
+        fuzz_seen[i] |= bucket;
+        new_bits++;
+      }
+      fuzz_coverage[i] = 0;
+    }
+  }
+  return new_bits;
+}
+
+static size_t Fuzz_edges(void){
+  size_t edges = 0;
+  for(size_t i = 0; i < FUZZ_MAP_SIZE; ++i) edges += fuzz_seen[i] != 0;
+  return edges;
+}
+
+// operand words of the SETx instructions, which are what inputs get
+// compared against
+static uint8_t fuzz_dictionary[256];
+static size_t fuzz_dictionary_size;
+
+static void Fuzz_build_dictionary(void){
+  uint8_t* mem = fuzz.machine->mem.data;
+  bool seen[256] = {0};
+  for(size_t pc = ADR8_BOOTSTRAPPER_SIZE; pc + 2 < fuzz.machine->mem.size; ++pc){
+    if(mem[pc] < ADR8_Op_SETK || mem[pc] > ADR8_Op_SETY) continue;
+    for(size_t i = 1; i <= 2; ++i){
+      if(!seen[mem[pc+i]]){
+        seen[mem[pc+i]] = true;
+        fuzz_dictionary[fuzz_dictionary_size++] = mem[pc+i];
+      }
+    }
+  }
+}
+
+static size_t Fuzz_mutate(uint8_t* data, size_t size, Fuzz_Input* corpus, size_t corpus_size){
+  static const uint8_t interesting[] = {0x00, 0x01, 0x7F, 0x80, 0xFF};
+  size_t stack = 1 << (rand() % 4);
+  for(size_t n = 0; n < stack; ++n){
+    size_t pos = size ? rand() % size : 0;
+    switch(rand() % 8){
+      case 0: if(size) data[pos] ^= 1 << (rand() % 8); break;
+      case 1: if(size) data[pos] = rand(); break;
+      case 2: if(size) data[pos] += rand() % 33 - 16; break;
+      case 3: if(size) data[pos] = interesting[rand() % sizeof(interesting)]; break;
+      case 4:{
+        if(size && fuzz_dictionary_size) data[pos] = fuzz_dictionary[rand() % fuzz_dictionary_size];
+      } break;
+      case 5:{ // insert a byte
+        if(size >= FUZZ_MAX_INPUT) break;
+        pos = rand() % (size + 1);
+        memmove(data + pos + 1, data + pos, size - pos);
+        data[pos] = fuzz_dictionary_size && rand() % 2 ? fuzz_dictionary[rand() % fuzz_dictionary_size] : rand();
+        size++;
+      } break;
+      case 6:{ // delete a range
+        if(size < 2) break;
+        size_t len = 1 + rand() % (size - pos);
+        memmove(data + pos, data + pos + len, size - pos - len);
+        size -= len;
+      } break;
+      case 7:{ // splice in the end of another input
+        Fuzz_Input* other = &corpus[rand() % corpus_size];
+        if(!other->size) break;
+        size_t from = rand() % other->size;
+        size_t len = other->size - from;
+        if(pos + len > FUZZ_MAX_INPUT) len = FUZZ_MAX_INPUT - pos;
+        memcpy(data + pos, other->data + from, len);
+        size = pos + len;
+      } break;
+    }
+  }
+  return size;
+}
+
+static void Fuzz_save_crash(const char* dir, const uint8_t* data, size_t size, size_t n){
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/crash-%zu", dir, n);
+  FILE* fp = fopen(path, "wb");
+  if(!fp){
+    fprintf(stderr, "unable to write '%s'\n", path);
+    return;
+  }
+  fwrite(data, 1, size, fp);
+  fclose(fp);
+  printf("crash at [%04hX] saved to %s\n", (uint16_t)fuzz.machine->core.reg.pc.full, path);
+}
+
+int main(int argc, char** argv){
+  uint64_t cycles = FUZZ_DEFAULT_CYCLES;
+  uint64_t max_execs = 0;
+  double seconds = 10;
+  unsigned seed = 1;
+  const char* crash_dir = ".";
+  const char* path = NULL;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] == '-' && i+1 < argc){
+      switch (argv[i][1]) {
+        case 'n': cycles = atoll(argv[++i]); break;
+        case 'x': max_execs = atoll(argv[++i]); break;
+        case 't': seconds = atof(argv[++i]); break;
+        case 's': seed = atoi(argv[++i]); break;
+        case 'o': crash_dir = argv[++i]; break;
+        default:
+          fprintf(stderr, "Usage: fuzz PROGRAM [-n CYCLES] [-t SECONDS] [-x EXECS] [-s SEED] [-o CRASH_DIR]\n");
+          return 1;
+      }
+    }else{
+      path = argv[i];
+    }
+  }
+  if(!path){
+    fprintf(stderr, "Usage: fuzz PROGRAM [-n CYCLES] [-t SECONDS] [-x EXECS] [-s SEED] [-o CRASH_DIR]\n");
+    return 1;
+  }
+  if(!Fuzz_init(path, cycles)) return 1;
+  Fuzz_build_dictionary();
+  srand(seed);
+
+  size_t corpus_size = 0, corpus_capacity = 64;
+  Fuzz_Input* corpus = malloc(corpus_capacity * sizeof(Fuzz_Input));
+  assert(corpus);
+  // the empty input is the only seed
+  Fuzz_run(NULL, 0);
+  Fuzz_collect();
+  corpus[corpus_size++] = (Fuzz_Input){calloc(1, 1), 0};
+
+  bool crash_pcs[0x10000] = {0};
+  size_t crashes = 0;
+  static uint8_t data[FUZZ_MAX_INPUT];
+  uint64_t execs = 0;
+  uint64_t start = Fuzz_now_ns(), last_report = start;
+  while(!max_execs || execs < max_execs){
+    Fuzz_Input* parent = &corpus[rand() % corpus_size];
+    memcpy(data, parent->data, parent->size);
+    size_t size = Fuzz_mutate(data, parent->size, corpus, corpus_size);
+    Fuzz_Result result = Fuzz_run(data, size);
+    execs++;
+
+    if(Fuzz_collect()){
+      if(corpus_size == corpus_capacity){
+        corpus_capacity *= 2;
+        corpus = realloc(corpus, corpus_capacity * sizeof(Fuzz_Input));
+        assert(corpus);
+      }
+      uint8_t* copy = malloc(size + 1);
+      assert(copy);
+      memcpy(copy, data, size);
+      corpus[corpus_size++] = (Fuzz_Input){copy, size};
+    }
+    // one crash per address the program crashes at
+    uint16_t pc = fuzz.machine->core.reg.pc.full;
+    if(result == Fuzz_CRASH && !crash_pcs[pc]){
+      crash_pcs[pc] = true;
+      Fuzz_save_crash(crash_dir, data, size, crashes++);
+    }
+
+    if((execs & 0x3FF) == 0){
+      uint64_t now = Fuzz_now_ns();
+      if(now - last_report >= 1000000000ull || now - start >= seconds*1e9){
+        last_report = now;
+        printf("execs: %llu (%.0f/s) corpus: %zu edges: %zu crashes: %zu\n",
+            (unsigned long long)execs, execs / ((now - start) / 1e9), corpus_size, Fuzz_edges(), crashes);
+        fflush(stdout);
+      }
+      if(now - start >= seconds*1e9) break;
+    }
+  }
+  double elapsed = (Fuzz_now_ns() - start) / 1e9;
+  printf("done: %llu execs in %.1fs (%.0f/s) corpus: %zu edges: %zu crashes: %zu\n",
+      (unsigned long long)execs, elapsed, execs / elapsed, corpus_size, Fuzz_edges(), crashes);
+  for(size_t i = 0; i < corpus_size; ++i) free(corpus[i].data);
+  free(corpus);
+  return crashes ? 2 : 0;
+}
+
+#endif // FUZZ_LIBFUZZER
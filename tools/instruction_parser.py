@@ -1,29 +1,120 @@
 
+import re
+import sys
+
+# parses the X(name, opcode, operand, cycles, timing, description) lines of
+# the ADR8_OPCODES list, the single description of every instruction
+OPCODE_LINE = re.compile(r'X\((\w+),\s*(0x[0-9A-Fa-f]+),\s*(\w+),\s*(\d+),\s*(\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+
 def parse_instructions(path):
     instructions = {}
     with open(path,'r') as file:
         inopdef = False
         for line in file.readlines():
-            if 'enum{ // ADR8_OpCode' in line:
+            if line.startswith('#define ADR8_OPCODES(X)'):
                 inopdef = True
-            if '}ADR8_OpCode;' in line:
-                inopdef = False
-            if not inopdef:
                 continue
-            if not 'ADR8_Op_' in line:
+            if not inopdef:
                 continue
-            line = line.split('Op_')
-            line = line[1].split('=')
-            name = line[0].strip()
-            opcode = line[1].split(',')[0].strip()
-            instructions[name] = opcode
+            match = OPCODE_LINE.search(line)
+            if match:
+                name, opcode, operand, cycles, timing, description = match.groups()
+                instructions[name] = {
+                    'opcode': int(opcode, 16),
+                    'operand': operand,
+                    'cycles': int(cycles),
+                    'timing': timing,
+                    'description': description.replace('\\"', '"'),
+                }
+            if not line.rstrip().endswith('\\'):
+                break
     return instructions
 
 def generate_c_lookup_table(instructions):
     for instruction in instructions:
         print(f'table[ADR8_Op_{instruction}] = "{instruction}";')
 
+OPERAND_NOTATION = {'NONE': '', 'IMMEDIATE': ' xxxx', 'ADDRESS': ' mmmm', 'OFFSET': ' dd'}
+README_TABLE_HEADER = 'Instruction | Hex Code | Cycles | Description'
 
-instructions = parse_instructions('ADR8.h')
-generate_c_lookup_table(instructions)
+def generate_readme_table(instructions):
+    lines = [README_TABLE_HEADER, '----------- | -------- | ------ | -------------------------------------------------------------------------']
+    for name, instruction in instructions.items():
+        code = f'{instruction["opcode"]:02X}{OPERAND_NOTATION[instruction["operand"]]}'
+        cycles = f'{instruction["cycles"]}' + ('' if instruction['timing'] == 'FIXED' else '+')
+        lines.append(f'{name:<11} | {code:<8} | {cycles:<6} | {instruction["description"]}')
+    return lines
+
+# replaces the instruction table in the README, which ends at the first line
+# that isn't a table row
+def update_readme(instructions, path):
+    with open(path, 'r') as file:
+        lines = file.read().split('\n')
+    start = lines.index(README_TABLE_HEADER)
+    end = start
+    while end < len(lines) and ' | ' in lines[end]:
+        end += 1
+    lines[start:end] = generate_readme_table(instructions)
+    with open(path, 'w') as file:
+        file.write('\n'.join(lines))
+
+MNEMONIC_HASH_BITS = 9
 
+def mnemonic_key(name):
+    # mnemonics are packed little endian into a 32-bit key
+    assert len(name) <= 4, f'mnemonic {name} longer than 4 characters'
+    key = 0
+    for i, c in enumerate(name):
+        key |= ord(c) << (8*i)
+    return key
+
+def mnemonic_hash(key, seed):
+    return ((key*seed) & 0xFFFFFFFF) >> (32 - MNEMONIC_HASH_BITS)
+
+def find_perfect_hash_seed(keys):
+    seed = 0x9E3779B1
+    while True:
+        if len({mnemonic_hash(key, seed) for key in keys}) == len(keys):
+            return seed
+        seed = (seed*0x2545F491 + 0x6B43A9B5) & 0xFFFFFFFF | 1
+
+def generate_c_mnemonic_header(instructions):
+    keys = {name: mnemonic_key(name) for name in instructions}
+    seed = find_perfect_hash_seed(keys.values())
+    slots = [None]*(1 << MNEMONIC_HASH_BITS)
+    for name, key in keys.items():
+        slots[mnemonic_hash(key, seed)] = name
+
+    print('// generated from the ADR8_OPCODES list by tools/instruction_parser.py --mnemonics')
+    print('// do not edit, run `make generate` after changing the list instead')
+    print('#ifndef ADR8_MNEMONICS_H')
+    print('#define ADR8_MNEMONICS_H')
+    print()
+    print('#include <stdint.h>')
+    print()
+    print(f'#define MNEMONIC_HASH_BITS {MNEMONIC_HASH_BITS}')
+    print(f'#define MNEMONIC_HASH_SEED 0x{seed:08X}u')
+    print('#define MNEMONIC_HASH(key) ((uint32_t)((key)*MNEMONIC_HASH_SEED) >> (32 - MNEMONIC_HASH_BITS))')
+    print()
+    print('typedef struct{')
+    print('  uint32_t key; // mnemonic packed little endian, 0 for empty slots')
+    print('  uint8_t opcode;')
+    print('} MnemonicEntry;')
+    print()
+    print('// perfect hash of every mnemonic, indexed by MNEMONIC_HASH(key)')
+    print(f'static const MnemonicEntry MnemonicTable[1 << MNEMONIC_HASH_BITS] = {{')
+    for index, name in enumerate(slots):
+        if name:
+            print(f'  [{index}] = {{0x{keys[name]:08X}u, ADR8_Op_{name}}},')
+    print('};')
+    print()
+    print('#endif // ADR8_MNEMONICS_H')
+
+
+instructions = parse_instructions('ADR8.h')
+if '--mnemonics' in sys.argv:
+    generate_c_mnemonic_header(instructions)
+elif '--readme' in sys.argv:
+    update_readme(instructions, 'README.md')
+else:
+    generate_c_lookup_table(instructions)
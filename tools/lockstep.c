@@ -0,0 +1,476 @@
+#define ADR8_IMPLEMENTATION
+// random programs run into unknown opcodes all the time, which halt the core
+#define ADR8_LOG_PRINTF(...) ((void)0)
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "../utilities/disassembler.h"
+#include "../utilities/bootstrapper.h"
+#define ADR8_RECOMPILED_LIBRARY
+#include "../utilities/recompiler.h"
+#include <dlfcn.h>
+#include <unistd.h>
+
+// Differential validation of the execution engines against the reference,
+// ADR8_Core_clock followed by ADR8_Bus_clock every cycle with every block
+// memory op going over the bus. The reference is stepped an instruction at a
+// time and every other engine is run up to the same cycle, after which the
+// core, memory and the serial I/O have to match. Free-running engines are
+// run in one go instead and compared once the reference ended, which is
+// what skipping ahead over stalls, waits and translated code has to get
+// right over long stretches. A divergence stops the run, the program is
+// shrunk to the fewest instructions that still diverge and the last
+// instructions leading up to it are printed.
+//
+// Programs are either files assembled with -b, loaded through the
+// bootstrapper, or random instruction streams started at address 0. The
+// recompiler only runs random programs, each one is translated to C,
+// compiled to a shared object and loaded, which is why it only runs the
+// first few given with -x. It has to be started from the root of the
+// repository to find the recompiler and its runtime.
+
+#define LOCKSTEP_MEMORY_SIZE 0x1000
+#define LOCKSTEP_PROGRAM_SIZE 0x100
+#define LOCKSTEP_INPUT_SIZE 64
+#define LOCKSTEP_TRACE 16
+#define LOCKSTEP_DEFAULT_PROGRAMS 2000
+#define LOCKSTEP_DEFAULT_CYCLES 20000
+
+#ifndef LOCKSTEP_RECOMPILER
+#define LOCKSTEP_RECOMPILER "./build/utilities/recompiler"
+#endif
+#ifndef LOCKSTEP_RECOMPILER_RUNTIME
+#define LOCKSTEP_RECOMPILER_RUNTIME "./utilities" // directory of recompiler.h
+#endif
+
+typedef struct Lockstep_Engine Lockstep_Engine;
+
+struct Lockstep_Engine{
+  const char* name;
+  void (*run)(Lockstep_Engine* engine, uint64_t until); // NULL for the reference
+  bool free_running; // only run and compared once the reference ended
+  bool recompiled;   // runs a translation of the program, which doesn't keep the decode state
+  bool active;       // runs the current program
+  ADR8_Machine* machine;
+  ADR8_SerialBus serial;
+  ADR8_Scheduler sched;
+  ADR8_Timer timer;
+  FILE* in_fp;
+  FILE* out_fp;
+  char* output;
+  size_t output_size;
+  ADR8_Recompiled* rt;
+  void* library;
+};
+
+typedef struct{
+  uint16_t pc;
+  uint8_t opcode;
+  uint64_t cycles; // after the instruction
+  ADR8_Registers reg;
+} Lockstep_TraceEntry;
+
+typedef struct{
+  const uint8_t* image; // loaded at address 0 and run from there
+  size_t image_size;
+  const uint8_t* input;
+  size_t input_size;
+  uint64_t cycles;
+  uint8_t block_cycles;
+  bool recompile; // also run the recompiled engine
+} Lockstep_Program;
+
+static char lockstep_dir[] = "/tmp/lockstep.XXXXXX"; // output of the recompiler
+
+// runs the scheduler loop, which skips over stall and wait cycles, on a
+// machine whose memory is a bus region, so block memory ops run on the host
+static void Lockstep_run_scheduler(Lockstep_Engine* engine, uint64_t until){
+  ADR8_Scheduler_run(&engine->sched, &engine->machine->core, until);
+}
+
+static void Lockstep_run_recompiled(Lockstep_Engine* engine, uint64_t until){
+  engine->rt->cycle_limit = until;
+  ADR8_Recompiled_run(engine->rt);
+}
+
+static Lockstep_Engine lockstep_engines[] = {
+  {.name = "reference"},
+  {.name = "scheduler", .run = Lockstep_run_scheduler},
+  {.name = "free-running scheduler", .run = Lockstep_run_scheduler, .free_running = true},
+  {.name = "recompiled", .run = Lockstep_run_recompiled, .free_running = true, .recompiled = true},
+};
+
+#define LOCKSTEP_ENGINES (sizeof(lockstep_engines)/sizeof(lockstep_engines[0]))
+
+// translates the raw image with the recompiler and loads the result,
+// returns NULL if any of it failed
+static const ADR8_RecompiledProgram* Lockstep_recompile(Lockstep_Engine* engine, Lockstep_Program* program){
+  static unsigned count = 0;
+  char path[64], command[512];
+  snprintf(path, sizeof(path), "%s/program.bin", lockstep_dir);
+  FILE* fp = fopen(path, "wb");
+  if(!fp) return NULL;
+  fwrite(program->image, 1, program->image_size, fp);
+  fclose(fp);
+  // a new name every time as dlopen returns the library loaded before for
+  // the same path
+  const char* cc = getenv("CC") ? getenv("CC") : "cc";
+  snprintf(command, sizeof(command),
+      LOCKSTEP_RECOMPILER " -r -o %1$s/program.c %1$s/program.bin && "
+      "%2$s -O0 -shared -fPIC -DADR8_RECOMPILED_LIBRARY '-DADR8_LOG_PRINTF(...)=((void)0)' "
+      "-I" LOCKSTEP_RECOMPILER_RUNTIME " %1$s/program.c -o %1$s/program%3$u.so",
+      lockstep_dir, cc, count);
+  if(system(command) != 0) return NULL;
+  snprintf(path, sizeof(path), "%s/program%u.so", lockstep_dir, count++);
+  engine->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  unlink(path);
+  if(!engine->library){
+    fprintf(stderr, "%s\n", dlerror());
+    return NULL;
+  }
+  return dlsym(engine->library, "ADR8_recompiled_program");
+}
+
+// the recompiled runtime brings its own machine and devices, the serial
+// poll is cancelled as the input of the other engines can't be polled
+static void Lockstep_Engine_init_recompiled(Lockstep_Engine* engine, Lockstep_Program* program){
+  const ADR8_RecompiledProgram* recompiled = Lockstep_recompile(engine, program);
+  if(!recompiled){
+    fprintf(stderr, "unable to recompile the program\n");
+    exit(1);
+  }
+  engine->rt = malloc(sizeof(ADR8_Recompiled));
+  assert(engine->rt);
+  bool ok = ADR8_Recompiled_init(engine->rt, recompiled, engine->in_fp, engine->out_fp);
+  assert(ok);
+  (void)ok;
+  ADR8_Scheduler_cancel(&engine->rt->sched, ADR8_SerialPoll_event, &engine->rt->poll);
+  engine->rt->serial.core = NULL;
+  engine->machine = engine->rt->machine;
+  engine->machine->core.block_cycles = program->block_cycles;
+  engine->machine->core.reg.stk.full = LOCKSTEP_MEMORY_SIZE - 1;
+}
+
+static void Lockstep_Engine_init(Lockstep_Engine* engine, Lockstep_Program* program){
+  engine->active = !engine->recompiled || program->recompile;
+  if(!engine->active) return;
+  engine->in_fp = program->input_size ? fmemopen((void*)program->input, program->input_size, "r") : fopen("/dev/null", "r");
+  engine->out_fp = open_memstream(&engine->output, &engine->output_size);
+  assert(engine->in_fp && engine->out_fp);
+  if(engine->recompiled){
+    Lockstep_Engine_init_recompiled(engine, program);
+    return;
+  }
+
+  engine->machine = ADR8_Machine_new(LOCKSTEP_MEMORY_SIZE, 0x0);
+  assert(engine->machine);
+  ADR8_Machine* machine = engine->machine;
+  ADR8_Bus* bus = &machine->bus;
+  // the reference can't take the host path of the block memory ops
+  if(!engine->run) bus->region_count = 0;
+
+  ADR8_SerialBus_init(&engine->serial, engine->in_fp, engine->out_fp, bus, 0x1000);
+  ADR8_Scheduler_init(&engine->sched);
+  ADR8_Timer_init(&engine->timer, bus, &engine->sched, &machine->core, 1, 1, 0x1010);
+
+  memcpy(machine->mem.data, program->image, program->image_size);
+  machine->core.block_cycles = program->block_cycles;
+  machine->core.reg.stk.full = LOCKSTEP_MEMORY_SIZE - 1;
+}
+
+static void Lockstep_Engine_free(Lockstep_Engine* engine){
+  if(!engine->active) return;
+  fclose(engine->in_fp);
+  fclose(engine->out_fp);
+  free(engine->output);
+  engine->output = NULL;
+  if(engine->recompiled){
+    ADR8_Recompiled_free(engine->rt);
+    free(engine->rt);
+    dlclose(engine->library);
+    return;
+  }
+  ADR8_Scheduler_free(&engine->sched);
+  ADR8_Machine_free(engine->machine);
+}
+
+// clocks the reference up to the end of the current instruction or until
+static void Lockstep_step_reference(Lockstep_Engine* engine, uint64_t until){
+  ADR8_Core* core = &engine->machine->core;
+  do{
+    ADR8_Core_clock(core);
+    ADR8_Bus_clock(core->bus);
+    if(ADR8_Scheduler_next(&engine->sched) <= core->cycles){
+      ADR8_Scheduler_dispatch(&engine->sched, core->cycles);
+    }
+  }while(!core->halt && core->cycles < until && !(core->fetch && !core->stall));
+}
+
+static uint64_t Lockstep_hash(const uint8_t* data, size_t size){
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for(size_t i = 0; i < size; ++i){
+    hash ^= data[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+// describes the first difference between the engines in diff, the decode
+// state and the ADR scratch register are left out as engines may finish an
+// instruction with different values in them that no program can observe
+static bool Lockstep_compare(Lockstep_Engine* ref, Lockstep_Engine* engine, char* diff, size_t diff_size){
+  ADR8_Core* a = &ref->machine->core;
+  ADR8_Core* b = &engine->machine->core;
+  #define LOCKSTEP_FIELD(field) \
+    if(a->field != b->field){ \
+      snprintf(diff, diff_size, #field " %llX != %llX", (unsigned long long)a->field, (unsigned long long)b->field); \
+      return false; \
+    }
+  LOCKSTEP_FIELD(cycles);
+  LOCKSTEP_FIELD(halt);
+  if(!engine->recompiled){
+    LOCKSTEP_FIELD(fetch);
+    LOCKSTEP_FIELD(stall);
+    LOCKSTEP_FIELD(reg.cmd.opcode);
+  }
+  LOCKSTEP_FIELD(reg.pc.full);
+  LOCKSTEP_FIELD(reg.stk.full);
+  LOCKSTEP_FIELD(reg.ctrl.full);
+  LOCKSTEP_FIELD(reg.a.full);
+  LOCKSTEP_FIELD(reg.b.full);
+  LOCKSTEP_FIELD(reg.x.full);
+  LOCKSTEP_FIELD(reg.y.full);
+  LOCKSTEP_FIELD(reg.ivt.full);
+  LOCKSTEP_FIELD(irq_pending);
+  LOCKSTEP_FIELD(irq_enabled);
+  LOCKSTEP_FIELD(interrupt);
+  LOCKSTEP_FIELD(waiting);
+  #undef LOCKSTEP_FIELD
+
+  uint8_t* mem_a = ref->machine->mem.data;
+  uint8_t* mem_b = engine->machine->mem.data;
+  size_t size = ref->machine->mem.size;
+  // hashing every instruction costs far more than comparing
+  if(memcmp(mem_a, mem_b, size) != 0){
+    size_t i = 0;
+    while(mem_a[i] == mem_b[i]) ++i;
+    snprintf(diff, diff_size, "memory [%04zX] %02X != %02X (hash %016llX != %016llX)", i, mem_a[i], mem_b[i],
+        (unsigned long long)Lockstep_hash(mem_a, size), (unsigned long long)Lockstep_hash(mem_b, size));
+    return false;
+  }
+
+  long read_a = ftell(ref->in_fp), read_b = ftell(engine->in_fp);
+  if(read_a != read_b){
+    snprintf(diff, diff_size, "serial bytes read %ld != %ld", read_a, read_b);
+    return false;
+  }
+  fflush(ref->out_fp);
+  fflush(engine->out_fp);
+  if(ref->output_size != engine->output_size || memcmp(ref->output, engine->output, ref->output_size) != 0){
+    snprintf(diff, diff_size, "serial output of %zu != %zu bytes", ref->output_size, engine->output_size);
+    return false;
+  }
+  return true;
+}
+
+static void Lockstep_print_trace(Lockstep_TraceEntry* trace, size_t steps){
+  size_t first = steps > LOCKSTEP_TRACE ? steps - LOCKSTEP_TRACE : 0;
+  for(size_t i = first; i < steps; ++i){
+    Lockstep_TraceEntry* entry = &trace[i % LOCKSTEP_TRACE];
+    const char* name = ADR8_OpInfoTable[entry->opcode].name ? ADR8_OpInfoTable[entry->opcode].name : "???";
+    printf("  %6zu [%04hX] %-4s cycles: %-6llu a: %04hX b: %04hX x: %04hX y: %04hX stk: %04hX\n",
+        i, entry->pc, name, (unsigned long long)entry->cycles, entry->reg.a.full, entry->reg.b.full,
+        entry->reg.x.full, entry->reg.y.full, entry->reg.stk.full);
+  }
+}
+
+// returns true if every engine matches the reference at every instruction
+static bool Lockstep_check(Lockstep_Program* program, bool verbose){
+  for(size_t i = 0; i < LOCKSTEP_ENGINES; ++i) Lockstep_Engine_init(&lockstep_engines[i], program);
+  Lockstep_Engine* ref = &lockstep_engines[0];
+  ADR8_Core* core = &ref->machine->core;
+
+  Lockstep_TraceEntry trace[LOCKSTEP_TRACE];
+  size_t steps = 0;
+  bool match = true;
+  char diff[160];
+  while(match && !core->halt && core->cycles < program->cycles){
+    Lockstep_TraceEntry* entry = &trace[steps++ % LOCKSTEP_TRACE];
+    entry->pc = core->reg.pc.full;
+    Lockstep_step_reference(ref, program->cycles);
+    entry->opcode = core->reg.cmd.opcode;
+    entry->cycles = core->cycles;
+    entry->reg = core->reg;
+    // engines may be anywhere inside an instruction the budget cuts short
+    if(!core->halt && !(core->fetch && !core->stall)) break;
+    for(size_t i = 1; i < LOCKSTEP_ENGINES && match; ++i){
+      Lockstep_Engine* engine = &lockstep_engines[i];
+      if(engine->free_running || !engine->active) continue;
+      engine->run(engine, core->cycles);
+      if(!Lockstep_compare(ref, engine, diff, sizeof(diff))){
+        match = false;
+        if(verbose){
+          printf("%s diverges from %s after %zu instructions: %s\n", engine->name, ref->name, steps, diff);
+          Lockstep_print_trace(trace, steps);
+        }
+      }
+    }
+  }
+  for(size_t i = 1; i < LOCKSTEP_ENGINES && match; ++i){
+    Lockstep_Engine* engine = &lockstep_engines[i];
+    if(!engine->free_running || !engine->active) continue;
+    engine->run(engine, core->cycles);
+    if(!Lockstep_compare(ref, engine, diff, sizeof(diff))){
+      match = false;
+      if(verbose){
+        printf("%s diverges from %s at the end, after %zu instructions: %s\n", engine->name, ref->name, steps, diff);
+        Lockstep_print_trace(trace, steps);
+      }
+    }
+  }
+  for(size_t i = 0; i < LOCKSTEP_ENGINES; ++i) Lockstep_Engine_free(&lockstep_engines[i]);
+  return match;
+}
+
+// replaces every instruction it can by NOPs while the program still diverges
+static void Lockstep_minimize(uint8_t* image, size_t size, Lockstep_Program* program){
+  for(size_t i = 0; i < size; ++i){
+    if(image[i] == ADR8_Op_NOP) continue;
+    uint8_t saved = image[i];
+    image[i] = ADR8_Op_NOP;
+    if(Lockstep_check(program, false)) image[i] = saved;
+  }
+}
+
+static bool Lockstep_report(uint8_t* image, size_t size, Lockstep_Program* program, const char* source){
+  if(Lockstep_check(program, false)) return true;
+  printf("divergence in %s (block cycles %hhu)\n", source, program->block_cycles);
+  Lockstep_minimize(image, size, program);
+  printf("minimized program:");
+  for(size_t i = 0; i < size; ++i) printf("%s%02X", i % 32 ? " " : "\n  ", image[i]);
+  printf("\n");
+  Lockstep_check(program, true);
+  return false;
+}
+
+static uint16_t Lockstep_random_address(void){
+  // now and then a device register instead of memory
+  if(rand() % 16 == 0) return 0x1000 + rand() % 0x20;
+  return rand() % LOCKSTEP_MEMORY_SIZE;
+}
+
+// random instructions of implemented opcodes, every other one is opcode
+// unless that is 0, followed by random data
+static void Lockstep_random_program(uint8_t* image, uint8_t opcode){
+  static uint8_t opcodes[0x100];
+  static size_t opcode_count = 0;
+  if(!opcode_count){
+    for(size_t op = 0; op < 0x100; ++op){
+      if(ADR8_OpTiming_cycles(op)) opcodes[opcode_count++] = op;
+    }
+  }
+  for(size_t i = 0; i < LOCKSTEP_MEMORY_SIZE; ++i) image[i] = rand();
+  size_t pc = 0;
+  bool pick = true;
+  while(pc + 3 < LOCKSTEP_PROGRAM_SIZE){
+    uint8_t op = opcode && !pick ? opcode : opcodes[rand() % opcode_count];
+    pick = !pick;
+    image[pc++] = op;
+    uint8_t operand_size = Disassembler_operand_size(op);
+    if(operand_size == 2){
+      uint16_t address = Lockstep_random_address();
+      image[pc++] = address;
+      image[pc++] = address >> 8;
+    }else if(operand_size == 1){
+      image[pc++] = rand();
+    }
+  }
+  image[pc] = ADR8_Op_HALT;
+}
+
+static bool Lockstep_file(const char* path, uint64_t cycles){
+  FILE* fp = fopen(path, "rb");
+  if(!fp){
+    fprintf(stderr, "unable to open '%s'\n", path);
+    return false;
+  }
+  static uint8_t input[0x10000 + 2];
+  size_t input_size = fread(input, 1, sizeof(input), fp);
+  fclose(fp);
+
+  uint8_t image[ADR8_BOOTSTRAPPER_SIZE + 1] = {0};
+  memcpy(image, ADR8_bootstrapper, ADR8_BOOTSTRAPPER_SIZE);
+  Lockstep_Program program = {
+    .image = image, .image_size = sizeof(image),
+    .input = input, .input_size = input_size,
+    .cycles = cycles, .block_cycles = ADR8_BLOCK_CYCLES,
+  };
+  // the program arrives over the serial bus so there is nothing to shrink
+  if(Lockstep_check(&program, false)) return true;
+  printf("divergence in %s (block cycles %hhu)\n", path, program.block_cycles);
+  Lockstep_check(&program, true);
+  return false;
+}
+
+int main(int argc, char** argv){
+  size_t program_count = LOCKSTEP_DEFAULT_PROGRAMS;
+  uint64_t cycles = LOCKSTEP_DEFAULT_CYCLES;
+  unsigned seed = 1;
+  size_t recompile_count = 0;
+  int files = 0;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] == '-' && i+1 < argc){
+      switch (argv[i][1]) {
+        case 'r': program_count = atol(argv[++i]); break;
+        case 'n': cycles = atoll(argv[++i]); break;
+        case 's': seed = atoi(argv[++i]); break;
+        case 'x': recompile_count = atol(argv[++i]); break;
+        default:
+          fprintf(stderr, "Usage: lockstep [-r RANDOM_PROGRAMS] [-n CYCLES] [-s SEED] [-x RECOMPILED_PROGRAMS] [FILE...]\n");
+          return 1;
+      }
+    }else{
+      argv[files++] = argv[i];
+    }
+  }
+
+  if(recompile_count && !mkdtemp(lockstep_dir)){
+    fprintf(stderr, "unable to create '%s'\n", lockstep_dir);
+    return 1;
+  }
+
+  bool ok = true;
+  for(int i = 0; i < files && ok; ++i){
+    ok = Lockstep_file(argv[i], cycles * 100);
+  }
+
+  srand(seed);
+  static uint8_t image[LOCKSTEP_MEMORY_SIZE];
+  static uint8_t input[LOCKSTEP_INPUT_SIZE];
+  for(size_t n = 0; n < program_count && ok; ++n){
+    // the first programs each stress one opcode, the rest are fully random
+    uint8_t opcode = n < 0x100 && ADR8_OpTiming_cycles(n) ? n : 0;
+    Lockstep_random_program(image, opcode);
+    for(size_t i = 0; i < LOCKSTEP_INPUT_SIZE; ++i) input[i] = rand();
+    Lockstep_Program program = {
+      .image = image, .image_size = sizeof(image),
+      .input = input, .input_size = sizeof(input),
+      .cycles = cycles, .block_cycles = ADR8_BLOCK_CYCLES + rand() % 3,
+      .recompile = n < recompile_count,
+    };
+    char source[64];
+    snprintf(source, sizeof(source), "random program %zu (seed %u)", n, seed);
+    ok = Lockstep_report(image, LOCKSTEP_PROGRAM_SIZE, &program, source);
+  }
+
+  if(recompile_count){
+    char path[64];
+    snprintf(path, sizeof(path), "%s/program.bin", lockstep_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/program.c", lockstep_dir);
+    unlink(path);
+    rmdir(lockstep_dir);
+  }
+  if(ok) printf("%d files and %zu random programs match across %zu engines\n", files, program_count, LOCKSTEP_ENGINES);
+  return ok ? 0 : 1;
+}
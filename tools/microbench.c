@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#define ADR8_IMPLEMENTATION
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+
+// Microbenchmarks isolating the host cost of the individual paths in ADR8.h.
+// Every benchmark is repeated several times and reported as ns per operation.
+// The core benchmarks clock a single memory alongside the core since it cannot
+// fetch without one, compare with "memory clock read" for the core-only share.
+
+#define BENCH_DEFAULT_REPS 15
+#define BENCH_DEFAULT_ITERS 2000000
+
+typedef struct{
+  const char* name;
+  double ns[256];
+  size_t reps;
+} Bench_Result;
+
+static volatile uint32_t bench_sink;
+
+static uint64_t Bench_now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+static int Bench_cmp_double(const void* a, const void* b){
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void Bench_report(Bench_Result* res){
+  double mean = 0, var = 0;
+  for(size_t i = 0; i < res->reps; ++i) mean += res->ns[i];
+  mean /= res->reps;
+  for(size_t i = 0; i < res->reps; ++i) var += (res->ns[i]-mean)*(res->ns[i]-mean);
+  double stddev = res->reps > 1 ? sqrt(var/(res->reps-1)) : 0;
+  qsort(res->ns, res->reps, sizeof(double), Bench_cmp_double);
+  printf("%-28s %8.3f %8.3f %8.3f %8.3f\n",
+      res->name, res->ns[res->reps/2], res->ns[0], mean, stddev);
+}
+
+static bool Bench_pin_cpu(int cpu){
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// core clock per opcode class
+
+typedef struct{
+  const char* name;
+  uint8_t pattern[8];
+  size_t len;
+} Bench_OpClass;
+
+static Bench_OpClass bench_op_classes[] = {
+  {"core NOP",       {ADR8_Op_NOP}, 1},
+  {"core SETx",      {ADR8_Op_SETA, 0x34, 0x12}, 3},
+  {"core LDxx",      {ADR8_Op_LDAL, 0x00, 0x0F}, 3},
+  {"core STxx",      {ADR8_Op_STAL, 0x00, 0x0F}, 3},
+  {"core LDx",       {ADR8_Op_LDA, 0x00, 0x0F}, 3},
+  {"core STx",       {ADR8_Op_STA, 0x00, 0x0F}, 3},
+  {"core LXxx",      {ADR8_Op_LXAL}, 1},
+  {"core SXxx",      {ADR8_Op_SXAL}, 1},
+  {"core LXA/SXA",   {ADR8_Op_LXA, ADR8_Op_SXA}, 2},
+  {"core TRxx",      {ADR8_Op_TRAB, ADR8_Op_TRXA}, 2},
+  {"core ALU",       {ADR8_Op_ADD}, 1},
+  {"core INCX/DECX", {ADR8_Op_INCX, ADR8_Op_DECX}, 2},
+  {"core JMPR",      {ADR8_Op_JMPR, 0x00}, 2},
+  {"core JEQA",      {ADR8_Op_JEQA, 0x00, 0x00}, 3},
+  {"core PUxx/POxx", {ADR8_Op_PUAL, ADR8_Op_POAL}, 2},
+  {"core PUx/POx",   {ADR8_Op_PUA, ADR8_Op_POA}, 2},
+  {"core JSR/RSR",   {ADR8_Op_JSR, 0x00, 0x0F}, 3},
+};
+
+#define BENCH_PROGRAM_END 0x0E00
+#define BENCH_DATA 0x0F00
+
+// fills the program area with the pattern followed by a jump back to zero
+static void Bench_setup_program(ADR8_Memory* mem, Bench_OpClass* op){
+  memset(mem->data, 0, mem->size);
+  uint16_t pc = 0;
+  while(pc + op->len + 3 < BENCH_PROGRAM_END){
+    memcpy(&mem->data[pc], op->pattern, op->len);
+    pc += op->len;
+  }
+  mem->data[pc++] = ADR8_Op_JMPA;
+  mem->data[pc++] = 0x00;
+  mem->data[pc++] = 0x00;
+  // subroutine target for JSR/RSR, the core enters subroutines at mmmm+1
+  mem->data[BENCH_DATA] = ADR8_Op_RSR;
+  mem->data[BENCH_DATA+1] = ADR8_Op_RSR;
+}
+
+static void Bench_core_class(Bench_OpClass* op, size_t reps, size_t iters){
+  ADR8_Bus bus = {0};
+  ADR8_Memory mem = {0};
+  ADR8_Memory_init(&mem, &bus, 0x1000, 0x0);
+  ADR8_Core core = {0};
+
+  Bench_Result core_mem = {.name = op->name, .reps = reps};
+  for(size_t r = 0; r < reps; ++r){
+    Bench_setup_program(&mem, op);
+    ADR8_Core_init(&core, &bus);
+    core.reg.stk.full = 0x0FFF;
+    core.reg.x.full = BENCH_DATA + 1;
+    uint64_t start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Core_clock(&core);
+      ADR8_Memory_clock(&mem);
+    }
+    core_mem.ns[r] = (double)(Bench_now_ns() - start) / iters;
+    if(core.halt) ADR8_ERROR_LOG("benchmark '%s' halted early\n", op->name);
+  }
+  Bench_report(&core_mem);
+  free(mem.data);
+}
+
+// memory clock versus a flat page table lookup
+
+#define BENCH_ADDRESSES 4096
+
+static void Bench_memory(size_t reps, size_t iters){
+  ADR8_Bus bus = {0};
+  ADR8_Memory mem = {0};
+  ADR8_Memory_init(&mem, &bus, 0x1000, 0x0);
+  memset(mem.data, 0xA5, mem.size);
+
+  uint16_t addresses[BENCH_ADDRESSES];
+  srand(1);
+  for(size_t i = 0; i < BENCH_ADDRESSES; ++i) addresses[i] = rand() % mem.size;
+
+  uint8_t* page_table[0x100] = {0};
+  for(size_t i = 0; i < mem.size/0x100; ++i) page_table[i] = mem.data + i*0x100;
+
+  Bench_Result mem_read = {.name = "memory clock read", .reps = reps};
+  Bench_Result mem_write = {.name = "memory clock write", .reps = reps};
+  Bench_Result page_read = {.name = "page table read", .reps = reps};
+  for(size_t r = 0; r < reps; ++r){
+    uint32_t acc = 0;
+    uint64_t start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus_read(&bus, addresses[i % BENCH_ADDRESSES]);
+      ADR8_Memory_clock(&mem);
+      acc += ADR8_Bus_get_data(&bus);
+    }
+    mem_read.ns[r] = (double)(Bench_now_ns() - start) / iters;
+
+    start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus_write(&bus, addresses[i % BENCH_ADDRESSES], (uint8_t)i);
+      ADR8_Memory_clock(&mem);
+    }
+    mem_write.ns[r] = (double)(Bench_now_ns() - start) / iters;
+
+    start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      uint16_t address = addresses[i % BENCH_ADDRESSES];
+      uint8_t* page = page_table[address >> 8];
+      if(page) acc += page[address & 0xFF];
+    }
+    page_read.ns[r] = (double)(Bench_now_ns() - start) / iters;
+    bench_sink = acc;
+  }
+  Bench_report(&mem_read);
+  Bench_report(&mem_write);
+  Bench_report(&page_read);
+  free(mem.data);
+
+  ADR8_Bus paged_bus = {0};
+  ADR8_PagedMemory paged;
+  ADR8_PagedMemory_init(&paged, &paged_bus, 0x1000, 0x0);
+  for(size_t i = 0; i < paged.size; ++i) ADR8_PagedMemory_set(&paged, i, 0xA5);
+
+  Bench_Result paged_read = {.name = "paged memory clock read", .reps = reps};
+  Bench_Result paged_write = {.name = "paged memory clock write", .reps = reps};
+  for(size_t r = 0; r < reps; ++r){
+    uint32_t acc = 0;
+    uint64_t start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus_read(&paged_bus, addresses[i % BENCH_ADDRESSES]);
+      ADR8_PagedMemory_clock(&paged);
+      acc += ADR8_Bus_get_data(&paged_bus);
+    }
+    paged_read.ns[r] = (double)(Bench_now_ns() - start) / iters;
+
+    start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus_write(&paged_bus, addresses[i % BENCH_ADDRESSES], (uint8_t)i);
+      ADR8_PagedMemory_clock(&paged);
+    }
+    paged_write.ns[r] = (double)(Bench_now_ns() - start) / iters;
+    bench_sink = acc;
+  }
+  Bench_report(&paged_read);
+  Bench_report(&paged_write);
+  ADR8_PagedMemory_free(&paged);
+}
+
+// creating and destroying a machine, separately allocated versus one arena
+
+static void Bench_machine(size_t reps, size_t iters){
+  // creating machines is much slower than clocking them
+  iters = iters/64 ? iters/64 : 1;
+  Bench_Result separate = {.name = "machine separate new/free", .reps = reps};
+  Bench_Result arena = {.name = "machine arena new/free", .reps = reps};
+  for(size_t r = 0; r < reps; ++r){
+    uint32_t acc = 0;
+    uint64_t start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus* bus = calloc(1, sizeof(ADR8_Bus));
+      ADR8_Memory* mem = calloc(1, sizeof(ADR8_Memory));
+      ADR8_Core* core = calloc(1, sizeof(ADR8_Core));
+      assert(bus && mem && core);
+      ADR8_Memory_init(mem, bus, 0x1000, 0x0);
+      memset(mem->data, 0, mem->size);
+      ADR8_Core_init(core, bus);
+      acc += mem->data[i & 0xFFF];
+      free(mem->data);
+      free(core);
+      free(mem);
+      free(bus);
+    }
+    separate.ns[r] = (double)(Bench_now_ns() - start) / iters;
+
+    start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Machine* machine = ADR8_Machine_new(0x1000, 0x0);
+      assert(machine);
+      acc += machine->ram[i & 0xFFF];
+      ADR8_Machine_free(machine);
+    }
+    arena.ns[r] = (double)(Bench_now_ns() - start) / iters;
+    bench_sink = acc;
+  }
+  Bench_report(&separate);
+  Bench_report(&arena);
+}
+
+// serial port through stdio streams
+
+static void Bench_serial(size_t reps, size_t iters){
+  size_t in_size = iters;
+  char* in_data = malloc(in_size);
+  assert(in_data);
+  memset(in_data, 'a', in_size);
+  FILE* out_fp = fopen("/dev/null", "w");
+  assert(out_fp);
+
+  Bench_Result serial_read = {.name = "serial read", .reps = reps};
+  Bench_Result serial_write = {.name = "serial write", .reps = reps};
+  for(size_t r = 0; r < reps; ++r){
+    FILE* in_fp = fmemopen(in_data, in_size, "r");
+    assert(in_fp);
+    // a fresh bus per repetition, as every serial bus attaches to it
+    ADR8_Bus bus = {0};
+    ADR8_SerialBus serial = {0};
+    ADR8_SerialBus_init(&serial, in_fp, out_fp, &bus, 0x1000);
+    uint32_t acc = 0;
+    uint64_t start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus_read(&bus, 0x1000);
+      ADR8_SerialBus_clock(&serial);
+      acc += ADR8_Bus_get_data(&bus);
+    }
+    serial_read.ns[r] = (double)(Bench_now_ns() - start) / iters;
+    bench_sink = acc;
+    fclose(in_fp);
+
+    start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus_write(&bus, 0x1000, 'a');
+      ADR8_SerialBus_clock(&serial);
+    }
+    serial_write.ns[r] = (double)(Bench_now_ns() - start) / iters;
+  }
+  Bench_report(&serial_read);
+  Bench_report(&serial_write);
+  fclose(out_fp);
+  free(in_data);
+}
+
+// bus accessor indirection versus direct field access
+
+static void Bench_bus(size_t reps, size_t iters){
+  ADR8_Bus bus = {0};
+  ADR8_Bus* volatile bus_ptr = &bus; // keeps the bus from being folded away
+  Bench_Result accessors = {.name = "bus read+get_data", .reps = reps};
+  Bench_Result direct = {.name = "bus direct fields", .reps = reps};
+  for(size_t r = 0; r < reps; ++r){
+    uint32_t acc = 0;
+    uint64_t start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus* b = bus_ptr;
+      ADR8_Bus_read(b, (uint16_t)i);
+      b->data = (uint8_t)i;
+      acc += ADR8_Bus_get_data(b);
+    }
+    accessors.ns[r] = (double)(Bench_now_ns() - start) / iters;
+
+    start = Bench_now_ns();
+    for(size_t i = 0; i < iters; ++i){
+      ADR8_Bus* b = bus_ptr;
+      b->address = (uint16_t)i;
+      b->read = true;
+      b->data = (uint8_t)i;
+      acc += b->data;
+    }
+    direct.ns[r] = (double)(Bench_now_ns() - start) / iters;
+    bench_sink = acc;
+  }
+  Bench_report(&accessors);
+  Bench_report(&direct);
+}
+
+int main(int argc, char** argv){
+  size_t reps = BENCH_DEFAULT_REPS;
+  size_t iters = BENCH_DEFAULT_ITERS;
+  int cpu = 0;
+  const char* filter = NULL;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] == '-' && i+1 < argc){
+      switch (argv[i][1]) {
+        case 'r': reps = atol(argv[++i]); break;
+        case 'n': iters = atol(argv[++i]); break;
+        case 'c': cpu = atoi(argv[++i]); break;
+        case 'f': filter = argv[++i]; break;
+        default:
+          ADR8_ERROR_LOG("Usage: microbench [-r REPS] [-n ITERS] [-c CPU] [-f core|memory|machine|serial|bus]\n");
+          return 1;
+      }
+    }
+  }
+  if(reps == 0 || reps > 256) reps = BENCH_DEFAULT_REPS;
+  if(iters == 0) iters = BENCH_DEFAULT_ITERS;
+
+  if(!Bench_pin_cpu(cpu)){
+    ADR8_ERROR_LOG("unable to pin to cpu %d, results may be noisy\n", cpu);
+  }
+
+  printf("reps: %lu iterations: %lu cpu: %d\n", reps, iters, cpu);
+  printf("%-28s %8s %8s %8s %8s\n", "benchmark (ns/op)", "median", "min", "mean", "stddev");
+  if(!filter || strcmp(filter, "core") == 0){
+    for(size_t i = 0; i < sizeof(bench_op_classes)/sizeof(bench_op_classes[0]); ++i){
+      Bench_core_class(&bench_op_classes[i], reps, iters);
+    }
+  }
+  if(!filter || strcmp(filter, "memory") == 0) Bench_memory(reps, iters);
+  if(!filter || strcmp(filter, "machine") == 0) Bench_machine(reps, iters);
+  if(!filter || strcmp(filter, "serial") == 0) Bench_serial(reps, iters);
+  if(!filter || strcmp(filter, "bus") == 0) Bench_bus(reps, iters);
+  return 0;
+}
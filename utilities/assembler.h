@@ -0,0 +1,1782 @@
+#ifndef ADR8_ASSEMBLER_H
+#define ADR8_ASSEMBLER_H
+
+#include "../ADR8.h"
+#include "da.h"
+#include "mnemonics.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The ADR8 assembler as a library. Programs are assembled from files or from
+// memory and errors are returned as diagnostics instead of ending the process.
+// Every call keeps its state to itself, so several programs can be assembled
+// at the same time from different threads.
+
+typedef enum{
+  AssemblerDiagnosticLevel_ERROR = 0,
+  AssemblerDiagnosticLevel_NOTE,
+} AssemblerDiagnosticLevel;
+
+typedef struct{
+  AssemblerDiagnosticLevel level;
+  char* file;    // input the diagnostic is about, NULL if none
+  size_t line;   // 0 if not about a specific line
+  char* message;
+} AssemblerDiagnostic;
+
+DA_def(AssemblerDiagnostic);
+DA_def(uint8_t);
+
+typedef struct{
+  bool compile_only;      // only write object files, don't link
+  bool optimize;          // run the peephole optimizer before linking
+  bool size_header;       // prefix the program with its size for the bootstrapper
+  const char* object_dir; // where object files are written and reused from
+  size_t threads;         // worker threads, 0 for one per host core
+  FILE* map;              // receives the address of every label, if set
+} AssemblerOptions;
+
+typedef struct{
+  const char* path;   // file to assemble, or the name of an in-memory source
+  const char* source; // source in memory, NULL to read the file at path
+  size_t size;
+} AssemblerInput;
+
+// assembles and links the inputs in order, appending the program to program
+// and any diagnostics to diagnostics, returns false if there were errors
+bool Assembler_assemble(AssemblerOptions* options, AssemblerInput* inputs, size_t input_count,
+    DA_uint8_t* program, DA_AssemblerDiagnostic* diagnostics);
+// assembles a single source in memory into out, out_size is set to the size
+// of the program even if it doesn't fit into capacity
+bool Assembler_assemble_buffer(const char* source, size_t size, uint8_t* out, size_t capacity,
+    size_t* out_size, DA_AssemblerDiagnostic* diagnostics);
+
+size_t AssemblerDiagnostics_errors(DA_AssemblerDiagnostic* diagnostics);
+void AssemblerDiagnostics_print(DA_AssemblerDiagnostic* diagnostics);
+void AssemblerDiagnostics_free(DA_AssemblerDiagnostic* diagnostics);
+
+#ifdef ADR8_IMPLEMENTATION
+
+void AssemblerDiagnostics_vadd(DA_AssemblerDiagnostic* diagnostics, AssemblerDiagnosticLevel level,
+    const char* file, size_t line, const char* format, va_list args){
+  va_list size_args;
+  va_copy(size_args, args);
+  int len = vsnprintf(NULL, 0, format, size_args);
+  va_end(size_args);
+  AssemblerDiagnostic diagnostic = {
+    .level = level,
+    .file = file ? strdup(file) : NULL,
+    .line = line,
+    .message = malloc(len + 1),
+  };
+  assert(diagnostic.message && (!file || diagnostic.file));
+  vsnprintf(diagnostic.message, len + 1, format, args);
+  DA_append(diagnostics, diagnostic);
+}
+
+void AssemblerDiagnostics_add(DA_AssemblerDiagnostic* diagnostics, AssemblerDiagnosticLevel level,
+    const char* file, size_t line, const char* format, ...){
+  va_list args;
+  va_start(args, format);
+  AssemblerDiagnostics_vadd(diagnostics, level, file, line, format, args);
+  va_end(args);
+}
+
+size_t AssemblerDiagnostics_errors(DA_AssemblerDiagnostic* diagnostics){
+  size_t errors = 0;
+  DA_foreach(diagnostics, AssemblerDiagnostic*, diagnostic){
+    if(diagnostic->level == AssemblerDiagnosticLevel_ERROR) errors++;
+  }
+  return errors;
+}
+
+void AssemblerDiagnostics_print(DA_AssemblerDiagnostic* diagnostics){
+  DA_foreach(diagnostics, AssemblerDiagnostic*, d){
+    if(d->level == AssemblerDiagnosticLevel_ERROR){
+      if(d->file && d->line) ADR8_ERROR_LOG("%s:%lu: %s\n", d->file, d->line, d->message);
+      else if(d->file) ADR8_ERROR_LOG("%s: %s\n", d->file, d->message);
+      else ADR8_ERROR_LOG("%s\n", d->message);
+    }else{
+      if(d->file) ADR8_LOG_PRINTF("%s: %s\n", d->file, d->message);
+      else ADR8_LOG_PRINTF("%s\n", d->message);
+    }
+  }
+}
+
+void AssemblerDiagnostics_free(DA_AssemblerDiagnostic* diagnostics){
+  DA_foreach(diagnostics, AssemblerDiagnostic*, diagnostic){
+    free(diagnostic->file);
+    free(diagnostic->message);
+  }
+  DA_free(*diagnostics);
+  memset(diagnostics, 0, sizeof(DA_AssemblerDiagnostic));
+}
+
+typedef enum{
+  TokenType_UNKNOWN = 0,
+  TokenType_WHITESPACE,
+  TokenType_NEWLINE,
+  TokenType_LABEL,
+  TokenType_INSTRUCTION,
+  TokenType_HEXNUMBER,
+  TokenType_DECNUMBER,
+  TokenType_STRING,
+  TokenType_COMMENT,
+  TokenType_DIRECTIVE,
+  TokenType_OPERATOR,
+} TokenType;
+
+typedef struct{
+  TokenType type;
+  const char* text; // slice into the mapped source file, not null terminated
+  size_t len;
+  size_t line;
+} Token;
+
+// tokenizes a memory mapped source file or a source in memory without
+// copying, tokens are slices into the source so it must stay open as long as
+// tokens are in use
+typedef struct{
+  const char* path;
+  const char* data;
+  size_t size;
+  const char* cur;
+  size_t line;
+  bool mapped; // data is a mapping owned by the tokenizer
+} Tokenizer;
+
+void Tokenizer_open_buffer(Tokenizer* tokenizer, const char* path, const char* data, size_t size){
+  memset(tokenizer, 0, sizeof(Tokenizer));
+  tokenizer->path = path;
+  tokenizer->line = 1;
+  tokenizer->data = tokenizer->cur = data;
+  tokenizer->size = size;
+}
+
+bool Tokenizer_open(Tokenizer* tokenizer, const char* path){
+  memset(tokenizer, 0, sizeof(Tokenizer));
+  tokenizer->path = path;
+  tokenizer->line = 1;
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) return false;
+  struct stat st;
+  if(fstat(fd, &st) < 0){
+    close(fd);
+    return false;
+  }
+  tokenizer->size = st.st_size;
+  if(tokenizer->size > 0){
+    void* data = mmap(NULL, tokenizer->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED){
+      close(fd);
+      return false;
+    }
+    madvise(data, tokenizer->size, MADV_SEQUENTIAL);
+    tokenizer->data = data;
+    tokenizer->mapped = true;
+  }
+  close(fd);
+  tokenizer->cur = tokenizer->data;
+  return true;
+}
+
+void Tokenizer_close(Tokenizer* tokenizer){
+  if(tokenizer->mapped) munmap((void*)tokenizer->data, tokenizer->size);
+  tokenizer->mapped = false;
+  tokenizer->data = tokenizer->cur = NULL;
+  tokenizer->size = 0;
+}
+
+bool Tokenizer_is_nl(char c){
+  return c == '\n';
+}
+
+bool Tokenizer_is_ws(char c){
+  return c == ' ' || c == '\t'; 
+}
+
+bool Tokenizer_is_digit(char c){
+  return c >= '0' && c <= '9';
+}
+
+bool Tokenizer_is_hexdigit(char c){
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool Tokenizer_is_letter(char c){
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+TokenType Tokenizer_identify_tokentype(char c){
+  if(Tokenizer_is_ws(c)){
+    return TokenType_WHITESPACE;
+  }else if(Tokenizer_is_digit(c)){
+    return TokenType_DECNUMBER;
+  }else if(Tokenizer_is_letter(c)){
+    return TokenType_INSTRUCTION;
+  }else if(c == '.'){
+    return TokenType_DIRECTIVE;
+  }else if(c == '/'){
+    return TokenType_COMMENT;
+  }else if(strchr("+-*&|()<>,", c)){
+    return TokenType_OPERATOR;
+  }else if(c == '"'){
+    return TokenType_STRING;
+  }else if(Tokenizer_is_nl(c)){
+    return TokenType_NEWLINE;
+  }else{
+    return TokenType_UNKNOWN;
+  }
+}
+
+// returns -1 for unsupported escape codes
+int Tokenizer_resolve_escape_code(char c){
+  switch (c) {
+    case '\\': return '\\';
+    case 'n': return '\n';
+    case '0': return '\0';
+    case 'r': return '\r';
+    case 't': return '\t';
+    default: return -1;
+  }
+}
+
+// returns false once the end of the file is reached
+bool Tokenizer_consume(Tokenizer* tokenizer, Token* token){
+  const char* end = tokenizer->data + tokenizer->size;
+  const char* c = tokenizer->cur;
+  if(c >= end) return false;
+
+  token->text = c;
+  token->line = tokenizer->line;
+  token->type = Tokenizer_identify_tokentype(*c);
+  switch(token->type){
+    case TokenType_LABEL:
+    case TokenType_INSTRUCTION:
+      while(c < end && (Tokenizer_is_letter(*c) || Tokenizer_is_digit(*c) || *c == '_')) c++;
+      if(c < end && *c == ':'){
+        token->type = TokenType_LABEL;
+        c++;
+      }
+      break;
+    case TokenType_DECNUMBER:
+      c++;
+      if(c < end && *c == 'x'){
+        token->type = TokenType_HEXNUMBER;
+        c++;
+        while(c < end && Tokenizer_is_hexdigit(*c)) c++;
+      }else{
+        while(c < end && Tokenizer_is_digit(*c)) c++;
+      }
+      break;
+    case TokenType_HEXNUMBER:
+      assert(false && "unreachable");
+      break;
+    case TokenType_WHITESPACE:
+      while(c < end && Tokenizer_is_ws(*c)) c++;
+      break;
+    case TokenType_STRING:
+      c++;
+      while(c < end && *c != '"'){
+        if(*c == '\\') c++;
+        if(c < end && Tokenizer_is_nl(*c)) tokenizer->line++;
+        c++;
+      }
+      if(c >= end){
+        token->type = TokenType_UNKNOWN; // unterminated string
+        break;
+      }
+      c++;
+      break;
+    case TokenType_NEWLINE:
+      tokenizer->line++;
+      c++;
+      break;
+    case TokenType_DIRECTIVE:
+      c++;
+      while(c < end && Tokenizer_is_letter(*c)) c++;
+      if(c - token->text == 1) token->type = TokenType_UNKNOWN;
+      break;
+    case TokenType_COMMENT:
+      if(c+1 < end && c[1] != '/'){
+        // a single '/' is the division operator
+        token->type = TokenType_OPERATOR;
+        c++;
+        break;
+      }
+      c = memchr(c, '\n', end - c);
+      if(!c) c = end;
+      break;
+    case TokenType_OPERATOR:
+      if((*c == '<' || *c == '>') && (c+1 >= end || c[1] != *c)){
+        token->type = TokenType_UNKNOWN; // only shifts use '<' and '>'
+      }
+      c += (*c == '<' || *c == '>') && token->type == TokenType_OPERATOR ? 2 : 1;
+      break;
+    case TokenType_UNKNOWN:
+      c++;
+      break;
+  }
+  token->len = c - token->text;
+  tokenizer->cur = c;
+  ADR8_DEBUG_LOG("token %d: '%.*s'\n",token->type,(int)token->len,token->text);
+  return true;
+}
+
+// parses the digits of a number token, the caller guarantees they are valid
+uint32_t Tokenizer_parse_number(const char* text, size_t len, uint32_t base){
+  uint32_t n = 0;
+  for(size_t i = 0; i < len; ++i){
+    char c = text[i];
+    uint32_t digit = Tokenizer_is_digit(c) ? c - '0' : (c | 0x20) - 'a' + 10;
+    n = n*base + digit;
+  }
+  return n;
+}
+
+int Assembler_encode_instruction(Token* token){
+  if(token->len > sizeof(uint32_t)) return -1;
+  uint32_t key = 0;
+  for(size_t i = 0; i < token->len; ++i){
+    key |= (uint32_t)(uint8_t)token->text[i] << (8*i);
+  }
+  const MnemonicEntry* entry = &MnemonicTable[MNEMONIC_HASH(key)];
+  if(entry->key != key) return -1;
+  return entry->opcode;
+}
+
+typedef struct{
+  const char* name; // slice into the mapped source file
+  size_t name_len;
+  uint32_t loc;  // section offset, or address once the sections are laid out
+  bool absolute; // loc is a 16 bit constant (.equ) instead of a section offset
+  size_t line;
+  const char* file;
+} Label;
+
+DA_def(Label);
+DA_def(char);
+
+typedef enum{
+  RelocationKind_ABS16 = 0, // little endian dword holding the symbol address
+  RelocationKind_REL8,      // signed word offset relative to the next instruction
+  RelocationKind_LO8,       // lower word of the symbol address
+  RelocationKind_HI8,       // higher word of the symbol address
+} RelocationKind;
+
+// the relocation is the operand directly following an instruction
+#define RELOCATION_FLAG_OPERAND 0x1
+// a literal offset of a relative jump instead of a symbol, the addend holds
+// the offset so the optimizer can adjust it when it removes bytes it spans
+#define RELOCATION_FLAG_LITERAL 0x2
+
+// a reference to a symbol that is patched once the symbol address is known
+typedef struct{
+  RelocationKind kind;
+  uint32_t flags;
+  uint32_t offset;
+  int32_t addend;   // added to the symbol address
+  const char* name; // slice into the mapped source or loaded object
+  size_t name_len;
+  size_t line;
+  const char* file;
+} Relocation;
+
+DA_def(Relocation);
+
+// open addressing hash table of label definitions, slots hold index+1 into
+// the definitions array and 0 when empty
+typedef struct{
+  size_t* slots;
+  size_t capacity;
+  size_t count;
+} LabelMap;
+
+uint64_t LabelMap_hash(const char* name, size_t len){
+  uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+  for(size_t i = 0; i < len; ++i){
+    hash ^= (uint8_t)name[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+bool Label_name_equals(Label* label, const char* name, size_t len){
+  return label->name_len == len && memcmp(label->name, name, len) == 0;
+}
+
+size_t* LabelMap_find_slot(LabelMap* map, DA_Label* definitions, const char* name, size_t len){
+  size_t mask = map->capacity - 1;
+  size_t i = LabelMap_hash(name, len) & mask;
+  while(map->slots[i] && !Label_name_equals(&definitions->items[map->slots[i]-1], name, len)){
+    i = (i + 1) & mask;
+  }
+  return &map->slots[i];
+}
+
+void LabelMap_grow(LabelMap* map, DA_Label* definitions){
+  size_t* old_slots = map->slots;
+  size_t old_capacity = map->capacity;
+  map->capacity = map->capacity ? map->capacity*2 : 64;
+  map->slots = calloc(map->capacity, sizeof(size_t));
+  assert(map->slots && "Buy more RAM lol");
+  for(size_t i = 0; i < old_capacity; ++i){
+    if(old_slots[i]){
+      Label* label = &definitions->items[old_slots[i]-1];
+      *LabelMap_find_slot(map, definitions, label->name, label->name_len) = old_slots[i];
+    }
+  }
+  free(old_slots);
+}
+
+// later definitions of the same name replace earlier ones
+void LabelMap_put(LabelMap* map, DA_Label* definitions, size_t index){
+  if((map->count+1)*2 > map->capacity) LabelMap_grow(map, definitions);
+  Label* label = &definitions->items[index];
+  size_t* slot = LabelMap_find_slot(map, definitions, label->name, label->name_len);
+  if(!*slot) map->count++;
+  *slot = index+1;
+}
+
+Label* LabelMap_get(LabelMap* map, DA_Label* definitions, const char* name, size_t len){
+  if(!map->capacity) return NULL;
+  size_t* slot = LabelMap_find_slot(map, definitions, name, len);
+  return *slot ? &definitions->items[*slot-1] : NULL;
+}
+
+#define BOOTSTRAPPER_PATH "utilities/bootstrapper.asm"
+
+// diagnostics of a section after which it is no longer assembled
+#define ASSEMBLER_MAX_ERRORS 32
+
+// a single input file assembled on its own, label locations and relocation
+// offsets are relative to the start of the section until it is placed by
+// Assembler_link
+typedef struct{
+  const char* path;        // source file of the section
+  const char* source;      // source in memory, NULL to read the file at path
+  size_t source_size;
+  char* object_path;       // object file written for the section, if any
+  uint64_t source_hash;    // of the source and the options it is built with
+  Tokenizer tokenizer;
+  uint8_t* object;         // loaded object file, names point into it
+  char* object_source;     // source path stored in the loaded object file
+  DA_uint8_t bytes;
+  DA_Label label_definitions;
+  DA_Relocation relocations;
+  uint32_t base;
+  DA_AssemblerDiagnostic diagnostics; // collected while the section is built
+  size_t errors;
+} Section;
+
+DA_def(Section);
+
+void Section_error(Section* section, size_t line, const char* format, ...){
+  va_list args;
+  va_start(args, format);
+  AssemblerDiagnostics_vadd(&section->diagnostics, AssemblerDiagnosticLevel_ERROR, section->path, line, format, args);
+  va_end(args);
+  section->errors++;
+}
+
+void Section_free(Section* section){
+  Tokenizer_close(&section->tokenizer);
+  free(section->object);
+  free(section->object_source);
+  free(section->object_path);
+  DA_free(section->bytes);
+  DA_free(section->label_definitions);
+  DA_free(section->relocations);
+  DA_free(section->diagnostics);
+}
+
+// object files
+//
+// all integers are little endian u32 unless noted otherwise
+//   header:      magic "ADR8OBJ\0", version, hash of the source and the
+//                options (u64), source path (offset, len), byte count,
+//                symbol count, relocation count, string table size
+//   bytes:       the assembled bytes of the section
+//   symbols:     name (offset, len), value, flags, line
+//   relocations: kind, flags, offset, addend, name (offset, len), line
+//   strings:     names and the source path referenced by offset into here
+
+#define OBJECT_MAGIC "ADR8OBJ"
+#define OBJECT_VERSION 4
+#define OBJECT_SYMBOL_ABSOLUTE 0x1
+#define OBJECT_EXTENSION ".o8"
+#define OBJECT_HEADER_SIZE (8 + 4 + 8 + 4*6)
+
+// the options are hashed along with the source, so an object is only reused
+// by a build with the same options as the one that wrote it
+uint64_t Object_hash(AssemblerOptions* options, const char* data, size_t size){
+  uint64_t hash = LabelMap_hash(data, size);
+  uint8_t flags = options->optimize | options->size_header << 1;
+  hash ^= flags;
+  hash *= 0x100000001b3ull;
+  return hash;
+}
+
+bool Object_is_object_path(const char* path){
+  size_t len = strlen(path);
+  size_t ext_len = strlen(OBJECT_EXTENSION);
+  return len > ext_len && strcmp(path + len - ext_len, OBJECT_EXTENSION) == 0;
+}
+
+// object files in a directory are named after the mangled source path,
+// otherwise they are placed next to the source
+char* Object_path_for(const char* source_path, const char* object_dir){
+  size_t len = strlen(source_path);
+  char* path = malloc((object_dir ? strlen(object_dir) + 1 : 0) + len + sizeof(OBJECT_EXTENSION));
+  assert(path);
+  if(object_dir){
+    sprintf(path, "%s/%s" OBJECT_EXTENSION, object_dir, source_path);
+    for(char* c = path + strlen(object_dir) + 1; *c; ++c){
+      if(*c == '/') *c = '_';
+    }
+  }else{
+    const char* ext = strrchr(source_path, '.');
+    if(!ext || strchr(ext, '/')) ext = source_path + len;
+    sprintf(path, "%.*s" OBJECT_EXTENSION, (int)(ext - source_path), source_path);
+  }
+  return path;
+}
+
+void Object_put_u32(DA_uint8_t* out, uint32_t n){
+  for(int i = 0; i < 4; ++i) DA_append(out, (n >> (8*i)) & 0xFF);
+}
+
+uint32_t Object_get_u32(const uint8_t* in){
+  return in[0] | in[1] << 8 | in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+uint32_t Object_put_string(DA_char* strings, const char* str, size_t len){
+  uint32_t offset = DA_len(strings);
+  DA_append_many(strings, str, len);
+  return offset;
+}
+
+// returns false and sets errno if the file couldn't be written
+bool Object_write(Section* section, const char* path){
+  DA_uint8_t out = {0};
+  DA_char strings = {0};
+  uint32_t path_offset = Object_put_string(&strings, section->path, strlen(section->path));
+
+  DA_append_many(&out, OBJECT_MAGIC, sizeof(OBJECT_MAGIC));
+  Object_put_u32(&out, OBJECT_VERSION);
+  Object_put_u32(&out, section->source_hash & 0xFFFFFFFF);
+  Object_put_u32(&out, section->source_hash >> 32);
+  Object_put_u32(&out, path_offset);
+  Object_put_u32(&out, strlen(section->path));
+  Object_put_u32(&out, DA_len(&section->bytes));
+  Object_put_u32(&out, DA_len(&section->label_definitions));
+  Object_put_u32(&out, DA_len(&section->relocations));
+  size_t strings_size_at = DA_len(&out);
+  Object_put_u32(&out, 0); // string table size, patched below
+
+  DA_append_many(&out, section->bytes.items, DA_len(&section->bytes));
+  DA_foreach(&section->label_definitions, Label*, label){
+    Object_put_u32(&out, Object_put_string(&strings, label->name, label->name_len));
+    Object_put_u32(&out, label->name_len);
+    Object_put_u32(&out, label->loc);
+    Object_put_u32(&out, label->absolute ? OBJECT_SYMBOL_ABSOLUTE : 0);
+    Object_put_u32(&out, label->line);
+  }
+  DA_foreach(&section->relocations, Relocation*, reloc){
+    Object_put_u32(&out, reloc->kind);
+    Object_put_u32(&out, reloc->flags);
+    Object_put_u32(&out, reloc->offset);
+    Object_put_u32(&out, reloc->addend);
+    Object_put_u32(&out, Object_put_string(&strings, reloc->name, reloc->name_len));
+    Object_put_u32(&out, reloc->name_len);
+    Object_put_u32(&out, reloc->line);
+  }
+  for(int i = 0; i < 4; ++i) out.items[strings_size_at+i] = (DA_len(&strings) >> (8*i)) & 0xFF;
+  DA_append_many(&out, strings.items, DA_len(&strings));
+
+  FILE* file = fopen(path, "wb");
+  bool ok = file && fwrite(out.items, 1, DA_len(&out), file) == DA_len(&out);
+  if(file && fclose(file) != 0) ok = false;
+  DA_free(out);
+  DA_free(strings);
+  return ok;
+}
+
+// loads an object file into the section, fails without side effects if the
+// file is missing, has another version or (when check_hash is set) is for
+// another source, malformed object files are reported as errors
+bool Object_load(Section* section, const char* path, bool check_hash, uint64_t source_hash){
+  FILE* file = fopen(path, "rb");
+  if(!file) return false;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if(size < OBJECT_HEADER_SIZE){
+    fclose(file);
+    return false;
+  }
+  uint8_t* data = malloc(size);
+  assert(data);
+  bool ok = fread(data, 1, size, file) == (size_t)size;
+  fclose(file);
+
+  ok = ok && memcmp(data, OBJECT_MAGIC, sizeof(OBJECT_MAGIC)) == 0;
+  ok = ok && Object_get_u32(data + 8) == OBJECT_VERSION;
+  uint64_t hash = Object_get_u32(data + 12) | (uint64_t)Object_get_u32(data + 16) << 32;
+  ok = ok && (!check_hash || hash == source_hash);
+  uint32_t path_offset = Object_get_u32(data + 20);
+  uint32_t path_len = Object_get_u32(data + 24);
+  uint64_t byte_count = Object_get_u32(data + 28);
+  uint64_t symbol_count = Object_get_u32(data + 32);
+  uint64_t reloc_count = Object_get_u32(data + 36);
+  uint64_t strings_size = Object_get_u32(data + 40);
+  uint64_t strings_at = OBJECT_HEADER_SIZE + byte_count + symbol_count*20 + reloc_count*28;
+  ok = ok && strings_at + strings_size == (uint64_t)size;
+  ok = ok && (uint64_t)path_offset + path_len <= strings_size;
+  if(!ok){
+    free(data);
+    return false;
+  }
+
+  const char* strings = (const char*)data + strings_at;
+  const uint8_t* at = data + OBJECT_HEADER_SIZE;
+  // the path is stored without terminator, it is copied out to terminate it
+  char* source_path = malloc(path_len + 1);
+  assert(source_path);
+  memcpy(source_path, strings + path_offset, path_len);
+  source_path[path_len] = '\0';
+
+  DA_uint8_t bytes = {0};
+  DA_Label label_definitions = {0};
+  DA_Relocation relocations = {0};
+  DA_append_many(&bytes, at, byte_count);
+  at += byte_count;
+  for(uint64_t i = 0; ok && i < symbol_count; ++i, at += 20){
+    Label label = {
+      .name = strings + Object_get_u32(at),
+      .name_len = Object_get_u32(at + 4),
+      .loc = Object_get_u32(at + 8),
+      .absolute = Object_get_u32(at + 12) & OBJECT_SYMBOL_ABSOLUTE,
+      .line = Object_get_u32(at + 16),
+      .file = source_path,
+    };
+    ok = (uint64_t)Object_get_u32(at) + label.name_len <= strings_size;
+    DA_append(&label_definitions, label);
+  }
+  for(uint64_t i = 0; ok && i < reloc_count; ++i, at += 28){
+    Relocation reloc = {
+      .kind = Object_get_u32(at),
+      .flags = Object_get_u32(at + 4),
+      .offset = Object_get_u32(at + 8),
+      .addend = (int32_t)Object_get_u32(at + 12),
+      .name = strings + Object_get_u32(at + 16),
+      .name_len = Object_get_u32(at + 20),
+      .line = Object_get_u32(at + 24),
+      .file = source_path,
+    };
+    size_t size = reloc.kind == RelocationKind_ABS16 ? 2 : 1;
+    ok = reloc.kind <= RelocationKind_HI8 && reloc.offset + size <= byte_count
+      && (uint64_t)Object_get_u32(at + 16) + reloc.name_len <= strings_size;
+    DA_append(&relocations, reloc);
+  }
+  if(!ok){
+    Section_error(section, 0, "malformed object file '%s'", path);
+    DA_free(bytes);
+    DA_free(label_definitions);
+    DA_free(relocations);
+    free(source_path);
+    free(data);
+    return false;
+  }
+
+  section->path = section->object_source = source_path;
+  section->source_hash = hash;
+  section->object = data;
+  section->bytes = bytes;
+  section->label_definitions = label_definitions;
+  section->relocations = relocations;
+  return true;
+}
+
+DA_def(Token);
+
+typedef struct{
+  Token name;
+  DA_Token params;
+  Token* body; // tokens between .macro and .endm
+  size_t body_len;
+} Macro;
+
+DA_def(Macro);
+
+// parameters of the macro being expanded, bound to their argument tokens
+typedef struct{
+  Macro* macro;
+  DA_Token* args; // one list of tokens per parameter
+} MacroEnv;
+
+// state of a section while it is being assembled
+typedef struct{
+  Section* section;
+  DA_Token tokens;
+  DA_Label constants;  // .equ definitions visible in this file
+  LabelMap constant_map;
+  LabelMap label_map;  // section labels defined so far, indexes label_definitions
+  DA_Macro macros;
+  size_t instruction_end; // offset right after the last instruction
+  int depth; // macro and .rept nesting
+  bool aborted; // stop assembling, set after too many errors
+} AssemblerContext;
+
+#define ASSEMBLER_MAX_DEPTH 64
+
+void Assembler_error(AssemblerContext* ctx, Token* token, const char* message){
+  if(ctx->aborted) return;
+  Section_error(ctx->section, token->line, "%s '%.*s'", message, (int)token->len, token->text);
+  if(ctx->section->errors >= ASSEMBLER_MAX_ERRORS){
+    Section_error(ctx->section, token->line, "too many errors, giving up");
+    ctx->aborted = true;
+  }
+}
+
+bool Token_is(Token* token, const char* text){
+  return token->len == strlen(text) && memcmp(token->text, text, token->len) == 0;
+}
+
+bool Token_is_blank(Token* token){
+  return token->type == TokenType_WHITESPACE || token->type == TokenType_COMMENT;
+}
+
+// a '-' directly followed by a decimal number is a negative number outside
+// of expressions, such as a relative jump offset
+bool Token_is_negative_number(Token* minus, Token* number){
+  return Token_is(minus, "-") && number->type == TokenType_DECNUMBER && number->text == minus->text + 1;
+}
+
+// constant expressions
+//
+// expressions are evaluated at assembly time, they may refer to .equ
+// constants and to at most one label, as in LABEL+N, which is resolved by a
+// relocation during linking. Operator precedence follows C.
+
+typedef struct{
+  int32_t value;
+  Token* symbol; // label the value is relative to, NULL for constants
+} ExprValue;
+
+typedef struct{
+  AssemblerContext* ctx;
+  Token* tokens;
+  size_t count;
+  size_t pos;
+  bool failed;      // only the first error of an expression is reported
+} ExprParser;
+
+ExprValue Expr_parse(ExprParser* p, int precedence);
+
+void Expr_error(ExprParser* p, Token* token, const char* message){
+  if(!p->failed) Assembler_error(p->ctx, token, message);
+  p->failed = true;
+}
+
+Token* Expr_peek(ExprParser* p){
+  while(p->pos < p->count && Token_is_blank(&p->tokens[p->pos])) p->pos++;
+  return p->pos < p->count ? &p->tokens[p->pos] : NULL;
+}
+
+// returns NULL after reporting the missing token
+Token* Expr_expect(ExprParser* p, Token* after){
+  Token* token = Expr_peek(p);
+  if(!token) Expr_error(p, after, "unexpected end of expression after");
+  return token;
+}
+
+ExprValue Expr_primary(ExprParser* p, Token* after){
+  ExprValue v = {0};
+  Token* token = Expr_expect(p, after);
+  if(!token) return v;
+  switch(token->type){
+    case TokenType_DECNUMBER:
+      p->pos++;
+      v.value = Tokenizer_parse_number(token->text, token->len, 10);
+      return v;
+    case TokenType_HEXNUMBER:
+      p->pos++;
+      if(token->len < 3) Expr_error(p, token, "invalid hex number");
+      else v.value = Tokenizer_parse_number(token->text+2, token->len-2, 16);
+      return v;
+    case TokenType_INSTRUCTION:{
+      p->pos++;
+      Label* constant = LabelMap_get(&p->ctx->constant_map, &p->ctx->constants, token->text, token->len);
+      if(constant){
+        v.value = constant->loc;
+      }else{
+        v.symbol = token;
+      }
+      return v;
+    }
+    case TokenType_OPERATOR:
+      if(Token_is(token, "(")){
+        p->pos++;
+        v = Expr_parse(p, 0);
+        Token* close = Expr_expect(p, token);
+        if(close && !Token_is(close, ")")) Expr_error(p, close, "expected ')' but got");
+        else if(close) p->pos++;
+        return v;
+      }
+      if(Token_is(token, "-")){
+        p->pos++;
+        ExprValue operand = Expr_primary(p, token);
+        if(operand.symbol) Expr_error(p, token, "cannot negate label");
+        v.value = -operand.value;
+        return v;
+      }
+      break;
+    default: break;
+  }
+  Expr_error(p, token, "unexpected token in expression");
+  p->pos++;
+  return v;
+}
+
+int Expr_precedence(Token* token){
+  if(token->type != TokenType_OPERATOR) return -1;
+  if(Token_is(token, "|")) return 1;
+  if(Token_is(token, "&")) return 2;
+  if(Token_is(token, "<<") || Token_is(token, ">>")) return 3;
+  if(Token_is(token, "+") || Token_is(token, "-")) return 4;
+  if(Token_is(token, "*") || Token_is(token, "/")) return 5;
+  return -1;
+}
+
+ExprValue Expr_parse(ExprParser* p, int precedence){
+  ExprValue lhs = Expr_primary(p, p->pos ? &p->tokens[p->pos-1] : &p->tokens[0]);
+  while(!p->failed){
+    Token* op = Expr_peek(p);
+    if(!op) break;
+    int op_precedence = Expr_precedence(op);
+    if(op_precedence < 0 || op_precedence <= precedence) break;
+
+    p->pos++;
+    ExprValue rhs = Expr_parse(p, op_precedence);
+
+    if(Token_is(op, "-")){
+      if(rhs.symbol) Expr_error(p, rhs.symbol, "cannot subtract label");
+      lhs.value -= rhs.value;
+    }else if(Token_is(op, "+")){
+      if(rhs.symbol && lhs.symbol) Expr_error(p, op, "cannot add labels");
+      if(rhs.symbol) lhs.symbol = rhs.symbol;
+      lhs.value += rhs.value;
+    }else{
+      if(lhs.symbol || rhs.symbol) Expr_error(p, lhs.symbol ? lhs.symbol : rhs.symbol, "label used in constant expression");
+      if(Token_is(op, "|")) lhs.value |= rhs.value;
+      else if(Token_is(op, "&")) lhs.value &= rhs.value;
+      else if(Token_is(op, "<<")) lhs.value <<= rhs.value;
+      else if(Token_is(op, ">>")) lhs.value >>= rhs.value;
+      else if(Token_is(op, "*")) lhs.value *= rhs.value;
+      else if(Token_is(op, "/")){
+        if(rhs.value == 0) Expr_error(p, op, "division by zero");
+        else lhs.value /= rhs.value;
+      }
+    }
+  }
+  return lhs;
+}
+
+// evaluates the tokens as a single expression, at is the token the
+// expression belongs to, which errors about missing tokens refer to
+ExprValue Expr_evaluate(AssemblerContext* ctx, Token* at, Token* tokens, size_t count){
+  ExprParser p = {.ctx = ctx, .tokens = tokens, .count = count};
+  ExprValue v = {0};
+  if(!count){
+    Assembler_error(ctx, at, "expected expression after");
+    return v;
+  }
+  v = Expr_parse(&p, 0);
+  Token* rest = Expr_peek(&p);
+  if(rest) Expr_error(&p, rest, "unexpected token after expression");
+  if(p.failed) v.symbol = NULL;
+  return v;
+}
+
+int32_t Expr_evaluate_constant(AssemblerContext* ctx, Token* at, Token* tokens, size_t count){
+  ExprValue v = Expr_evaluate(ctx, at, tokens, count);
+  if(v.symbol){
+    Assembler_error(ctx, v.symbol, "expected constant expression but got label");
+    return 0;
+  }
+  return v.value;
+}
+
+// index of the ')' matching the '(' at tokens[open], the end of the line if
+// the parenthesis is never closed
+size_t Assembler_find_close(AssemblerContext* ctx, Token* tokens, size_t count, size_t open){
+  int level = 0;
+  size_t i = open;
+  for(; i < count && tokens[i].type != TokenType_NEWLINE; ++i){
+    if(tokens[i].type != TokenType_OPERATOR) continue;
+    if(Token_is(&tokens[i], "(")) level++;
+    if(Token_is(&tokens[i], ")") && --level == 0) return i;
+  }
+  Assembler_error(ctx, &tokens[open], "unclosed");
+  return i;
+}
+
+// emits a single word, recording it as a literal relocation when it is the
+// offset of a relative jump
+void Assembler_emit_word(AssemblerContext* ctx, uint8_t word, Token* at){
+  Section* section = ctx->section;
+  size_t offset = DA_len(&section->bytes);
+  uint8_t opcode = offset ? section->bytes.items[offset-1] : 0;
+  if(offset == ctx->instruction_end && opcode >= ADR8_Op_JMPR && opcode <= ADR8_Op_JLTR){
+    Relocation reloc = {
+      .kind = RelocationKind_REL8,
+      .flags = RELOCATION_FLAG_OPERAND | RELOCATION_FLAG_LITERAL,
+      .offset = offset,
+      .addend = (int8_t)word,
+      .line = at->line,
+      .file = section->path,
+    };
+    DA_append(&section->relocations, reloc);
+  }
+  DA_append(&section->bytes, word);
+}
+
+void Assembler_emit_value(AssemblerContext* ctx, ExprValue v, RelocationKind kind, Token* at){
+  Section* section = ctx->section;
+  bool symbol = v.symbol;
+  if(v.symbol){
+    Relocation reloc = {
+      .kind = kind,
+      .offset = DA_len(&section->bytes),
+      .addend = v.value,
+      .name = v.symbol->text,
+      .name_len = v.symbol->len,
+      .line = at->line,
+      .file = section->path,
+    };
+    reloc.flags = reloc.offset == ctx->instruction_end ? RELOCATION_FLAG_OPERAND : 0;
+    DA_append(&section->relocations, reloc);
+    v.value = 0;
+  }
+  switch(kind){
+    case RelocationKind_ABS16:
+      DA_append(&section->bytes, v.value & 0xFF);
+      DA_append(&section->bytes, (v.value & 0xFF00)>>8);
+      break;
+    default:{
+      uint8_t word = kind == RelocationKind_HI8 ? (v.value & 0xFF00)>>8 : v.value & 0xFF;
+      if(symbol) DA_append(&section->bytes, word);
+      else Assembler_emit_word(ctx, word, at);
+    }break;
+  }
+}
+
+void Assembler_define_label(AssemblerContext* ctx, Token* name, uint32_t loc, bool absolute){
+  Label label = {
+    .name = name->text,
+    .name_len = name->len,
+    .loc = absolute ? (uint16_t)loc : loc,
+    .absolute = absolute,
+    .line = name->line,
+    .file = ctx->section->path,
+  };
+  DA_append(&ctx->section->label_definitions, label);
+  LabelMap_put(&ctx->label_map, &ctx->section->label_definitions, DA_len(&ctx->section->label_definitions)-1);
+}
+
+// index of the token closing the block opened at tokens[open] (.macro or
+// .rept), count if the block is never closed
+size_t Assembler_find_block_end(AssemblerContext* ctx, Token* tokens, size_t count, size_t open, const char* begin, const char* end){
+  int level = 0;
+  for(size_t i = open; i < count; ++i){
+    if(tokens[i].type != TokenType_DIRECTIVE) continue;
+    if(Token_is(&tokens[i], begin)) level++;
+    if(Token_is(&tokens[i], end) && --level == 0) return i;
+  }
+  Assembler_error(ctx, &tokens[open], "missing end of block");
+  return count;
+}
+
+Macro* Assembler_find_macro(AssemblerContext* ctx, Token* name){
+  DA_foreach(&ctx->macros, Macro*, macro){
+    if(macro->name.len == name->len && memcmp(macro->name.text, name->text, name->len) == 0) return macro;
+  }
+  return NULL;
+}
+
+DA_Token* MacroEnv_lookup(MacroEnv* env, Token* token){
+  if(!env || token->type != TokenType_INSTRUCTION) return NULL;
+  for(size_t i = 0; i < DA_len(&env->macro->params); ++i){
+    Token* param = &env->macro->params.items[i];
+    if(param->len == token->len && memcmp(param->text, token->text, token->len) == 0) return &env->args[i];
+  }
+  return NULL;
+}
+
+// appends tokens[from..to) to out with macro parameters substituted
+void Assembler_collect_range(Token* tokens, size_t from, size_t to, MacroEnv* env, DA_Token* out){
+  for(size_t i = from; i < to; ++i){
+    DA_Token* arg = MacroEnv_lookup(env, &tokens[i]);
+    if(arg){
+      DA_append_many(out, arg->items, DA_len(arg));
+    }else{
+      DA_append(out, tokens[i]);
+    }
+  }
+}
+
+// collects the tokens up to the end of the line with macro parameters
+// substituted and whitespace and comments dropped, i is left on the newline
+void Assembler_collect_line(Token* tokens, size_t count, size_t* i, MacroEnv* env, DA_Token* out){
+  DA_len(out) = 0;
+  for(; *i < count && tokens[*i].type != TokenType_NEWLINE; ++*i){
+    if(Token_is_blank(&tokens[*i])) continue;
+    Assembler_collect_range(tokens, *i, *i + 1, env, out);
+  }
+}
+
+void Assembler_process(AssemblerContext* ctx, Token* tokens, size_t count, MacroEnv* env);
+
+void Assembler_expand_macro(AssemblerContext* ctx, Macro* macro, Token* tokens, size_t count, size_t* i, MacroEnv* env){
+  Token* call = &tokens[*i];
+  DA_Token line = {0};
+  ++*i;
+  Assembler_collect_line(tokens, count, i, env, &line);
+
+  // arguments are single tokens, negative numbers or parenthesized
+  // expressions, optionally separated by commas
+  DA_Token* args = calloc(DA_len(&macro->params) + 1, sizeof(DA_Token));
+  assert(args);
+  size_t arg_count = 0;
+  for(size_t j = 0; j < DA_len(&line); ++j){
+    if(Token_is(&line.items[j], ",")) continue;
+    size_t last = j;
+    if(Token_is(&line.items[j], "(")){
+      last = Assembler_find_close(ctx, line.items, DA_len(&line), j);
+      if(last == DA_len(&line)) last--;
+    }else if(j + 1 < DA_len(&line) && Token_is_negative_number(&line.items[j], &line.items[j+1])){
+      last = j + 1;
+    }
+    if(arg_count < DA_len(&macro->params)){
+      size_t arg_len = last - j + 1;
+      DA_append_many(&args[arg_count], &line.items[j], arg_len);
+    }
+    arg_count++;
+    j = last;
+  }
+
+  if(arg_count != DA_len(&macro->params)){
+    Assembler_error(ctx, call, arg_count < DA_len(&macro->params) ? "too few arguments for macro" : "too many arguments for macro");
+  }else if(ctx->depth >= ASSEMBLER_MAX_DEPTH){
+    // runaway recursion would only repeat the error, stop the section instead
+    Assembler_error(ctx, call, "macro nesting too deep in");
+    ctx->aborted = true;
+  }else{
+    MacroEnv macro_env = {.macro = macro, .args = args};
+    ctx->depth++;
+    Assembler_process(ctx, macro->body, macro->body_len, &macro_env);
+    ctx->depth--;
+  }
+  // the argument tokens are copies, the slices they point to stay mapped
+  for(size_t j = 0; j < DA_len(&macro->params); ++j) DA_free(args[j]);
+  free(args);
+  DA_free(line);
+  --*i; // leave the newline to the caller
+}
+
+void Assembler_directive(AssemblerContext* ctx, Token* tokens, size_t count, size_t* i, MacroEnv* env){
+  Token* directive = &tokens[*i];
+  DA_Token line = {0};
+  if(Token_is(directive, ".equ")){
+    ++*i;
+    Assembler_collect_line(tokens, count, i, env, &line);
+    --*i;
+    if(DA_len(&line) < 2 || line.items[0].type != TokenType_INSTRUCTION){
+      Assembler_error(ctx, directive, "expected name and value after");
+      DA_free(line);
+      return;
+    }
+    Token* name = &line.items[0];
+    ExprValue v = Expr_evaluate(ctx, name, line.items + 1, DA_len(&line) - 1);
+    if(v.symbol){
+      // a label relative value is only known when its label is already placed
+      Label* label = LabelMap_get(&ctx->label_map, &ctx->section->label_definitions, v.symbol->text, v.symbol->len);
+      if(!label){
+        Assembler_error(ctx, v.symbol, ".equ must refer to a label defined earlier in the same file, got");
+      }else{
+        Assembler_define_label(ctx, name, label->loc + v.value, label->absolute);
+      }
+    }else{
+      Label constant = {.name = name->text, .name_len = name->len, .loc = (uint16_t)v.value, .absolute = true, .line = name->line, .file = ctx->section->path};
+      DA_append(&ctx->constants, constant);
+      LabelMap_put(&ctx->constant_map, &ctx->constants, DA_len(&ctx->constants)-1);
+      // also exported so other files can use the constant as a label
+      Assembler_define_label(ctx, name, v.value, true);
+    }
+  }else if(Token_is(directive, ".macro")){
+    size_t end = Assembler_find_block_end(ctx, tokens, count, *i, ".macro", ".endm");
+    ++*i;
+    Assembler_collect_line(tokens, count, i, NULL, &line);
+    if(DA_len(&line) < 1 || line.items[0].type != TokenType_INSTRUCTION){
+      Assembler_error(ctx, directive, "expected macro name after");
+    }else if(end < count){
+      Macro macro = {.name = line.items[0], .body = &tokens[*i], .body_len = end - *i};
+      for(size_t j = 1; j < DA_len(&line); ++j){
+        if(Token_is(&line.items[j], ",")) continue;
+        if(line.items[j].type != TokenType_INSTRUCTION) Assembler_error(ctx, &line.items[j], "invalid macro parameter");
+        DA_append(&macro.params, line.items[j]);
+      }
+      DA_append(&ctx->macros, macro);
+    }
+    *i = end;
+  }else if(Token_is(directive, ".rept")){
+    size_t end = Assembler_find_block_end(ctx, tokens, count, *i, ".rept", ".endr");
+    ++*i;
+    Assembler_collect_line(tokens, count, i, env, &line);
+    int32_t n = Expr_evaluate_constant(ctx, directive, line.items, DA_len(&line));
+    if(n < 0){
+      Assembler_error(ctx, directive, "negative repeat count for");
+    }else if(end < count){
+      if(ctx->depth >= ASSEMBLER_MAX_DEPTH){
+        Assembler_error(ctx, directive, "nesting too deep in");
+        ctx->aborted = true;
+        n = 0;
+      }
+      ctx->depth++;
+      for(int32_t r = 0; r < n && !ctx->aborted; ++r){
+        Assembler_process(ctx, &tokens[*i], end - *i, env);
+      }
+      ctx->depth--;
+    }
+    *i = end;
+  }else{
+    Assembler_error(ctx, directive, "unknown directive");
+  }
+  DA_free(line);
+}
+
+// emits a decimal number as a single word, negative numbers are the digits
+// after their '-'
+void Assembler_emit_decimal(AssemblerContext* ctx, Token* digits, bool negative){
+  uint32_t n = Tokenizer_parse_number(digits->text, digits->len, 10);
+  if((negative && n > 128) || (!negative && n > 0xFF)){
+    Token number = {.text = digits->text - negative, .len = digits->len + negative, .line = digits->line};
+    Assembler_error(ctx, &number, "decimal number does not fit in a word, use an expression for dwords:");
+    return;
+  }
+  Assembler_emit_word(ctx, negative ? -n : n, digits);
+}
+
+void Assembler_process(AssemblerContext* ctx, Token* tokens, size_t count, MacroEnv* env){
+  Section* section = ctx->section;
+  for(size_t i = 0; i < count && !ctx->aborted; ++i){
+    Token token = tokens[i];
+    DA_Token* arg = MacroEnv_lookup(env, &token);
+    if(arg){
+      Assembler_process(ctx, arg->items, DA_len(arg), NULL);
+      continue;
+    }
+    switch(token.type){
+      case TokenType_NEWLINE:
+      case TokenType_COMMENT:
+      case TokenType_WHITESPACE:
+        break;
+      case TokenType_DIRECTIVE:
+        Assembler_directive(ctx, tokens, count, &i, env);
+        break;
+      case TokenType_OPERATOR:{
+        if(i + 1 < count && Token_is_negative_number(&token, &tokens[i+1])){
+          Assembler_emit_decimal(ctx, &tokens[++i], true);
+          break;
+        }
+        if(!Token_is(&token, "(")){
+          Assembler_error(ctx, &token, "unexpected operator");
+          break;
+        }
+        // parenthesized expressions are emitted as a dword
+        size_t close = Assembler_find_close(ctx, tokens, count, i);
+        DA_Token expr = {0};
+        Assembler_collect_range(tokens, i + 1, close, env, &expr);
+        Assembler_emit_value(ctx, Expr_evaluate(ctx, &token, expr.items, DA_len(&expr)), RelocationKind_ABS16, &token);
+        DA_free(expr);
+        i = close;
+      }break;
+      case TokenType_INSTRUCTION:{
+        int instruction = Assembler_encode_instruction(&token);
+        if(instruction >= 0){
+          ADR8_DEBUG_LOG("'%.*s' decoded instruction: 0x%02hX\n",(int)token.len,token.text,instruction);
+          DA_append(&section->bytes,instruction);
+          ctx->instruction_end = DA_len(&section->bytes);
+          break;
+        }
+
+        // lo(expr) and hi(expr) emit a single word of a value
+        size_t next = i + 1;
+        if((Token_is(&token, "lo") || Token_is(&token, "hi"))
+            && next < count && Token_is(&tokens[next], "(")){
+          size_t close = Assembler_find_close(ctx, tokens, count, next);
+          DA_Token expr = {0};
+          Assembler_collect_range(tokens, next + 1, close, env, &expr);
+          ExprValue v = Expr_evaluate(ctx, &token, expr.items, DA_len(&expr));
+          Assembler_emit_value(ctx, v, Token_is(&token, "lo") ? RelocationKind_LO8 : RelocationKind_HI8, &token);
+          DA_free(expr);
+          i = close;
+          break;
+        }
+
+        Macro* macro = Assembler_find_macro(ctx, &token);
+        if(macro){
+          Assembler_expand_macro(ctx, macro, tokens, count, &i, env);
+          break;
+        }
+
+        ADR8_DEBUG_LOG("'%.*s' not instruction, assuming label\n",(int)token.len,token.text);
+        ExprValue v = {0};
+        Label* constant = LabelMap_get(&ctx->constant_map, &ctx->constants, token.text, token.len);
+        if(constant){
+          v.value = constant->loc;
+        }else{
+          v.symbol = &tokens[i];
+        }
+        Assembler_emit_value(ctx, v, RelocationKind_ABS16, &token);
+      }break;
+      case TokenType_LABEL:{
+        Token name = token;
+        name.len--; // strip ':'
+        Assembler_define_label(ctx, &name, DA_len(&section->bytes), false);
+      }break;
+      case TokenType_DECNUMBER:
+        Assembler_emit_decimal(ctx, &token, false);
+        break;
+      case TokenType_HEXNUMBER:{
+        if(token.len == 4){
+          uint8_t n = Tokenizer_parse_number(token.text+2, 2, 16);
+          Assembler_emit_word(ctx, n, &token);
+        }else if(token.len == 6){
+          uint16_t n = Tokenizer_parse_number(token.text+2, 4, 16);
+          uint8_t h = (n&0xFF);
+          DA_append(&section->bytes, h);
+          uint8_t l = (n&0xFF00)>>8;
+          DA_append(&section->bytes, l);
+        }else{
+          Assembler_error(ctx, &token, "hex number must be explicitly 8-bit (e.g. 0xFF) or 16-bit (e.g. 0xFFFF), got");
+        }
+      }break;
+      case TokenType_STRING:{
+        for(size_t i = 1; i < token.len-1; ++i){
+          int c = token.text[i];
+          if(c == '\\'){
+            c = Tokenizer_resolve_escape_code(token.text[++i]);
+            if(c < 0){
+              Token escape = {.text = &token.text[i-1], .len = 2, .line = token.line};
+              Assembler_error(ctx, &escape, "unsupported escape code");
+              continue;
+            }
+          }
+          DA_append(&section->bytes, c);
+        }
+        DA_append(&section->bytes, '\0');
+      }break;
+      case TokenType_UNKNOWN:{
+        if(token.text[0] == '"'){
+          Token quote = {.text = token.text, .len = 1, .line = token.line};
+          Assembler_error(ctx, &quote, "unterminated string starting with");
+        }else{
+          Assembler_error(ctx, &token, "invalid token:");
+        }
+      }break;
+    }
+  }
+}
+
+void Assembler_assemble_section(Section* section){
+  AssemblerContext ctx = {.section = section, .instruction_end = SIZE_MAX};
+  Token token;
+  ADR8_DEBUG_LOG("assembling file '%s'\n",section->path);
+  while(Tokenizer_consume(&section->tokenizer, &token)){
+    DA_append(&ctx.tokens, token);
+  }
+  Assembler_process(&ctx, ctx.tokens.items, DA_len(&ctx.tokens), NULL);
+
+  DA_foreach(&ctx.macros, Macro*, macro){
+    DA_free(macro->params);
+  }
+  DA_free(ctx.macros);
+  DA_free(ctx.constants);
+  DA_free(ctx.tokens);
+  free(ctx.constant_map.slots);
+  free(ctx.label_map.slots);
+}
+
+// loads the section from an object file, reuses the section's object file
+// when its source is unchanged, or assembles the source otherwise
+void Assembler_build_section(AssemblerOptions* options, Section* section){
+  if(!section->source && Object_is_object_path(section->path)){
+    if(!Object_load(section, section->path, false, 0) && !section->errors){
+      Section_error(section, 0, "couldn't load object file");
+    }
+    return;
+  }
+
+  if(section->source){
+    Tokenizer_open_buffer(&section->tokenizer, section->path, section->source, section->source_size);
+  }else if(!Tokenizer_open(&section->tokenizer, section->path)){
+    Section_error(section, 0, "couldn't open file: %s", strerror(errno));
+    return;
+  }
+  section->source_hash = Object_hash(options, section->tokenizer.data, section->tokenizer.size);
+  if(options->compile_only || options->object_dir){
+    section->object_path = Object_path_for(section->path, options->object_dir);
+    if(Object_load(section, section->object_path, true, section->source_hash)){
+      ADR8_DEBUG_LOG("'%s' unchanged, reusing '%s'\n",section->path,section->object_path);
+      Tokenizer_close(&section->tokenizer);
+      return;
+    }
+    if(section->errors) return;
+  }
+
+  Assembler_assemble_section(section);
+  if(section->object_path && !section->errors && !Object_write(section, section->object_path)){
+    Section_error(section, 0, "unable to write object file '%s': %s", section->object_path, strerror(errno));
+  }
+}
+
+typedef struct{
+  AssemblerOptions* options;
+  DA_Section* sections;
+  size_t next; // index of the next section to build
+} AssemblerWorkers;
+
+void* Assembler_worker(void* arg){
+  AssemblerWorkers* workers = arg;
+  size_t i;
+  while((i = __atomic_fetch_add(&workers->next, 1, __ATOMIC_RELAXED)) < DA_len(workers->sections)){
+    Assembler_build_section(workers->options, &workers->sections->items[i]);
+  }
+  return NULL;
+}
+
+// lays the sections out in order and collects the label definitions of all
+// sections at their final address
+void Assembler_layout(DA_Section* sections, DA_Label* label_definitions, LabelMap* label_map){
+  DA_len(label_definitions) = 0;
+  label_map->count = 0;
+  if(label_map->slots) memset(label_map->slots, 0, label_map->capacity*sizeof(size_t));
+
+  size_t base = 0;
+  DA_foreach(sections, Section*, section){
+    section->base = base;
+    base += DA_len(&section->bytes);
+    DA_foreach(&section->label_definitions, Label*, label){
+      Label definition = *label;
+      if(!definition.absolute) definition.loc += section->base;
+      DA_append(label_definitions, definition);
+    }
+  }
+  for(size_t i = 0; i < DA_len(label_definitions); ++i){
+    LabelMap_put(label_map, label_definitions, i);
+  }
+}
+
+// returns NULL if the symbol isn't defined in any section
+Label* Assembler_resolve(DA_Label* label_definitions, LabelMap* label_map, Relocation* reloc){
+  return LabelMap_get(label_map, label_definitions, reloc->name, reloc->name_len);
+}
+
+// one line per label with its address, name and definition
+void Assembler_write_map(DA_Label* label_definitions, FILE* map){
+  DA_foreach(label_definitions, Label*, label){
+    if(label->absolute) continue; // .equ constants aren't addresses
+    fprintf(map, "%04X %.*s %s:%lu\n", label->loc, (int)label->name_len, label->name, label->file, label->line);
+  }
+}
+
+// lays the sections out in order and resolves relocations across all of them
+void Assembler_link(AssemblerOptions* options, DA_Section* sections, DA_uint8_t* program, DA_AssemblerDiagnostic* diagnostics){
+  DA_Label label_definitions = {0};
+  LabelMap label_map = {0};
+  Assembler_layout(sections, &label_definitions, &label_map);
+  if(options->map) Assembler_write_map(&label_definitions, options->map);
+
+  DA_foreach(sections, Section*, section){
+    DA_foreach(&section->relocations, Relocation*, reloc){
+      if(reloc->flags & RELOCATION_FLAG_LITERAL){
+        DA_set(&section->bytes, reloc->offset, (uint8_t)reloc->addend);
+        continue;
+      }
+      Label* label = Assembler_resolve(&label_definitions, &label_map, reloc);
+      if(!label){
+        AssemblerDiagnostics_add(diagnostics, AssemblerDiagnosticLevel_ERROR, reloc->file, reloc->line,
+            "unable to resolve symbol '%.*s'", (int)reloc->name_len, reloc->name);
+        continue;
+      }
+      uint16_t address = label->loc + reloc->addend;
+      switch(reloc->kind){
+        case RelocationKind_ABS16:
+          DA_set(&section->bytes, reloc->offset, address & 0xFF);
+          DA_set(&section->bytes, reloc->offset+1, (address & 0xFF00)>>8);
+          break;
+        case RelocationKind_REL8:
+          DA_set(&section->bytes, reloc->offset, (uint8_t)(address - (section->base + reloc->offset + 1)));
+          break;
+        case RelocationKind_LO8:
+          DA_set(&section->bytes, reloc->offset, address & 0xFF);
+          break;
+        case RelocationKind_HI8:
+          DA_set(&section->bytes, reloc->offset, (address & 0xFF00)>>8);
+          break;
+      }
+    }
+    DA_append_many(program, section->bytes.items, DA_len(&section->bytes));
+  }
+  free(label_map.slots);
+  DA_free(label_definitions);
+}
+
+// peephole optimizer
+//
+// rewrites absolute jumps to labels that are within reach of a relative jump
+// into the shorter and faster relative form, relaxing branches iteratively as
+// every rewrite can bring other targets into reach. Only jumps whose operand
+// is a label directly following the instruction are touched, code that jumps
+// to hand written absolute addresses must not be optimized. Relative jumps
+// with literal offsets are adjusted for the bytes removed between them and
+// their target, which must lie in the same file.
+//
+// Before that a word load of the lower half of A or B followed by one of the
+// higher half from the next address is fused into a single dword load, again
+// only when both operands are labels.
+
+typedef struct{
+  const char* name; // function the savings are attributed to
+  size_t name_len;
+  const char* file;
+  size_t relaxed; // jumps
+  size_t fused;   // loads
+  size_t cycles;
+  size_t bytes;
+} OptimizerSavings;
+
+DA_def(OptimizerSavings);
+
+typedef size_t offset_t;
+DA_def(offset_t);
+
+typedef Label* LabelPtr;
+DA_def(LabelPtr);
+
+// number of removed offsets before the given offset, removed is sorted
+size_t Optimizer_removed_before(DA_offset_t* removed, size_t offset){
+  size_t lo = 0, hi = DA_len(removed);
+  while(lo < hi){
+    size_t mid = (lo + hi)/2;
+    if(removed->items[mid] < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// removes the bytes at the sorted offsets from the section in a single pass,
+// moving labels and relocations behind them, relocations of removed bytes
+// are dropped
+void Optimizer_remove_bytes(Section* section, DA_offset_t* removed){
+  size_t out = 0;
+  size_t next = 0;
+  for(size_t i = 0; i < DA_len(&section->bytes); ++i){
+    if(next < DA_len(removed) && removed->items[next] == i){
+      next++;
+      continue;
+    }
+    section->bytes.items[out++] = section->bytes.items[i];
+  }
+  DA_len(&section->bytes) = out;
+  DA_foreach(&section->label_definitions, Label*, label){
+    if(label->absolute) continue; // .equ constants don't move with the code
+    label->loc -= Optimizer_removed_before(removed, label->loc);
+  }
+  size_t kept = 0;
+  DA_foreach(&section->relocations, Relocation*, reloc){
+    size_t before = Optimizer_removed_before(removed, reloc->offset);
+    if(Optimizer_removed_before(removed, reloc->offset + 1) != before) continue;
+    if(reloc->flags & RELOCATION_FLAG_LITERAL){
+      // removed bytes between the jump and its target aren't skipped anymore
+      long next = reloc->offset + 1;
+      long target = next + reloc->addend;
+      reloc->addend -= (long)Optimizer_removed_before(removed, target) - (long)Optimizer_removed_before(removed, next);
+    }
+    reloc->offset -= before;
+    section->relocations.items[kept++] = *reloc;
+  }
+  DA_len(&section->relocations) = kept;
+}
+
+// labels of the same location keep the order they were defined in
+int Optimizer_compare_labels(const void* a, const void* b){
+  const Label* x = *(const LabelPtr*)a;
+  const Label* y = *(const LabelPtr*)b;
+  if(x->loc != y->loc) return (x->loc > y->loc) - (x->loc < y->loc);
+  return (x > y) - (x < y);
+}
+
+// the labels of the section that aren't constants, sorted by location
+void Optimizer_sort_labels(Section* section, DA_LabelPtr* sorted){
+  DA_len(sorted) = 0;
+  DA_foreach(&section->label_definitions, Label*, label){
+    if(!label->absolute) DA_append(sorted, label);
+  }
+  if(DA_len(sorted)) qsort(sorted->items, DA_len(sorted), sizeof(LabelPtr), Optimizer_compare_labels);
+}
+
+// the label a location is attributed to, the closest one at or before it
+Label* Optimizer_function_of(DA_LabelPtr* sorted, size_t offset){
+  size_t lo = 0, hi = DA_len(sorted);
+  while(lo < hi){
+    size_t mid = (lo + hi)/2;
+    if(sorted->items[mid]->loc <= offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo ? sorted->items[lo-1] : NULL;
+}
+
+// adds the cycles and bytes saved at offset to the function it is in, the
+// caller counts the rewrite itself
+OptimizerSavings* Optimizer_count_savings(DA_OptimizerSavings* savings, Section* section, DA_LabelPtr* sorted, size_t offset, size_t cycles, size_t bytes){
+  Label* function = Optimizer_function_of(sorted, offset);
+  const char* name = function ? function->name : "<start>";
+  size_t name_len = function ? function->name_len : strlen("<start>");
+  OptimizerSavings* entry = NULL;
+  DA_foreach(savings, OptimizerSavings*, s){
+    if(s->file == section->path && s->name_len == name_len && memcmp(s->name, name, name_len) == 0) entry = s;
+  }
+  if(!entry){
+    OptimizerSavings new_entry = {.name = name, .name_len = name_len, .file = section->path};
+    DA_append(savings, new_entry);
+    entry = &savings->items[DA_len(savings)-1];
+  }
+  entry->cycles += cycles;
+  entry->bytes += bytes;
+  return entry;
+}
+
+// whether code can get to offset other than from the instruction before it,
+// through a label or a relative jump with a literal offset
+bool Optimizer_is_entry(Section* section, DA_LabelPtr* sorted, size_t offset){
+  Label* label = Optimizer_function_of(sorted, offset);
+  if(label && label->loc == offset) return true;
+  DA_foreach(&section->relocations, Relocation*, reloc){
+    if((reloc->flags & RELOCATION_FLAG_LITERAL) && (long)reloc->offset + 1 + reloc->addend == (long)offset) return true;
+  }
+  return false;
+}
+
+// LDAL n, LDAH n+1 into LDA n and LDBL n, LDBH n+1 into LDB n, both read n
+// first and n+1 second so only the cycles in between change
+void Optimizer_fuse_loads(DA_Section* sections, DA_OptimizerSavings* savings){
+  DA_offset_t removed = {0};
+  DA_LabelPtr sorted = {0};
+  DA_foreach(sections, Section*, section){
+    if(strcmp(section->path, BOOTSTRAPPER_PATH) == 0) continue;
+    DA_len(&removed) = 0;
+    Optimizer_sort_labels(section, &sorted);
+    for(size_t i = 0; i + 1 < DA_len(&section->relocations); ++i){
+      Relocation* low = &section->relocations.items[i];
+      Relocation* high = &section->relocations.items[i+1];
+      if(low->kind != RelocationKind_ABS16 || !(low->flags & RELOCATION_FLAG_OPERAND)) continue;
+      if(high->kind != RelocationKind_ABS16 || !(high->flags & RELOCATION_FLAG_OPERAND)) continue;
+      uint8_t opcode = section->bytes.items[low->offset-1];
+      if(opcode != ADR8_Op_LDAL && opcode != ADR8_Op_LDBL) continue;
+      // the higher half is the next instruction and reads the next address
+      if(high->offset != low->offset + 3 || section->bytes.items[high->offset-1] != opcode + 1) continue;
+      if(high->name_len != low->name_len || memcmp(high->name, low->name, low->name_len) != 0) continue;
+      if(high->addend != low->addend + 1) continue;
+      if(Optimizer_is_entry(section, &sorted, high->offset-1)) continue;
+
+      uint8_t dword = opcode == ADR8_Op_LDAL ? ADR8_Op_LDA : ADR8_Op_LDB;
+      size_t cycles = ADR8_OpTiming_cycles(opcode) + ADR8_OpTiming_cycles(opcode + 1) - ADR8_OpTiming_cycles(dword);
+      Optimizer_count_savings(savings, section, &sorted, low->offset-1, cycles, 3)->fused++;
+      section->bytes.items[low->offset-1] = dword;
+      for(size_t j = 0; j < 3; ++j) DA_append(&removed, high->offset-1 + j);
+      i++;
+    }
+    if(DA_len(&removed)) Optimizer_remove_bytes(section, &removed);
+  }
+  DA_free(removed);
+  DA_free(sorted);
+}
+
+// every decision is made against the same layout, which is safe as removing
+// bytes never moves a jump further away from its target
+bool Optimizer_relax_branches(DA_Section* sections, DA_Label* label_definitions, LabelMap* label_map, DA_OptimizerSavings* savings){
+  bool changed = false;
+  DA_offset_t removed = {0};
+  DA_LabelPtr sorted = {0};
+  DA_foreach(sections, Section*, section){
+    // the bootstrapper must stay identical to the copy in the program loader
+    if(strcmp(section->path, BOOTSTRAPPER_PATH) == 0) continue;
+    DA_len(&removed) = 0;
+    Optimizer_sort_labels(section, &sorted);
+    DA_foreach(&section->relocations, Relocation*, reloc){
+      if(reloc->kind != RelocationKind_ABS16 || !(reloc->flags & RELOCATION_FLAG_OPERAND)) continue;
+      uint8_t opcode = section->bytes.items[reloc->offset-1];
+      if(opcode < ADR8_Op_JMPA || opcode > ADR8_Op_JLTA) continue;
+
+      Label* label = Assembler_resolve(label_definitions, label_map, reloc);
+      if(!label) continue; // reported while linking
+      size_t address = (uint16_t)(label->loc + reloc->addend);
+      long distance = (long)address - (long)(section->base + reloc->offset + 1);
+      // a target behind the jump moves one closer once the operand shrinks
+      if(address > section->base + reloc->offset) distance--;
+      if(distance < INT8_MIN || distance > INT8_MAX) continue;
+
+      uint8_t relative = opcode - (ADR8_Op_JMPA - ADR8_Op_JMPR);
+      size_t cycles = ADR8_OpTiming_cycles(opcode) - ADR8_OpTiming_cycles(relative);
+      Optimizer_count_savings(savings, section, &sorted, reloc->offset-1, cycles, 1)->relaxed++;
+      section->bytes.items[reloc->offset-1] = relative;
+      reloc->kind = RelocationKind_REL8;
+      DA_append(&removed, reloc->offset+1);
+    }
+    if(DA_len(&removed)){
+      Optimizer_remove_bytes(section, &removed);
+      changed = true;
+    }
+  }
+  DA_free(removed);
+  DA_free(sorted);
+  return changed;
+}
+
+// the bytes of another file move by an amount only known after linking, so
+// a literal offset into another file can't be adjusted
+void Optimizer_check_literals(DA_Section* sections, DA_AssemblerDiagnostic* diagnostics){
+  DA_foreach(sections, Section*, section){
+    if(strcmp(section->path, BOOTSTRAPPER_PATH) == 0) continue;
+    DA_foreach(&section->relocations, Relocation*, reloc){
+      if(!(reloc->flags & RELOCATION_FLAG_LITERAL)) continue;
+      long target = (long)reloc->offset + 1 + reloc->addend;
+      if(target < 0 || target > (long)DA_len(&section->bytes)){
+        AssemblerDiagnostics_add(diagnostics, AssemblerDiagnosticLevel_ERROR, reloc->file, reloc->line,
+            "relative jump by %d leaves the file, it can't be optimized, use a label and an absolute jump instead",
+            reloc->addend);
+      }
+    }
+  }
+}
+
+void Assembler_optimize(DA_Section* sections, DA_AssemblerDiagnostic* diagnostics){
+  DA_Label label_definitions = {0};
+  LabelMap label_map = {0};
+  DA_OptimizerSavings savings = {0};
+  Optimizer_check_literals(sections, diagnostics);
+  Optimizer_fuse_loads(sections, &savings);
+  do{
+    Assembler_layout(sections, &label_definitions, &label_map);
+  }while(Optimizer_relax_branches(sections, &label_definitions, &label_map, &savings));
+
+  DA_foreach(&savings, OptimizerSavings*, s){
+    AssemblerDiagnostics_add(diagnostics, AssemblerDiagnosticLevel_NOTE, s->file, 0,
+        "optimizer: %.*s: %lu jumps relaxed, %lu loads fused, %lu cycles and %lu bytes saved",
+        (int)s->name_len, s->name, s->relaxed, s->fused, s->cycles, s->bytes);
+  }
+  free(label_map.slots);
+  DA_free(label_definitions);
+  DA_free(savings);
+}
+
+bool Assembler_assemble(AssemblerOptions* options, AssemblerInput* inputs, size_t input_count,
+    DA_uint8_t* program, DA_AssemblerDiagnostic* diagnostics){
+  DA_Section sections = {0};
+  for(size_t i = 0; i < input_count; ++i){
+    Section section = {
+      .path = inputs[i].path ? inputs[i].path : "<buffer>",
+      .source = inputs[i].source,
+      .source_size = inputs[i].size,
+    };
+    DA_append(&sections, section);
+  }
+
+  // every file is assembled into its own section, spread over worker
+  // threads, the calling thread works along
+  AssemblerWorkers workers = {.options = options, .sections = &sections};
+  size_t thread_count = options->threads ? options->threads : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if(thread_count < 1) thread_count = 1;
+  if(thread_count > DA_len(&sections)) thread_count = DA_len(&sections);
+  pthread_t* threads = calloc(thread_count, sizeof(pthread_t));
+  assert(threads || !thread_count);
+  size_t started = 0;
+  // a thread that fails to start just leaves more sections to the others
+  while(started + 1 < thread_count && pthread_create(&threads[started], NULL, Assembler_worker, &workers) == 0){
+    started++;
+  }
+  Assembler_worker(&workers);
+  for(size_t i = 0; i < started; ++i){
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  size_t errors = 0;
+  DA_foreach(&sections, Section*, section){
+    if(DA_len(&section->diagnostics)){
+      DA_append_many(diagnostics, section->diagnostics.items, DA_len(&section->diagnostics));
+      DA_len(&section->diagnostics) = 0; // moved
+    }
+    errors += section->errors;
+  }
+
+  if(!errors && !options->compile_only){
+    if(options->optimize) Assembler_optimize(&sections, diagnostics);
+    size_t size_at = DA_len(program);
+    if(options->size_header){
+      DA_append(program, 0);
+      DA_append(program, 0);
+    }
+    size_t start = DA_len(program);
+    Assembler_link(options, &sections, program, diagnostics);
+    size_t size = DA_len(program) - start;
+    ADR8_DEBUG_LOG("size: %lu [%08lX]\n", size, size);
+    // labels past the end of the address space would wrap around to its start
+    size_t limit = options->size_header ? 0xFFFF : 0x10000;
+    if(size > limit){
+      AssemblerDiagnostics_add(diagnostics, AssemblerDiagnosticLevel_ERROR, NULL, 0,
+          "program of %lu bytes doesn't fit into the address space of %lu bytes", size, limit);
+    }
+    if(options->size_header){
+      program->items[size_at] = size & 0xFF;
+      program->items[size_at+1] = (size & 0xFF00)>>8;
+    }
+  }
+
+  // sources stay mapped until here as labels point into them
+  DA_foreach(&sections, Section*, section){
+    Section_free(section);
+  }
+  DA_free(sections);
+  return AssemblerDiagnostics_errors(diagnostics) == 0;
+}
+
+bool Assembler_assemble_buffer(const char* source, size_t size, uint8_t* out, size_t capacity,
+    size_t* out_size, DA_AssemblerDiagnostic* diagnostics){
+  AssemblerOptions options = {.threads = 1};
+  AssemblerInput input = {.path = "<buffer>", .source = source, .size = size};
+  DA_uint8_t program = {0};
+  bool ok = Assembler_assemble(&options, &input, 1, &program, diagnostics);
+  *out_size = DA_len(&program);
+  if(ok && DA_len(&program) > capacity){
+    AssemblerDiagnostics_add(diagnostics, AssemblerDiagnosticLevel_ERROR, NULL, 0,
+        "program of %lu bytes doesn't fit into the output buffer of %lu bytes", DA_len(&program), capacity);
+    ok = false;
+  }
+  if(ok) memcpy(out, program.items, DA_len(&program));
+  DA_free(program);
+  return ok;
+}
+
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_ASSEMBLER_H
@@ -0,0 +1,62 @@
+#ifndef ADR8_BOOTSTRAPPER_H
+#define ADR8_BOOTSTRAPPER_H
+
+#include "../ADR8.h"
+
+// The bootstrapper copies a program prefixed with its 16 bit size from the
+// serial bus at 0x1000 to memory starting at address 0. Programs assembled
+// with -b start with the same bytes (utilities/bootstrapper.asm) so it stays
+// intact while it overwrites itself, followed by a jump to the program.
+
+#define ADR8_BOOTSTRAPPER_SIZE 0x15 // the jump to the program follows
+
+static const uint8_t ADR8_bootstrapper[ADR8_BOOTSTRAPPER_SIZE] = {
+  // load 16 bit integer indicating how long the program is from serial bus
+  ADR8_Op_LDAL, 0x00, 0x10,
+  ADR8_Op_LDAH, 0x00, 0x10,
+  ADR8_Op_SETY, 0x00, 0x00, // set pointer to start of program location
+
+  ADR8_Op_LDBL, 0x00, 0x10, // read program byte from serial bus
+  ADR8_Op_SYBL,             // write program byte to memory
+  ADR8_Op_INCY,             // increment program pointer
+  ADR8_Op_DEC,              // decrement A
+  ADR8_Op_SETB, 0x00, 0x00, // set B to zero
+  ADR8_Op_JGTA, 0x09, 0x00, // if A > B(0) keep copying
+};
+
+uint32_t ADR8_Bootstrapper_program_size(const uint8_t* binary, size_t size, uint32_t capacity);
+void ADR8_Bootstrapper_start(ADR8_Core* core, uint32_t program_size);
+bool ADR8_Bootstrapper_load(ADR8_Machine* machine, const uint8_t* binary, size_t size);
+
+#ifdef ADR8_IMPLEMENTATION
+
+// size of the program following the size prefix of a binary assembled with
+// -b, 0 if it wasn't assembled with -b or doesn't fit in capacity bytes
+uint32_t ADR8_Bootstrapper_program_size(const uint8_t* binary, size_t size, uint32_t capacity){
+  if(size < 2) return 0;
+  uint32_t program_size = binary[0] | binary[1] << 8;
+  if(program_size != size - 2 || program_size > capacity || program_size <= ADR8_BOOTSTRAPPER_SIZE) return 0;
+  if(memcmp(binary + 2, ADR8_bootstrapper, ADR8_BOOTSTRAPPER_SIZE) != 0) return 0;
+  return program_size;
+}
+
+// continues the core at the jump to the program with the registers the
+// bootstrapper leaves behind once it copied program_size bytes
+void ADR8_Bootstrapper_start(ADR8_Core* core, uint32_t program_size){
+  core->reg.y.full = program_size;
+  core->reg.pc.full = ADR8_BOOTSTRAPPER_SIZE;
+}
+
+// loads a program assembled with -b into memory at address 0 without
+// running the bootstrapper, returns false if the program wasn't assembled
+// with -b or doesn't fit in memory
+bool ADR8_Bootstrapper_load(ADR8_Machine* machine, const uint8_t* binary, size_t size){
+  uint32_t program_size = ADR8_Bootstrapper_program_size(binary, size, machine->mem.size);
+  if(!program_size) return false;
+  memcpy(machine->mem.data, binary + 2, program_size);
+  ADR8_Bootstrapper_start(&machine->core, program_size);
+  return true;
+}
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_BOOTSTRAPPER_H
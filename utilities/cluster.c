@@ -0,0 +1,195 @@
+#define ADR8_IMPLEMENTATION
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "../devices/network.h"
+#include "bootstrapper.h"
+#include <pthread.h>
+
+// Runs a program on every node of a simulated cluster, each node on its own
+// thread with the devices of the program loader and a network card at
+// 0x1040 on interrupt line 3. The nodes run in steps of at most the network
+// latency and wait for each other after every step, so every frame is in
+// its receiver's queue before the receiver runs up to its arrival. Queues
+// don't drop frames and a node sorts the frames it takes by arrival, so the
+// nodes see the same frames at the same cycles on every run. Frames go
+// through the lock-free queues of the network, the wait between steps is
+// the only point the threads meet. Once every node halted or ran its cycles
+// the output of the nodes is written to stdout in the order of the nodes.
+
+#define CLUSTER_MEMORY_SIZE 0x1000
+#define CLUSTER_DEFAULT_NODES 4
+#define CLUSTER_DEFAULT_LATENCY 1000
+#define CLUSTER_DEFAULT_CYCLES_PER_BYTE 8
+#define CLUSTER_DEFAULT_BUDGET 100000000
+
+typedef struct Cluster Cluster;
+
+typedef struct{
+  Cluster* cluster;
+  uint8_t id;
+  ADR8_Machine* machine;
+  ADR8_SerialBus serial;
+  ADR8_Scheduler sched;
+  ADR8_Timer timer;
+  ADR8_Nic nic;
+  FILE* in_fp;
+  FILE* out_fp;
+  char* output;
+  size_t output_size;
+  pthread_t thread;
+} Cluster_Node;
+
+struct Cluster{
+  ADR8_Network network;
+  Cluster_Node* nodes;
+  uint64_t step; // cycles between the waits
+  uint64_t budget;
+  pthread_barrier_t barrier;
+  // nodes done after step k are counted in finished[k % 3], read after the
+  // wait of step k and cleared after the wait of step k+1, before step k+3
+  // counts in it again
+  _Atomic size_t finished[3];
+};
+
+static bool Cluster_Node_init(Cluster_Node* node, Cluster* cluster, uint8_t id, const uint8_t* program, size_t program_size){
+  node->cluster = cluster;
+  node->id = id;
+  node->machine = ADR8_Machine_new(CLUSTER_MEMORY_SIZE, 0x0);
+  if(!node->machine) return false;
+  ADR8_Bus* bus = &node->machine->bus;
+  ADR8_Core* core = &node->machine->core;
+  node->in_fp = fopen("/dev/null", "r");
+  node->out_fp = open_memstream(&node->output, &node->output_size);
+  if(!node->in_fp || !node->out_fp) return false;
+  ADR8_SerialBus_init(&node->serial, node->in_fp, node->out_fp, bus, 0x1000);
+  ADR8_Scheduler_init(&node->sched);
+  ADR8_Timer_init(&node->timer, bus, &node->sched, core, 1, 1, 0x1010);
+  if(!ADR8_Nic_init(&node->nic, &cluster->network, id, bus, &node->sched, core, 3, 0x1040)) return false;
+  return ADR8_Bootstrapper_load(node->machine, program, program_size);
+}
+
+static void Cluster_Node_free(Cluster_Node* node){
+  if(node->in_fp) fclose(node->in_fp);
+  if(node->out_fp) fclose(node->out_fp);
+  free(node->output);
+  ADR8_Nic_free(&node->nic);
+  ADR8_Scheduler_free(&node->sched);
+  if(node->machine) ADR8_Machine_free(node->machine);
+}
+
+static void* Cluster_Node_run(void* ptr){
+  Cluster_Node* node = ptr;
+  Cluster* cluster = node->cluster;
+  ADR8_Core* core = &node->machine->core;
+  size_t node_count = cluster->network.node_count;
+  for(uint64_t k = 0;; ++k){
+    // frames sent during the last step arrive in this one at the earliest
+    ADR8_Nic_poll(&node->nic);
+    uint64_t until = (k + 1)*cluster->step;
+    if(until > cluster->budget) until = cluster->budget;
+    ADR8_Scheduler_run(&node->sched, core, until);
+    if(core->halt || core->cycles >= cluster->budget) atomic_fetch_add(&cluster->finished[k % 3], 1);
+    if(pthread_barrier_wait(&cluster->barrier) == PTHREAD_BARRIER_SERIAL_THREAD){
+      atomic_store(&cluster->finished[(k + 2) % 3], 0);
+    }
+    if(atomic_load(&cluster->finished[k % 3]) == node_count) break;
+  }
+  return NULL;
+}
+
+static uint8_t* Cluster_read_file(const char* path, size_t* size){
+  FILE* fp = fopen(path, "rb");
+  if(!fp) return NULL;
+  fseek(fp, 0, SEEK_END);
+  long length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t* data = length > 0 ? malloc(length) : NULL;
+  if(data && fread(data, 1, length, fp) != (size_t)length){
+    free(data);
+    data = NULL;
+  }
+  fclose(fp);
+  *size = length;
+  return data;
+}
+
+int main(int argc, char** argv){
+  const char* program_path = NULL;
+  long node_count = CLUSTER_DEFAULT_NODES;
+  uint64_t latency = CLUSTER_DEFAULT_LATENCY;
+  uint64_t cycles_per_byte = CLUSTER_DEFAULT_CYCLES_PER_BYTE;
+  uint64_t budget = CLUSTER_DEFAULT_BUDGET;
+  bool print_cycles = false;
+  bool usage = false;
+  for(int i = 1; i < argc; ++i){
+    if(strcmp(argv[i], "-c") == 0){
+      print_cycles = true;
+    }else if(argv[i][0] == '-' && i+1 < argc){
+      switch (argv[i][1]) {
+        case 'N': node_count = atol(argv[++i]); break;
+        case 'l': latency = atoll(argv[++i]); break;
+        case 'b': cycles_per_byte = atoll(argv[++i]); break;
+        case 'n': budget = atoll(argv[++i]); break;
+        default: usage = true; break;
+      }
+    }else{
+      program_path = argv[i];
+    }
+  }
+  if(usage || !program_path || node_count <= 0 || node_count > ADR8_NETWORK_MAX_NODES || latency == 0){
+    ADR8_ERROR_LOG("Usage: cluster [-N NODES] [-l LATENCY] [-b CYCLES_PER_BYTE] [-n MAX_CYCLES] [-c] PROGRAM\n");
+    return 1;
+  }
+  if(budget == 0) budget = CLUSTER_DEFAULT_BUDGET;
+
+  size_t program_size = 0;
+  uint8_t* program = Cluster_read_file(program_path, &program_size);
+  if(!program){
+    ADR8_ERROR_LOG("cluster: unable to read '%s'\n", program_path);
+    return 1;
+  }
+
+  Cluster cluster = {.step = latency, .budget = budget};
+  for(int i = 0; i < 3; ++i) atomic_init(&cluster.finished[i], 0);
+  cluster.nodes = calloc(node_count, sizeof(Cluster_Node));
+  if(!cluster.nodes || !ADR8_Network_init(&cluster.network, node_count, latency, cycles_per_byte)){
+    ADR8_ERROR_LOG("cluster: unable to allocate %ld nodes\n", node_count);
+    return 1;
+  }
+  bool ok = true;
+  for(long i = 0; i < node_count && ok; ++i){
+    ok = Cluster_Node_init(&cluster.nodes[i], &cluster, i, program, program_size);
+  }
+  if(!ok){
+    ADR8_ERROR_LOG("cluster: '%s' wasn't assembled with -b, is too large or a node couldn't be allocated\n", program_path);
+  }else{
+    pthread_barrier_init(&cluster.barrier, NULL, node_count);
+    for(long i = 0; i < node_count; ++i){
+      if(pthread_create(&cluster.nodes[i].thread, NULL, Cluster_Node_run, &cluster.nodes[i]) != 0){
+        // the others would wait for it forever
+        ADR8_ERROR_LOG("cluster: unable to start node %ld\n", i);
+        exit(1);
+      }
+    }
+    for(long i = 0; i < node_count; ++i) pthread_join(cluster.nodes[i].thread, NULL);
+    pthread_barrier_destroy(&cluster.barrier);
+    for(long i = 0; i < node_count; ++i){
+      Cluster_Node* node = &cluster.nodes[i];
+      fflush(node->out_fp);
+      fwrite(node->output, 1, node->output_size, stdout);
+      if(print_cycles){
+        fprintf(stderr, "node %ld: %llu cycles\n", i, (unsigned long long)node->machine->core.cycles);
+      }
+      if(!node->machine->core.halt){
+        ADR8_ERROR_LOG("cluster: node %ld didn't halt within %llu cycles\n", i, (unsigned long long)budget);
+      }
+    }
+  }
+
+  for(long i = 0; i < node_count; ++i) Cluster_Node_free(&cluster.nodes[i]);
+  ADR8_Network_free(&cluster.network);
+  free(cluster.nodes);
+  free(program);
+  return ok ? 0 : 1;
+}
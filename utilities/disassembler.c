@@ -0,0 +1,60 @@
+#include "../ADR8.h"
+#include "disassembler.h"
+
+#define DISASSEMBLER_DEFAULT_TRIP_COUNT 10
+
+int main(int argc, char** argv){
+  const char* input_file = NULL;
+  const char* map_file = NULL;
+  uint16_t entry = 0;
+  uint64_t trip_count = DISASSEMBLER_DEFAULT_TRIP_COUNT;
+  bool raw = false;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] == '-'){
+      switch (argv[i][1]) {
+        case 'm': if(i+1 < argc) map_file = argv[++i]; break;
+        case 'e': if(i+1 < argc) entry = strtol(argv[++i], NULL, 16); break;
+        case 't': if(i+1 < argc) trip_count = atol(argv[++i]); break;
+        case 'r': raw = true; break;
+        default: break;
+      }
+    }else{
+      input_file = argv[i];
+    }
+  }
+
+  if(!input_file){
+    ADR8_ERROR_LOG("Usage: disassembler [-m MAPFILE] [-e ENTRY] [-t TRIPS] [-r] INFILE\n");
+    return 1;
+  }
+
+  FILE* file = fopen(input_file, "rb");
+  if(!file){
+    ADR8_ERROR_LOG("couldn't open file '%s'\n",input_file);
+    return 1;
+  }
+  uint8_t* data = calloc(0x10000 + 2, 1);
+  assert(data);
+  size_t size = fread(data, 1, 0x10000 + 2, file);
+  fclose(file);
+
+  // programs assembled for the bootstrapper start with their size, which
+  // isn't loaded into memory
+  uint8_t* image = data;
+  if(!raw && size >= 2 && (size_t)(data[0] | data[1] << 8) == size - 2){
+    image += 2;
+    size -= 2;
+  }
+
+  Disassembly dis;
+  Disassembly_init(&dis, image, size, trip_count);
+  if(map_file && !Disassembly_load_map(&dis, map_file)){
+    ADR8_ERROR_LOG("couldn't open map file '%s'\n",map_file);
+    return 1;
+  }
+  Disassembly_analyze(&dis, entry);
+  Disassembly_print(&dis, stdout);
+  Disassembly_free(&dis);
+  free(data);
+  return 0;
+}
@@ -0,0 +1,550 @@
+#ifndef ADR8_DISASSEMBLER_H
+#define ADR8_DISASSEMBLER_H
+
+#include "../ADR8.h"
+#include "da.h"
+#include <stdio.h>
+
+// Recovers the code of an ADR8 program image by following its control flow
+// from an entry point, so data between the code is never decoded. The code
+// is split into basic blocks that form a control flow graph, every block is
+// annotated with its cycle cost from ADR8_OpInfoTable and loops are found
+// as the natural loops of the graph to estimate where a program spends its
+// cycles without running it.
+
+#define DISASSEMBLER_NO_BLOCK SIZE_MAX
+
+typedef struct{
+  uint16_t start;
+  uint16_t end;              // address after the last instruction
+  size_t instructions;
+  uint64_t cycles;           // all instructions
+  size_t successors[2];      // blocks control continues in within the function
+  size_t successor_count;
+  bool calls;                // contains a JSR
+  bool returns;              // ends in RSR or RTI
+  bool halts;                // ends in HALT
+  bool invalid;              // ends in an unimplemented opcode or leaves the image
+  size_t loop;               // innermost loop, DISASSEMBLER_NO_BLOCK if none
+} DisassemblerBlock;
+
+typedef size_t DisassemblerIndex;
+DA_def(DisassemblerIndex);
+
+typedef struct{
+  size_t header;           // block every iteration starts in
+  DA_DisassemblerIndex blocks;
+  size_t parent;           // enclosing loop, DISASSEMBLER_NO_BLOCK if outermost
+  size_t depth;            // 1 for outermost loops
+  bool calls;              // cycles spent in subroutines are not included
+  uint64_t cycles;         // one iteration, inner loops run trip_count times
+  uint64_t estimate;       // the outermost loop entered once
+} DisassemblerLoop;
+
+typedef struct{
+  char* name;
+  uint16_t address;
+} DisassemblerSymbol;
+
+DA_def(DisassemblerBlock);
+DA_def(DisassemblerLoop);
+DA_def(DisassemblerSymbol);
+
+typedef struct{
+  const uint8_t* image; // program as loaded at address 0
+  size_t size;
+  uint64_t trip_count;  // assumed iterations of every loop
+  uint8_t* flags;       // DISASSEMBLER_FLAG_* of every address
+  size_t* block_at;     // block starting at every address
+  DA_DisassemblerBlock blocks;
+  DA_DisassemblerIndex functions; // entry point and subroutines
+  DA_DisassemblerLoop loops;
+  DA_DisassemblerSymbol symbols;  // sorted by address
+} Disassembly;
+
+void Disassembly_init(Disassembly* dis, const uint8_t* image, size_t size, uint64_t trip_count);
+void Disassembly_free(Disassembly* dis);
+// reads the symbols of an assembler map file (-m), returns false if the file
+// can't be read
+bool Disassembly_load_map(Disassembly* dis, const char* path);
+void Disassembly_analyze(Disassembly* dis, uint16_t entry);
+void Disassembly_print(Disassembly* dis, FILE* out);
+
+uint8_t Disassembler_operand_size(uint8_t opcode);
+
+#ifdef ADR8_IMPLEMENTATION
+
+#define DISASSEMBLER_FLAG_CODE     0x1 // an instruction starts here
+#define DISASSEMBLER_FLAG_LEADER   0x2 // a block starts here
+#define DISASSEMBLER_FLAG_FUNCTION 0x4 // entry point or subroutine
+
+uint8_t Disassembler_operand_size(uint8_t opcode){
+  return ADR8_OpInfoTable[opcode].length ? ADR8_OpInfoTable[opcode].length - 1 : 0;
+}
+
+static bool Disassembler_is_relative_jump(uint8_t opcode){
+  return ADR8_OpInfoTable[opcode].operand == ADR8_OPERAND_OFFSET;
+}
+
+static bool Disassembler_is_absolute_jump(uint8_t opcode){
+  return opcode >= ADR8_Op_JMPA && opcode <= ADR8_Op_JLTA;
+}
+
+static uint16_t Disassembler_operand16(Disassembly* dis, size_t address){
+  return dis->image[address+1] | dis->image[address+2] << 8;
+}
+
+// target of the jump or call at address, the caller checks the opcode
+static uint16_t Disassembler_target(Disassembly* dis, size_t address){
+  uint8_t opcode = dis->image[address];
+  if(Disassembler_is_relative_jump(opcode)){
+    return address + 2 + (int8_t)dis->image[address+1];
+  }
+  // the core enters subroutines one past the address of the JSR operand
+  if(opcode == ADR8_Op_JSR) return Disassembler_operand16(dis, address) + 1;
+  return Disassembler_operand16(dis, address);
+}
+
+static bool Disassembler_fits(Disassembly* dis, size_t address){
+  return address < dis->size && address + Disassembler_operand_size(dis->image[address]) < dis->size;
+}
+
+void Disassembly_init(Disassembly* dis, const uint8_t* image, size_t size, uint64_t trip_count){
+  memset(dis, 0, sizeof(Disassembly));
+  dis->image = image;
+  dis->size = size > 0x10000 ? 0x10000 : size;
+  dis->trip_count = trip_count;
+  dis->flags = calloc(0x10000, sizeof(uint8_t));
+  dis->block_at = malloc(0x10000*sizeof(size_t));
+  assert(dis->flags && dis->block_at);
+  for(size_t i = 0; i < 0x10000; ++i) dis->block_at[i] = DISASSEMBLER_NO_BLOCK;
+}
+
+void Disassembly_free(Disassembly* dis){
+  DA_foreach(&dis->loops, DisassemblerLoop*, loop){
+    DA_free(loop->blocks);
+  }
+  DA_foreach(&dis->symbols, DisassemblerSymbol*, symbol){
+    free(symbol->name);
+  }
+  DA_free(dis->loops);
+  DA_free(dis->blocks);
+  DA_free(dis->functions);
+  DA_free(dis->symbols);
+  free(dis->flags);
+  free(dis->block_at);
+}
+
+static int Disassembler_symbol_cmp(const void* a, const void* b){
+  const DisassemblerSymbol* x = a;
+  const DisassemblerSymbol* y = b;
+  return (x->address > y->address) - (x->address < y->address);
+}
+
+bool Disassembly_load_map(Disassembly* dis, const char* path){
+  FILE* file = fopen(path, "r");
+  if(!file) return false;
+  char line[512];
+  while(fgets(line, sizeof(line), file)){
+    unsigned address;
+    char name[256];
+    if(sscanf(line, "%x %255s", &address, name) != 2) continue;
+    DisassemblerSymbol symbol = {.name = strdup(name), .address = address};
+    assert(symbol.name);
+    DA_append(&dis->symbols, symbol);
+  }
+  fclose(file);
+  if(DA_len(&dis->symbols)){
+    qsort(dis->symbols.items, DA_len(&dis->symbols), sizeof(DisassemblerSymbol), Disassembler_symbol_cmp);
+  }
+  return true;
+}
+
+// first symbol at the address, NULL if there is none
+static const char* Disassembler_symbol_at(Disassembly* dis, uint16_t address){
+  size_t lo = 0, hi = DA_len(&dis->symbols);
+  while(lo < hi){
+    size_t mid = (lo + hi)/2;
+    if(dis->symbols.items[mid].address < address) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo < DA_len(&dis->symbols) && dis->symbols.items[lo].address == address ? dis->symbols.items[lo].name : NULL;
+}
+
+// follows the control flow from the entry point, marking every instruction
+// and where blocks and functions start
+static void Disassembler_explore(Disassembly* dis, uint16_t entry){
+  DA_DisassemblerIndex worklist = {0};
+  dis->flags[entry] |= DISASSEMBLER_FLAG_LEADER | DISASSEMBLER_FLAG_FUNCTION;
+  DA_append(&worklist, entry);
+  while(DA_len(&worklist)){
+    size_t address = worklist.items[--DA_len(&worklist)];
+    while(Disassembler_fits(dis, address) && !(dis->flags[address] & DISASSEMBLER_FLAG_CODE)){
+      uint8_t opcode = dis->image[address];
+      dis->flags[address] |= DISASSEMBLER_FLAG_CODE;
+      if(ADR8_OpTiming_cycles(opcode) == 0) break;
+
+      size_t next = address + 1 + Disassembler_operand_size(opcode);
+      if(Disassembler_is_relative_jump(opcode) || Disassembler_is_absolute_jump(opcode) || opcode == ADR8_Op_JSR){
+        uint16_t target = Disassembler_target(dis, address);
+        dis->flags[target] |= DISASSEMBLER_FLAG_LEADER;
+        if(opcode == ADR8_Op_JSR) dis->flags[target] |= DISASSEMBLER_FLAG_FUNCTION;
+        DA_append(&worklist, target);
+        if(opcode == ADR8_Op_JMPR || opcode == ADR8_Op_JMPA) break;
+        if(opcode != ADR8_Op_JSR && next < 0x10000) dis->flags[next] |= DISASSEMBLER_FLAG_LEADER;
+      }
+      if(opcode == ADR8_Op_RSR || opcode == ADR8_Op_RTI || opcode == ADR8_Op_HALT) break;
+      address = next;
+    }
+  }
+  DA_free(worklist);
+}
+
+static void Disassembler_add_successor(DisassemblerBlock* block, size_t successor){
+  if(successor == DISASSEMBLER_NO_BLOCK){
+    block->invalid = true;
+    return;
+  }
+  for(size_t i = 0; i < block->successor_count; ++i){
+    if(block->successors[i] == successor) return;
+  }
+  block->successors[block->successor_count++] = successor;
+}
+
+// splits the explored code into basic blocks at every leader
+static void Disassembler_build_blocks(Disassembly* dis){
+  for(size_t start = 0; start < 0x10000; ++start){
+    if(!(dis->flags[start] & DISASSEMBLER_FLAG_LEADER) || !(dis->flags[start] & DISASSEMBLER_FLAG_CODE)) continue;
+    DisassemblerBlock block = {.start = start, .loop = DISASSEMBLER_NO_BLOCK};
+    size_t address = start;
+    for(;;){
+      uint8_t opcode = dis->image[address];
+      block.instructions++;
+      block.cycles += ADR8_OpTiming_cycles(opcode);
+      address += 1 + Disassembler_operand_size(opcode);
+      if(opcode == ADR8_Op_JSR) block.calls = true;
+      if(ADR8_OpTiming_cycles(opcode) == 0 || opcode == ADR8_Op_RSR || opcode == ADR8_Op_RTI || opcode == ADR8_Op_HALT
+          || Disassembler_is_relative_jump(opcode) || Disassembler_is_absolute_jump(opcode)){
+        break;
+      }
+      if(address >= 0x10000 || !(dis->flags[address] & DISASSEMBLER_FLAG_CODE)
+          || (dis->flags[address] & DISASSEMBLER_FLAG_LEADER)){
+        break;
+      }
+    }
+    block.end = address;
+    dis->block_at[start] = DA_len(&dis->blocks);
+    DA_append(&dis->blocks, block);
+  }
+
+  DA_foreach(&dis->blocks, DisassemblerBlock*, block){
+    size_t last = block->start;
+    for(size_t address = block->start; address < block->end; address += 1 + Disassembler_operand_size(dis->image[address])){
+      last = address;
+    }
+    uint8_t opcode = dis->image[last];
+    bool jump = Disassembler_is_relative_jump(opcode) || Disassembler_is_absolute_jump(opcode);
+    block->returns = opcode == ADR8_Op_RSR || opcode == ADR8_Op_RTI;
+    block->halts = opcode == ADR8_Op_HALT;
+    if(ADR8_OpTiming_cycles(opcode) == 0) block->invalid = true;
+    if(jump) Disassembler_add_successor(block, dis->block_at[Disassembler_target(dis, last)]);
+    bool falls_through = !block->returns && !block->halts && !block->invalid
+      && opcode != ADR8_Op_JMPR && opcode != ADR8_Op_JMPA;
+    if(falls_through){
+      Disassembler_add_successor(block, block->end < 0x10000 ? dis->block_at[block->end] : DISASSEMBLER_NO_BLOCK);
+    }
+  }
+
+  for(size_t address = 0; address < 0x10000; ++address){
+    if((dis->flags[address] & DISASSEMBLER_FLAG_FUNCTION) && dis->block_at[address] != DISASSEMBLER_NO_BLOCK){
+      DA_append(&dis->functions, dis->block_at[address]);
+    }
+  }
+}
+
+// postorder of the blocks reachable from root within its function
+static void Disassembler_postorder(Disassembly* dis, size_t root, size_t* visited, size_t mark, DA_DisassemblerIndex* order){
+  // iterative depth first search, the stack holds block and next successor
+  DA_DisassemblerIndex stack = {0};
+  visited[root] = mark;
+  DA_append(&stack, root);
+  DA_append(&stack, 0);
+  while(DA_len(&stack)){
+    size_t* next = &stack.items[DA_len(&stack)-1];
+    size_t block = stack.items[DA_len(&stack)-2];
+    if(*next < dis->blocks.items[block].successor_count){
+      size_t successor = dis->blocks.items[block].successors[(*next)++];
+      if(visited[successor] != mark){
+        visited[successor] = mark;
+        DA_append(&stack, successor);
+        DA_append(&stack, 0);
+      }
+    }else{
+      DA_append(order, block);
+      DA_len(&stack) -= 2;
+    }
+  }
+  DA_free(stack);
+}
+
+static size_t Disassembler_intersect(size_t* idom, size_t* rpo_index, size_t a, size_t b){
+  while(a != b){
+    while(rpo_index[a] > rpo_index[b]) a = idom[a];
+    while(rpo_index[b] > rpo_index[a]) b = idom[b];
+  }
+  return a;
+}
+
+static bool Disassembler_dominates(size_t* idom, size_t a, size_t b){
+  for(;;){
+    if(a == b) return true;
+    if(idom[b] == b) return false;
+    b = idom[b];
+  }
+}
+
+static DisassemblerLoop* Disassembler_loop_with_header(Disassembly* dis, size_t header){
+  DA_foreach(&dis->loops, DisassemblerLoop*, loop){
+    if(loop->header == header) return loop;
+  }
+  DisassemblerLoop loop = {.header = header, .parent = DISASSEMBLER_NO_BLOCK};
+  DA_append(&loop.blocks, header);
+  DA_append(&dis->loops, loop);
+  return &dis->loops.items[DA_len(&dis->loops)-1];
+}
+
+static bool Disassembler_loop_contains(DisassemblerLoop* loop, size_t block){
+  DA_foreach(&loop->blocks, size_t*, b){
+    if(*b == block) return true;
+  }
+  return false;
+}
+
+// adds the natural loop of the back edge from tail to the loop, the blocks
+// that reach tail without passing through the header
+static void Disassembler_add_natural_loop(Disassembly* dis, DisassemblerLoop* loop, size_t tail, DA_DisassemblerIndex* predecessors, size_t* predecessor_start){
+  DA_DisassemblerIndex worklist = {0};
+  if(!Disassembler_loop_contains(loop, tail)){
+    DA_append(&loop->blocks, tail);
+    DA_append(&worklist, tail);
+  }
+  while(DA_len(&worklist)){
+    size_t block = worklist.items[--DA_len(&worklist)];
+    for(size_t i = predecessor_start[block]; i < predecessor_start[block+1]; ++i){
+      size_t predecessor = predecessors->items[i];
+      if(!Disassembler_loop_contains(loop, predecessor)){
+        DA_append(&loop->blocks, predecessor);
+        DA_append(&worklist, predecessor);
+      }
+    }
+  }
+  DA_free(worklist);
+}
+
+// finds the loops of every function from its dominator tree, which is
+// computed with the iterative algorithm of Cooper, Harvey and Kennedy
+static void Disassembler_find_loops(Disassembly* dis){
+  size_t n = DA_len(&dis->blocks);
+  if(!n) return;
+  size_t* visited = calloc(n, sizeof(size_t));
+  size_t* idom = malloc(n*sizeof(size_t));
+  size_t* rpo_index = malloc(n*sizeof(size_t));
+  size_t* predecessor_start = calloc(n + 1, sizeof(size_t));
+  assert(visited && idom && rpo_index && predecessor_start);
+
+  // predecessors of every block in one array, indexed by predecessor_start
+  DA_DisassemblerIndex predecessors = {0};
+  DA_foreach(&dis->blocks, DisassemblerBlock*, block){
+    for(size_t i = 0; i < block->successor_count; ++i) predecessor_start[block->successors[i]+1]++;
+  }
+  for(size_t i = 0; i < n; ++i) predecessor_start[i+1] += predecessor_start[i];
+  size_t* fill = calloc(n, sizeof(size_t));
+  assert(fill);
+  for(size_t i = 0; i < predecessor_start[n]; ++i) DA_append(&predecessors, 0);
+  for(size_t b = 0; b < n; ++b){
+    DisassemblerBlock* block = &dis->blocks.items[b];
+    for(size_t i = 0; i < block->successor_count; ++i){
+      size_t s = block->successors[i];
+      predecessors.items[predecessor_start[s] + fill[s]++] = b;
+    }
+  }
+  free(fill);
+
+  DA_DisassemblerIndex order = {0};
+  for(size_t f = 0; f < DA_len(&dis->functions); ++f){
+    size_t root = dis->functions.items[f];
+    DA_len(&order) = 0;
+    Disassembler_postorder(dis, root, visited, f+1, &order);
+    // reverse postorder, the root comes first
+    for(size_t i = 0; i < DA_len(&order); ++i){
+      size_t block = order.items[DA_len(&order)-1-i];
+      rpo_index[block] = i;
+      idom[block] = DISASSEMBLER_NO_BLOCK;
+    }
+    idom[root] = root;
+    bool changed = true;
+    while(changed){
+      changed = false;
+      for(size_t i = 1; i < DA_len(&order); ++i){
+        size_t block = order.items[DA_len(&order)-1-i];
+        size_t new_idom = DISASSEMBLER_NO_BLOCK;
+        for(size_t p = predecessor_start[block]; p < predecessor_start[block+1]; ++p){
+          size_t predecessor = predecessors.items[p];
+          if(visited[predecessor] != f+1 || idom[predecessor] == DISASSEMBLER_NO_BLOCK) continue;
+          new_idom = new_idom == DISASSEMBLER_NO_BLOCK ? predecessor
+            : Disassembler_intersect(idom, rpo_index, predecessor, new_idom);
+        }
+        if(idom[block] != new_idom){
+          idom[block] = new_idom;
+          changed = true;
+        }
+      }
+    }
+
+    // an edge to a block that dominates its source closes a loop
+    DA_foreach(&order, size_t*, b){
+      DisassemblerBlock* block = &dis->blocks.items[*b];
+      for(size_t i = 0; i < block->successor_count; ++i){
+        size_t header = block->successors[i];
+        if(Disassembler_dominates(idom, header, *b)){
+          DisassemblerLoop* loop = Disassembler_loop_with_header(dis, header);
+          Disassembler_add_natural_loop(dis, loop, *b, &predecessors, predecessor_start);
+        }
+      }
+    }
+  }
+  DA_free(order);
+  DA_free(predecessors);
+  free(visited);
+  free(idom);
+  free(rpo_index);
+  free(predecessor_start);
+}
+
+// the innermost loop of a block has the fewest blocks, the parent of a loop
+// is the smallest other loop containing its header
+static void Disassembler_nest_loops(Disassembly* dis){
+  for(size_t l = 0; l < DA_len(&dis->loops); ++l){
+    DisassemblerLoop* loop = &dis->loops.items[l];
+    DA_foreach(&loop->blocks, size_t*, b){
+      DisassemblerBlock* block = &dis->blocks.items[*b];
+      if(block->loop == DISASSEMBLER_NO_BLOCK || DA_len(&dis->loops.items[block->loop].blocks) > DA_len(&loop->blocks)){
+        block->loop = l;
+      }
+      if(block->calls) loop->calls = true;
+    }
+    for(size_t o = 0; o < DA_len(&dis->loops); ++o){
+      DisassemblerLoop* outer = &dis->loops.items[o];
+      if(o == l || DA_len(&outer->blocks) <= DA_len(&loop->blocks)) continue;
+      if(!Disassembler_loop_contains(outer, loop->header)) continue;
+      if(loop->parent == DISASSEMBLER_NO_BLOCK || DA_len(&dis->loops.items[loop->parent].blocks) > DA_len(&outer->blocks)){
+        loop->parent = o;
+      }
+    }
+  }
+  DA_foreach(&dis->loops, DisassemblerLoop*, loop){
+    loop->depth = 1;
+    for(size_t p = loop->parent; p != DISASSEMBLER_NO_BLOCK; p = dis->loops.items[p].parent) loop->depth++;
+  }
+}
+
+static uint64_t Disassembler_loop_cycles(Disassembly* dis, size_t l){
+  DisassemblerLoop* loop = &dis->loops.items[l];
+  uint64_t cycles = 0;
+  DA_foreach(&loop->blocks, size_t*, b){
+    if(dis->blocks.items[*b].loop == l) cycles += dis->blocks.items[*b].cycles;
+  }
+  for(size_t i = 0; i < DA_len(&dis->loops); ++i){
+    if(dis->loops.items[i].parent == l) cycles += Disassembler_loop_cycles(dis, i)*dis->trip_count;
+  }
+  return cycles;
+}
+
+void Disassembly_analyze(Disassembly* dis, uint16_t entry){
+  Disassembler_explore(dis, entry);
+  Disassembler_build_blocks(dis);
+  Disassembler_find_loops(dis);
+  Disassembler_nest_loops(dis);
+  for(size_t l = 0; l < DA_len(&dis->loops); ++l){
+    DisassemblerLoop* loop = &dis->loops.items[l];
+    loop->cycles = Disassembler_loop_cycles(dis, l);
+    loop->estimate = loop->cycles*dis->trip_count;
+    for(size_t p = loop->parent; p != DISASSEMBLER_NO_BLOCK; p = dis->loops.items[p].parent){
+      loop->estimate *= dis->trip_count;
+    }
+  }
+}
+
+static void Disassembler_print_address(Disassembly* dis, FILE* out, uint16_t address){
+  const char* symbol = Disassembler_symbol_at(dis, address);
+  if(symbol) fprintf(out, "%s (0x%04X)", symbol, address);
+  else fprintf(out, "0x%04X", address);
+}
+
+static void Disassembler_print_instruction(Disassembly* dis, FILE* out, size_t address){
+  uint8_t opcode = dis->image[address];
+  const char* name = ADR8_OpInfoTable[opcode].name;
+  if(name) fprintf(out, "  %04lX: %s", address, name);
+  else fprintf(out, "  %04lX: 0x%02X", address, opcode);
+  if(Disassembler_is_relative_jump(opcode) || Disassembler_is_absolute_jump(opcode)){
+    fprintf(out, " ");
+    Disassembler_print_address(dis, out, Disassembler_target(dis, address));
+  }else if(ADR8_OpInfoTable[opcode].operand == ADR8_OPERAND_IMMEDIATE){
+    // immediate values, which may or may not be addresses
+    fprintf(out, " 0x%04X", Disassembler_operand16(dis, address));
+  }else if(ADR8_OpInfoTable[opcode].operand == ADR8_OPERAND_ADDRESS){
+    fprintf(out, " ");
+    Disassembler_print_address(dis, out, Disassembler_operand16(dis, address));
+  }
+  fprintf(out, "\n");
+}
+
+static int Disassembler_loop_cmp(const void* a, const void* b){
+  const DisassemblerLoop* x = *(DisassemblerLoop* const*)a;
+  const DisassemblerLoop* y = *(DisassemblerLoop* const*)b;
+  return (x->estimate < y->estimate) - (x->estimate > y->estimate);
+}
+
+void Disassembly_print(Disassembly* dis, FILE* out){
+  DA_foreach(&dis->blocks, DisassemblerBlock*, block){
+    fprintf(out, "\nblock ");
+    Disassembler_print_address(dis, out, block->start);
+    fprintf(out, ": %lu instructions, %lu cycles", block->instructions, block->cycles);
+    if(block->loop != DISASSEMBLER_NO_BLOCK){
+      fprintf(out, ", loop depth %lu", dis->loops.items[block->loop].depth);
+    }
+    fprintf(out, "\n");
+    for(size_t address = block->start; address < block->end; address += 1 + Disassembler_operand_size(dis->image[address])){
+      Disassembler_print_instruction(dis, out, address);
+    }
+    fprintf(out, "  -> ");
+    for(size_t i = 0; i < block->successor_count; ++i){
+      fprintf(out, "%s%04X", i ? ", " : "", dis->blocks.items[block->successors[i]].start);
+    }
+    if(block->returns) fprintf(out, "return");
+    if(block->halts) fprintf(out, "halt");
+    if(block->invalid) fprintf(out, "%sinvalid", block->successor_count ? ", " : "");
+    fprintf(out, "\n");
+  }
+
+  if(!DA_len(&dis->loops)) return;
+  // hottest loops first
+  DisassemblerLoop** sorted = malloc(DA_len(&dis->loops)*sizeof(DisassemblerLoop*));
+  assert(sorted);
+  for(size_t i = 0; i < DA_len(&dis->loops); ++i) sorted[i] = &dis->loops.items[i];
+  qsort(sorted, DA_len(&dis->loops), sizeof(DisassemblerLoop*), Disassembler_loop_cmp);
+  fprintf(out, "\nloops (assuming %lu iterations each):\n", dis->trip_count);
+  for(size_t i = 0; i < DA_len(&dis->loops); ++i){
+    DisassemblerLoop* loop = sorted[i];
+    fprintf(out, "  ");
+    Disassembler_print_address(dis, out, dis->blocks.items[loop->header].start);
+    fprintf(out, ": depth %lu, %lu blocks, %lu cycles per iteration, ~%lu cycles per entry of the outermost loop%s\n",
+        loop->depth, DA_len(&loop->blocks), loop->cycles, loop->estimate,
+        loop->calls ? " (plus subroutine calls)" : "");
+  }
+  free(sorted);
+}
+
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_DISASSEMBLER_H
@@ -0,0 +1,107 @@
+// generated from the ADR8_OPCODES list by tools/instruction_parser.py --mnemonics
+// do not edit, run `make generate` after changing the list instead
+#ifndef ADR8_MNEMONICS_H
+#define ADR8_MNEMONICS_H
+
+#include <stdint.h>
+
+#define MNEMONIC_HASH_BITS 9
+#define MNEMONIC_HASH_SEED 0x55DD6E39u
+#define MNEMONIC_HASH(key) ((uint32_t)((key)*MNEMONIC_HASH_SEED) >> (32 - MNEMONIC_HASH_BITS))
+
+typedef struct{
+  uint32_t key; // mnemonic packed little endian, 0 for empty slots
+  uint8_t opcode;
+} MnemonicEntry;
+
+// perfect hash of every mnemonic, indexed by MNEMONIC_HASH(key)
+static const MnemonicEntry MnemonicTable[1 << MNEMONIC_HASH_BITS] = {
+  [18] = {0x4C494642u, ADR8_Op_BFIL},
+  [27] = {0x00584F50u, ADR8_Op_POX},
+  [28] = {0x504D4342u, ADR8_Op_BCMP},
+  [36] = {0x004C554Du, ADR8_Op_MUL},
+  [37] = {0x4C414F50u, ADR8_Op_POAL},
+  [63] = {0x52504D4Au, ADR8_Op_JMPR},
+  [77] = {0x00414F50u, ADR8_Op_POA},
+  [78] = {0x59434544u, ADR8_Op_DECY},
+  [81] = {0x4C425953u, ADR8_Op_SYBL},
+  [82] = {0x41544553u, ADR8_Op_SETA},
+  [93] = {0x48414F50u, ADR8_Op_POAH},
+  [100] = {0x41544C4Au, ADR8_Op_JLTA},
+  [101] = {0x0058444Cu, ADR8_Op_LDX},
+  [110] = {0x4C41444Cu, ADR8_Op_LDAL},
+  [121] = {0x00425953u, ADR8_Op_SYB},
+  [124] = {0x00585550u, ADR8_Op_PUX},
+  [134] = {0x4C415550u, ADR8_Op_PUAL},
+  [137] = {0x48425953u, ADR8_Op_SYBH},
+  [144] = {0x58544553u, ADR8_Op_SETX},
+  [146] = {0x00004945u, ADR8_Op_EI},
+  [150] = {0x0041444Cu, ADR8_Op_LDA},
+  [166] = {0x4841444Cu, ADR8_Op_LDAH},
+  [172] = {0x00434544u, ADR8_Op_DEC},
+  [173] = {0x41504D4Au, ADR8_Op_JMPA},
+  [174] = {0x00415550u, ADR8_Op_PUA},
+  [179] = {0x59504342u, ADR8_Op_BCPY},
+  [190] = {0x48415550u, ADR8_Op_PUAH},
+  [196] = {0x42544553u, ADR8_Op_SETB},
+  [197] = {0x00585453u, ADR8_Op_STX},
+  [198] = {0x4B544553u, ADR8_Op_SETK},
+  [201] = {0x58434E49u, ADR8_Op_INCX},
+  [206] = {0x4C415453u, ADR8_Op_STAL},
+  [237] = {0x41585254u, ADR8_Op_TRXA},
+  [246] = {0x00415453u, ADR8_Op_STA},
+  [248] = {0x00594F50u, ADR8_Op_POY},
+  [257] = {0x4C424F50u, ADR8_Op_POBL},
+  [258] = {0x59544553u, ADR8_Op_SETY},
+  [262] = {0x48415453u, ADR8_Op_STAH},
+  [264] = {0x4C41584Cu, ADR8_Op_LXAL},
+  [274] = {0x54494157u, ADR8_Op_WAIT},
+  [297] = {0x00424F50u, ADR8_Op_POB},
+  [302] = {0x00495452u, ADR8_Op_RTI},
+  [304] = {0x0041584Cu, ADR8_Op_LXA},
+  [307] = {0x00525352u, ADR8_Op_RSR},
+  [313] = {0x48424F50u, ADR8_Op_POBH},
+  [315] = {0x59434E49u, ADR8_Op_INCY},
+  [320] = {0x4841584Cu, ADR8_Op_LXAH},
+  [321] = {0x0059444Cu, ADR8_Op_LDY},
+  [325] = {0x5251454Au, ADR8_Op_JEQR},
+  [331] = {0x4C42444Cu, ADR8_Op_LDBL},
+  [336] = {0x5254474Au, ADR8_Op_JGTR},
+  [345] = {0x00595550u, ADR8_Op_PUY},
+  [348] = {0x58415254u, ADR8_Op_TRAX},
+  [354] = {0x4C425550u, ADR8_Op_PUBL},
+  [371] = {0x0042444Cu, ADR8_Op_LDB},
+  [387] = {0x4842444Cu, ADR8_Op_LDBH},
+  [394] = {0x00425550u, ADR8_Op_PUB},
+  [398] = {0x00425553u, ADR8_Op_SUB},
+  [400] = {0x42415254u, ADR8_Op_TRAB},
+  [402] = {0x4B415254u, ADR8_Op_TRAK},
+  [408] = {0x544C4148u, ADR8_Op_HALT},
+  [409] = {0x00434E49u, ADR8_Op_INC},
+  [410] = {0x48425550u, ADR8_Op_PUBH},
+  [415] = {0x4C42594Cu, ADR8_Op_LYBL},
+  [417] = {0x00595453u, ADR8_Op_STY},
+  [427] = {0x4C425453u, ADR8_Op_STBL},
+  [428] = {0x56544553u, ADR8_Op_SETV},
+  [435] = {0x4151454Au, ADR8_Op_JEQA},
+  [442] = {0x4C415853u, ADR8_Op_SXAL},
+  [446] = {0x4154474Au, ADR8_Op_JGTA},
+  [455] = {0x0042594Cu, ADR8_Op_LYB},
+  [457] = {0x41595254u, ADR8_Op_TRYA},
+  [459] = {0x00444441u, ADR8_Op_ADD},
+  [462] = {0x59415254u, ADR8_Op_TRAY},
+  [467] = {0x00425453u, ADR8_Op_STB},
+  [470] = {0x0052534Au, ADR8_Op_JSR},
+  [471] = {0x4842594Cu, ADR8_Op_LYBH},
+  [476] = {0x58434544u, ADR8_Op_DECX},
+  [480] = {0x00504F4Eu, ADR8_Op_NOP},
+  [482] = {0x00415853u, ADR8_Op_SXA},
+  [483] = {0x48425453u, ADR8_Op_STBH},
+  [486] = {0x00004944u, ADR8_Op_DI},
+  [498] = {0x48415853u, ADR8_Op_SXAH},
+  [500] = {0x00564944u, ADR8_Op_DIV},
+  [502] = {0x52544C4Au, ADR8_Op_JLTR},
+  [507] = {0x41425254u, ADR8_Op_TRBA},
+};
+
+#endif // ADR8_MNEMONICS_H
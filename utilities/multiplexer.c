@@ -0,0 +1,322 @@
+#define ADR8_IMPLEMENTATION
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "bootstrapper.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Runs one program for every connection to a UNIX socket, each on its own
+// machine with the serial bus reading and writing the connection. Instead of
+// a thread per machine a few worker threads each run many machines in
+// slices of cycles, a machine that reads input that hasn't arrived yet, or
+// whose output the connection doesn't take, is left until epoll reports the
+// connection ready and the other machines run in the meantime. With -p the
+// memory of every machine is allocated a page at a time as it is written.
+
+#define MULTIPLEXER_MEMORY_SIZE 0x1000
+#define MULTIPLEXER_DEFAULT_THREADS 4
+#define MULTIPLEXER_DEFAULT_BUDGET 100000000
+#define MULTIPLEXER_SLICE_CYCLES 100000 // cycles a machine runs before the next one
+#define MULTIPLEXER_MAX_EVENTS 64
+
+typedef struct Instance{
+  ADR8_Machine* machine;
+  ADR8_PagedMemory paged; // memory of the machine with -p
+  ADR8_SerialBus serial;
+  ADR8_Scheduler sched;
+  ADR8_Timer timer;
+  int fd;
+  bool queued;   // in the worker's run queue
+  bool finished; // the program ended, the remaining output is written before closing
+  struct Instance* next;
+} Instance;
+
+typedef struct{
+  int epoll_fd;
+  int listen_fd;
+  const uint8_t* program;
+  size_t program_size;
+  uint64_t budget;
+  bool paged;
+  Instance* head; // instances that can run, in the order they run
+  Instance* tail;
+  size_t queued;
+} Worker;
+
+static void Worker_enqueue(Worker* worker, Instance* instance){
+  if(instance->queued) return;
+  instance->queued = true;
+  instance->next = NULL;
+  if(worker->tail) worker->tail->next = instance; else worker->head = instance;
+  worker->tail = instance;
+  worker->queued++;
+}
+
+static Instance* Worker_dequeue(Worker* worker){
+  Instance* instance = worker->head;
+  worker->head = instance->next;
+  if(!worker->head) worker->tail = NULL;
+  instance->queued = false;
+  worker->queued--;
+  return instance;
+}
+
+static void Instance_free(Instance* instance){
+  close(instance->fd);
+  ADR8_SerialBus_free(&instance->serial);
+  ADR8_Scheduler_free(&instance->sched);
+  if(instance->paged.bus) ADR8_PagedMemory_free(&instance->paged);
+  ADR8_Machine_free(instance->machine);
+  free(instance);
+}
+
+static Instance* Instance_new(Worker* worker, int fd){
+  Instance* instance = calloc(1, sizeof(Instance));
+  if(!instance) return NULL;
+  instance->fd = fd;
+  // a machine without memory of its own reads and writes the paged memory
+  instance->machine = ADR8_Machine_new(worker->paged ? 0 : MULTIPLEXER_MEMORY_SIZE, 0x0);
+  if(!instance->machine){
+    free(instance);
+    return NULL;
+  }
+  // same devices as the program loader
+  ADR8_Bus* bus = &instance->machine->bus;
+  ADR8_Core* core = &instance->machine->core;
+  if(worker->paged) ADR8_PagedMemory_init(&instance->paged, bus, MULTIPLEXER_MEMORY_SIZE, 0x0);
+  ADR8_Scheduler_init(&instance->sched);
+  if(!ADR8_SerialBus_init_fd(&instance->serial, fd, fd, bus, 0x1000)){
+    ADR8_Machine_free(instance->machine);
+    free(instance);
+    return NULL;
+  }
+  ADR8_SerialBus_connect_irq(&instance->serial, core, 0);
+  ADR8_Timer_init(&instance->timer, bus, &instance->sched, core, 1, 1, 0x1010);
+  if(worker->paged){
+    uint32_t program_size = ADR8_Bootstrapper_program_size(worker->program, worker->program_size, MULTIPLEXER_MEMORY_SIZE);
+    ADR8_PagedMemory_load(&instance->paged, 0x0, worker->program + 2, program_size);
+    ADR8_Bootstrapper_start(core, program_size);
+  }else{
+    bool loaded = ADR8_Bootstrapper_load(instance->machine, worker->program, worker->program_size);
+    assert(loaded);
+    (void)loaded;
+  }
+  return instance;
+}
+
+// runs the instance for a slice, then queues it again or leaves it until
+// its connection is ready
+static void Instance_step(Worker* worker, Instance* instance){
+  ADR8_Core* core = &instance->machine->core;
+  ADR8_Bus* bus = &instance->machine->bus;
+  bool wait = false;
+  if(!instance->finished){
+    // the scheduler skips the waiting core to its next event or the end of
+    // the slice without looking at the connection, so input that arrived
+    // in the meantime is checked first, also while a timer is pending
+    bool waiting = core->waiting && !core->irq_pending;
+    bool open = waiting && ADR8_SerialBus_poll(&instance->serial, 0);
+    bool idle = waiting && !instance->sched.count;
+    if(idle && !open){
+      instance->finished = true; // nothing can wake it anymore
+    }else if(idle && !core->irq_pending){
+      wait = true;
+    }else{
+      // time spent waiting for input isn't taken from the budget
+      uint64_t busy = core->cycles - instance->sched.idle;
+      uint64_t slice = worker->budget - busy;
+      if(slice > MULTIPLEXER_SLICE_CYCLES) slice = MULTIPLEXER_SLICE_CYCLES;
+      ADR8_Scheduler_run(&instance->sched, core, core->cycles + slice);
+      busy = core->cycles - instance->sched.idle;
+      if(core->halt || busy >= worker->budget) instance->finished = true;
+      wait = bus->blocked != NULL;
+    }
+  }
+  // output left over waits for the connection unless the program can go on
+  bool flushed = ADR8_SerialBus_flush(&instance->serial);
+  if(instance->finished){
+    if(flushed) Instance_free(instance);
+    return;
+  }
+  // a read or write of the connection failed with EAGAIN before waiting,
+  // so epoll reports the next change and the instance is queued again
+  if(!wait) Worker_enqueue(worker, instance);
+}
+
+static void Worker_accept(Worker* worker){
+  while(true){
+    int fd = accept(worker->listen_fd, NULL, NULL);
+    if(fd < 0){
+      if(errno == EINTR) continue;
+      if(errno != EAGAIN && errno != EWOULDBLOCK){
+        ADR8_ERROR_LOG("multiplexer: accept failed: %s\n", strerror(errno));
+      }
+      return;
+    }
+    Instance* instance = Instance_new(worker, fd);
+    if(!instance){
+      ADR8_ERROR_LOG("multiplexer: unable to allocate a machine\n");
+      close(fd);
+      continue;
+    }
+    // edge triggered, an instance only waits after a read or write of its
+    // connection would have blocked, so the next edge always wakes it
+    struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = instance};
+    if(epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0){
+      ADR8_ERROR_LOG("multiplexer: epoll_ctl failed: %s\n", strerror(errno));
+      Instance_free(instance);
+      continue;
+    }
+    Worker_enqueue(worker, instance);
+  }
+}
+
+static void* Worker_run(void* ptr){
+  Worker* worker = ptr;
+  struct epoll_event events[MULTIPLEXER_MAX_EVENTS];
+  while(true){
+    // only sleeps when no instance can run
+    int n = epoll_wait(worker->epoll_fd, events, MULTIPLEXER_MAX_EVENTS, worker->head ? 0 : -1);
+    if(n < 0 && errno != EINTR){
+      ADR8_ERROR_LOG("multiplexer: epoll_wait failed: %s\n", strerror(errno));
+      return NULL;
+    }
+    for(int i = 0; i < n; ++i){
+      if(events[i].data.ptr) Worker_enqueue(worker, events[i].data.ptr);
+      else Worker_accept(worker);
+    }
+    // one slice for each instance queued so far, instances queued again go
+    // after the ones that were woken
+    for(size_t i = worker->queued; i > 0; --i){
+      Instance_step(worker, Worker_dequeue(worker));
+    }
+  }
+}
+
+static int Multiplexer_listen(const char* path){
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if(fd < 0) return -1;
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    close(fd);
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0){
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static uint8_t* Multiplexer_read_file(const char* path, size_t* size){
+  FILE* fp = fopen(path, "rb");
+  if(!fp) return NULL;
+  fseek(fp, 0, SEEK_END);
+  long length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t* data = length > 0 ? malloc(length) : NULL;
+  if(data && fread(data, 1, length, fp) != (size_t)length){
+    free(data);
+    data = NULL;
+  }
+  fclose(fp);
+  *size = length;
+  return data;
+}
+
+int main(int argc, char** argv){
+  const char* socket_path = NULL;
+  const char* program_path = NULL;
+  long threads = MULTIPLEXER_DEFAULT_THREADS;
+  uint64_t budget = MULTIPLEXER_DEFAULT_BUDGET;
+  bool paged = false;
+  bool usage = false;
+  for(int i = 1; i < argc; ++i){
+    if(strcmp(argv[i], "-p") == 0){
+      paged = true;
+    }else if(argv[i][0] == '-' && i+1 < argc){
+      switch (argv[i][1]) {
+        case 'u': socket_path = argv[++i]; break;
+        case 't': threads = atol(argv[++i]); break;
+        case 'n': budget = atoll(argv[++i]); break;
+        default: usage = true; break;
+      }
+    }else{
+      program_path = argv[i];
+    }
+  }
+  if(usage || !socket_path || !program_path || threads <= 0){
+    ADR8_ERROR_LOG("Usage: multiplexer -u SOCKET [-t THREADS] [-n MAX_CYCLES] [-p] PROGRAM\n");
+    return 1;
+  }
+  if(budget == 0) budget = MULTIPLEXER_DEFAULT_BUDGET;
+
+  size_t program_size = 0;
+  uint8_t* program = Multiplexer_read_file(program_path, &program_size);
+  if(!program){
+    ADR8_ERROR_LOG("multiplexer: unable to read '%s'\n", program_path);
+    return 1;
+  }
+  // checked once on a scratch machine so instances can't fail to load it
+  ADR8_Machine* scratch = ADR8_Machine_new(MULTIPLEXER_MEMORY_SIZE, 0x0);
+  assert(scratch);
+  bool valid = ADR8_Bootstrapper_load(scratch, program, program_size);
+  ADR8_Machine_free(scratch);
+  if(!valid){
+    ADR8_ERROR_LOG("multiplexer: '%s' wasn't assembled with -b or is too large\n", program_path);
+    free(program);
+    return 1;
+  }
+
+  // a client closing its connection early must not end the multiplexer
+  signal(SIGPIPE, SIG_IGN);
+  int listen_fd = Multiplexer_listen(socket_path);
+  if(listen_fd < 0){
+    ADR8_ERROR_LOG("multiplexer: unable to listen on '%s': %s\n", socket_path, strerror(errno));
+    free(program);
+    return 1;
+  }
+
+  // every worker accepts on its own epoll instance, EPOLLEXCLUSIVE wakes
+  // only one of them per connection and instances never change workers
+  Worker* workers = calloc(threads, sizeof(Worker));
+  pthread_t* ids = calloc(threads, sizeof(pthread_t));
+  assert(workers && ids);
+  for(long i = 0; i < threads; ++i){
+    Worker* worker = &workers[i];
+    worker->listen_fd = listen_fd;
+    worker->program = program;
+    worker->program_size = program_size;
+    worker->budget = budget;
+    worker->paged = paged;
+    worker->epoll_fd = epoll_create1(0);
+    struct epoll_event event = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+    if(worker->epoll_fd < 0 || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) != 0){
+      ADR8_ERROR_LOG("multiplexer: unable to start worker %ld: %s\n", i, strerror(errno));
+      return 1;
+    }
+    // pthread_create returns its error instead of setting errno
+    int error = pthread_create(&ids[i], NULL, Worker_run, worker);
+    if(error != 0){
+      ADR8_ERROR_LOG("multiplexer: unable to start worker %ld: %s\n", i, strerror(error));
+      return 1;
+    }
+  }
+  // workers only return on errors
+  for(long i = 0; i < threads; ++i) pthread_join(ids[i], NULL);
+  close(listen_fd);
+  unlink(socket_path);
+  free(workers);
+  free(ids);
+  free(program);
+  return 1;
+}
@@ -0,0 +1,81 @@
+#ifndef ADR8_PACER_H
+#define ADR8_PACER_H
+
+#include "../ADR8.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Runs an emulator at a target emulated clock rate. The host loop runs the
+// emulator in batches of cycles and calls ADR8_Pacer_sync after each batch,
+// which sleeps until the absolute wall clock deadline of the cycles run so
+// far. Deadlines are absolute so sleep overshoot never accumulates.
+
+typedef struct{
+  uint64_t hz;
+  uint64_t batch;      // cycles per batch
+  struct timespec start;
+  uint64_t batches;
+  int64_t drift_ns;    // lateness of the last batch, negative when early
+  int64_t drift_max_ns;
+  int64_t drift_sum_ns;
+} ADR8_Pacer;
+
+void ADR8_Pacer_init(ADR8_Pacer* pacer, uint64_t hz, uint64_t batch);
+void ADR8_Pacer_sync(ADR8_Pacer* pacer, uint64_t cycles);
+void ADR8_Pacer_report(ADR8_Pacer* pacer, uint64_t cycles);
+
+#ifdef ADR8_IMPLEMENTATION
+
+#define ADR8_PACER_NS 1000000000ll
+
+static int64_t ADR8_Pacer_ns_since_start(ADR8_Pacer* pacer, struct timespec* ts){
+  return (ts->tv_sec - pacer->start.tv_sec)*ADR8_PACER_NS + (ts->tv_nsec - pacer->start.tv_nsec);
+}
+
+void ADR8_Pacer_init(ADR8_Pacer* pacer, uint64_t hz, uint64_t batch){
+  memset(pacer, 0, sizeof(ADR8_Pacer));
+  assert(hz > 0);
+  pacer->hz = hz;
+  // default to batches of about one millisecond of emulated time
+  pacer->batch = batch ? batch : (hz/1000 ? hz/1000 : 1);
+  clock_gettime(CLOCK_MONOTONIC, &pacer->start);
+}
+
+void ADR8_Pacer_sync(ADR8_Pacer* pacer, uint64_t cycles){
+  int64_t deadline_ns = (int64_t)((__uint128_t)cycles*ADR8_PACER_NS/pacer->hz);
+  struct timespec deadline = pacer->start;
+  deadline.tv_sec += deadline_ns/ADR8_PACER_NS;
+  deadline.tv_nsec += deadline_ns%ADR8_PACER_NS;
+  if(deadline.tv_nsec >= ADR8_PACER_NS){
+    deadline.tv_sec++;
+    deadline.tv_nsec -= ADR8_PACER_NS;
+  }
+
+  // sleep again when a signal interrupted it, other errors would only repeat
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  pacer->drift_ns = ADR8_Pacer_ns_since_start(pacer, &now) - deadline_ns;
+  if(pacer->drift_ns > pacer->drift_max_ns) pacer->drift_max_ns = pacer->drift_ns;
+  pacer->drift_sum_ns += pacer->drift_ns;
+  pacer->batches++;
+}
+
+void ADR8_Pacer_report(ADR8_Pacer* pacer, uint64_t cycles){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double elapsed = (double)ADR8_Pacer_ns_since_start(pacer, &now)/ADR8_PACER_NS;
+  ADR8_LOG_PRINTF("pacer: target %lu Hz, effective %.0f Hz over %lu cycles\n",
+      pacer->hz, elapsed > 0 ? cycles/elapsed : 0.0, cycles);
+  ADR8_LOG_PRINTF("pacer: drift last %ld ns, max %ld ns, mean %ld ns over %lu batches of %lu cycles\n",
+      pacer->drift_ns, pacer->drift_max_ns,
+      pacer->batches ? pacer->drift_sum_ns/(int64_t)pacer->batches : 0,
+      pacer->batches, pacer->batch);
+}
+
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_PACER_H
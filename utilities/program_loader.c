@@ -1,11 +1,32 @@
 #define ADR8_IMPLEMENTATION
 #include "../ADR8.h"
 #include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "../devices/bank.h"
+#include "../devices/storage.h"
+#include "pacer.h"
+#include "bootstrapper.h"
+
+// cycles between checks for serial input
+#define SERIAL_POLL_CYCLES 1024
+
+// the serial bus makes stdin and stdout non-blocking, which a terminal
+// shares with the shell, so their flags are put back on exit
+static int stdin_flags, stdout_flags;
+
+static void restore_stdio(void){
+  fcntl(STDIN_FILENO, F_SETFL, stdin_flags);
+  fcntl(STDOUT_FILENO, F_SETFL, stdout_flags);
+}
 
 int main(int argc, char** argv){
   
   size_t cycle_limit = 0;
   bool cycle_limit_set = false;
+  uint64_t clock_hz = 0;
+  const char* data_file = NULL;
+  const char* disk_image = NULL;
+  bool write_back = false;
   for(size_t i = 0; i < argc; ++i){
     if(argv[i][0] == '-'){
       switch (argv[i][1]) {
@@ -14,66 +35,118 @@ int main(int argc, char** argv){
           cycle_limit = atol(argv[i]);
           cycle_limit_set = true;
         }break;
+        case 'f':{
+          i++;
+          clock_hz = atol(argv[i]);
+        }break;
+        case 'd':{
+          i++;
+          data_file = argv[i];
+        }break;
+        case 's':{
+          i++;
+          disk_image = argv[i];
+        }break;
+        case 'w':{
+          write_back = true;
+        }break;
         default: break;
       }
     }
   }
 
-  ADR8_Bus bus = {0};
-
-  // init memory of 4096 bytes and mount at address 0x0
-  ADR8_Memory mem = {0};
-  ADR8_Memory_init(&mem, &bus, 0x1000, 0x0);
+  // init CPU, bus and memory of 4096 bytes mounted at address 0x0
+  ADR8_Machine* machine = ADR8_Machine_new(0x1000, 0x0);
+  if(!machine){
+    ADR8_ERROR_LOG("unable to allocate the machine\n");
+    return 1;
+  }
+  ADR8_Bus* bus = &machine->bus;
+  ADR8_Memory* mem = &machine->mem;
+  ADR8_Core* core = &machine->core;
   
-  // init serial bus device and map at address 0x1000
+  // init serial bus device on stdin and stdout and map at address 0x1000,
+  // input is read a buffer at a time and only when it is there
+  stdin_flags = fcntl(STDIN_FILENO, F_GETFL);
+  stdout_flags = fcntl(STDOUT_FILENO, F_GETFL);
+  atexit(restore_stdio);
   ADR8_SerialBus serial = {0};
-  ADR8_SerialBus_init(&serial,stdin,stdout, &bus, 0x1000);
-  
-  // init CPU
-  ADR8_Core core = {0};
-  ADR8_Core_init(&core, &bus);
+  if(!ADR8_SerialBus_init_fd(&serial, STDIN_FILENO, STDOUT_FILENO, bus, 0x1000)){
+    ADR8_ERROR_LOG("unable to allocate the serial bus buffers\n");
+    return 1;
+  }
+
+  // serial input raises interrupt line 0
+  ADR8_SerialBus_connect_irq(&serial, core, 0);
+
+  // devices acting at later cycles are run by the scheduler
+  ADR8_Scheduler sched;
+  ADR8_Scheduler_init(&sched);
+
+  // init timer counting in core cycles, map at address 0x1010 and raise line 1
+  ADR8_Timer timer;
+  ADR8_Timer_init(&timer, bus, &sched, core, 1, 1, 0x1010);
+
+  // map the data file as banks of 16KiB in a window at 0x8000, the bank is
+  // selected at 0x1020 and writes don't reach the file
+  ADR8_Bank bank = {0};
+  if(data_file && !ADR8_Bank_init_file(&bank, bus, data_file, false, 0x4000, 0x8000, 0x1020)){
+    return 1;
+  }
+
+  // map the disk image as block storage at 0x1030, completed transfers
+  // raise line 2 and written sectors only reach the image with -w
+  ADR8_Storage storage = {0};
+  if(disk_image){
+    if(!ADR8_Storage_init(&storage, bus, disk_image, write_back, 0x1030)) return 1;
+    ADR8_Storage_connect_irq(&storage, core, 2);
+  }
   
 
-  // load 16 bit integer indicating how long the program is from serial bus
-  mem.data[0x00] = ADR8_Op_LDAL;
-  mem.data[0x01] = 0x00;
-  mem.data[0x02] = 0x10;
-  mem.data[0x03] = ADR8_Op_LDAH;
-  mem.data[0x04] = 0x00;
-  mem.data[0x05] = 0x10;
-  mem.data[0x06] = ADR8_Op_SETY; // set pointer to start of program location
-  mem.data[0x07] = 0x00;
-  mem.data[0x08] = 0x00;
-
-  mem.data[0x09] = ADR8_Op_LDBL; // read program byte from serial bus
-  mem.data[0x0A] = 0x00;
-  mem.data[0x0B] = 0x10;
-  mem.data[0x0C] = ADR8_Op_SYBL; // write program byte to memory
-  mem.data[0x0D] = ADR8_Op_INCY; // increment program pointer
-  mem.data[0x0E] = ADR8_Op_DEC;  // decrement A
-  mem.data[0x0F] = ADR8_Op_SETB; // set B to zero
-  mem.data[0x10] = 0x00;
-  mem.data[0x11] = 0x00;
-  mem.data[0x12] = ADR8_Op_JGTA; // if A > B(0) keep copying
-  mem.data[0x13] = 0x09;
-  mem.data[0x14] = 0x00;
-  mem.data[0x15] = 0x00; // start program location
-
-  while(!core.halt){
-    ADR8_Core_clock(&core);
-    ADR8_Memory_clock(&mem);
-    ADR8_SerialBus_clock(&serial);
+  memcpy(mem->data, ADR8_bootstrapper, ADR8_BOOTSTRAPPER_SIZE);
+  mem->data[ADR8_BOOTSTRAPPER_SIZE] = 0x00; // start program location
+
+  ADR8_Pacer pacer = {0};
+  if(clock_hz) ADR8_Pacer_init(&pacer, clock_hz, 0);
+
+  ADR8_SerialPoll poll = {&serial, &sched, core, clock_hz != 0};
+  ADR8_Scheduler_add(&sched, SERIAL_POLL_CYCLES, SERIAL_POLL_CYCLES, ADR8_SerialPoll_event, &poll);
+
+  while(!core->halt){
+    uint64_t until = UINT64_MAX;
     #if ADR8_LOG_LEVEL == ADR8_LOG_LEVEL_DEBUG
-      ADR8_Memory_print(&mem,0x16);
-      ADR8_Core_print(&core);
+      until = core->cycles + 1;
     #endif
-    if(cycle_limit_set){
-      if(cycle_limit <= 0) {
-        break;
-      }
-      cycle_limit--;
+    if(clock_hz) until = (core->cycles/pacer.batch + 1)*pacer.batch;
+    if(cycle_limit_set && cycle_limit < until) until = cycle_limit;
+    ADR8_Scheduler_run(&sched, core, until);
+    #if ADR8_LOG_LEVEL == ADR8_LOG_LEVEL_DEBUG
+      ADR8_Memory_print(mem,0x16);
+      ADR8_Core_print(core);
+    #endif
+    if(bus->blocked){
+      // the serial bus needs stdin to have input or stdout to take output
+      ADR8_SerialBus_wait(&serial, bus->read);
+      continue;
+    }
+    if(cycle_limit_set && core->cycles >= cycle_limit) break;
+    if(!core->halt && core->cycles < until){
+      ADR8_ERROR_LOG("core is waiting for an interrupt but the serial bus reached the end of its input\n");
+      break;
+    }
+    if(clock_hz && core->cycles % pacer.batch == 0){
+      ADR8_SerialBus_flush(&serial);
+      ADR8_Pacer_sync(&pacer, core->cycles);
     }
   }
 
+  ADR8_SerialBus_wait(&serial, false);
+  if(clock_hz) ADR8_Pacer_report(&pacer, core->cycles);
+  ADR8_SerialBus_free(&serial);
+  ADR8_Scheduler_free(&sched);
+  if(data_file) ADR8_Bank_free(&bank);
+  if(disk_image) ADR8_Storage_free(&storage);
+  ADR8_Machine_free(machine);
+
   return 0;
 }
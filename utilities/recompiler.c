@@ -0,0 +1,456 @@
+#define ADR8_IMPLEMENTATION
+#define ADR8_RECOMPILED_LIBRARY
+#include "../ADR8.h"
+#include "disassembler.h"
+#include "recompiler.h"
+
+// Translates an ADR8 program to C ahead of time. The code recovered by the
+// disassembler is split into segments of straight-line code, every segment
+// becomes a label in one function with the registers as locals. Jumps and
+// calls to known segments are gotos, returns dispatch on the popped address.
+// The C is compiled together with recompiler.h into a native program, see
+// recompiler.h for what is left to the interpreter.
+
+#define RECOMPILER_FLAG_START 0x1 // a segment starts here
+#define RECOMPILER_FLAG_FALL  0x2 // the instruction before continues here
+#define RECOMPILER_FLAG_BYTE  0x4 // part of a translated instruction
+
+typedef struct{
+  Disassembly* dis;
+  FILE* out;
+  uint8_t flags[0x10000];
+} Recompiler;
+
+static const char* Recompiler_regs[4] = {"a", "b", "x", "y"};
+
+// instructions the interpreter runs instead, they end a segment
+static bool Recompiler_is_fallback(uint8_t opcode){
+  return !ADR8_OpTiming_cycles(opcode) || opcode == ADR8_Op_RTI || opcode == ADR8_Op_WAIT
+    || (opcode >= ADR8_Op_BCPY && opcode <= ADR8_Op_BCMP);
+}
+
+static bool Recompiler_ends_segment(uint8_t opcode){
+  return Recompiler_is_fallback(opcode) || Disassembler_is_relative_jump(opcode) || Disassembler_is_absolute_jump(opcode)
+    || opcode == ADR8_Op_JSR || opcode == ADR8_Op_RSR || opcode == ADR8_Op_HALT;
+}
+
+static size_t Recompiler_next(Recompiler* rc, size_t address){
+  return address + 1 + Disassembler_operand_size(rc->dis->image[address]);
+}
+
+// segments start at every block of the disassembly and wherever the code
+// can't be entered by falling through, such as after a call
+static void Recompiler_find_segments(Recompiler* rc){
+  Disassembly* dis = rc->dis;
+  for(size_t address = 0; address < dis->size; ++address){
+    if(!(dis->flags[address] & DISASSEMBLER_FLAG_CODE)) continue;
+    size_t next = Recompiler_next(rc, address);
+    for(size_t i = address; i < next; ++i) rc->flags[i] |= RECOMPILER_FLAG_BYTE;
+    if(!Recompiler_ends_segment(dis->image[address]) && next < 0x10000) rc->flags[next] |= RECOMPILER_FLAG_FALL;
+  }
+  for(size_t address = 0; address < dis->size; ++address){
+    if(!(dis->flags[address] & DISASSEMBLER_FLAG_CODE)) continue;
+    if((dis->flags[address] & DISASSEMBLER_FLAG_LEADER) || !(rc->flags[address] & RECOMPILER_FLAG_FALL)){
+      rc->flags[address] |= RECOMPILER_FLAG_START;
+    }
+  }
+}
+
+static bool Recompiler_is_start(Recompiler* rc, size_t address){
+  return address < rc->dis->size && (rc->flags[address] & RECOMPILER_FLAG_START);
+}
+
+// the last instruction of the segment starting at start
+static bool Recompiler_continues(Recompiler* rc, size_t address){
+  size_t next = Recompiler_next(rc, address);
+  return !Recompiler_ends_segment(rc->dis->image[address]) && next < rc->dis->size
+    && (rc->dis->flags[next] & DISASSEMBLER_FLAG_CODE) && !Recompiler_is_start(rc, next);
+}
+
+static uint64_t Recompiler_segment_cycles(Recompiler* rc, size_t start){
+  uint64_t cycles = 0;
+  for(size_t address = start;; address = Recompiler_next(rc, address)){
+    uint8_t opcode = rc->dis->image[address];
+    if(!Recompiler_is_fallback(opcode)) cycles += ADR8_OpTiming_cycles(opcode);
+    if(!Recompiler_continues(rc, address)) break;
+  }
+  return cycles;
+}
+
+static void Recompiler_goto(Recompiler* rc, const char* indent, uint16_t target){
+  if(Recompiler_is_start(rc, target)) fprintf(rc->out, "%sgoto S_%04X;\n", indent, target);
+  else fprintf(rc->out, "%sRECOMPILED_EXIT(0x%04X);\n", indent, target);
+}
+
+// writes the expression reading address to expr, returns true if it may
+// access a device
+static bool Recompiler_read(char* expr, size_t size, const char* address, int32_t fixed, uint8_t offset){
+  if(fixed < 0){
+    snprintf(expr, size, "RECOMPILED_READ(%s, %u)", address, offset);
+    return true;
+  }
+  if(fixed < ADR8_RECOMPILED_MEMORY_SIZE){
+    snprintf(expr, size, "ram[0x%04X]", fixed);
+    return false;
+  }
+  snprintf(expr, size, "ADR8_Recompiled_device_read(rt, 0x%04X, cycles + %u)", fixed, offset);
+  return true;
+}
+
+// emits a write of data, returns true if it may access a device or change
+// translated code
+static bool Recompiler_write(Recompiler* rc, const char* address, int32_t fixed, const char* data, uint8_t offset){
+  if(fixed < 0){
+    fprintf(rc->out, "  RECOMPILED_WRITE(%s, %s, %u);\n", address, data, offset);
+    return true;
+  }
+  if(fixed < ADR8_RECOMPILED_MEMORY_SIZE && !(rc->flags[fixed] & RECOMPILER_FLAG_BYTE)){
+    fprintf(rc->out, "  ram[0x%04X] = %s;\n", fixed, data);
+    return false;
+  }
+  fprintf(rc->out, "  RECOMPILED_WRITE(0x%04X, %s, %u);\n", fixed, data, offset);
+  return true;
+}
+
+// emits the instruction at address, returns true if the segment has to check
+// its deadline after it
+static bool Recompiler_instruction(Recompiler* rc, size_t address){
+  Disassembly* dis = rc->dis;
+  FILE* out = rc->out;
+  uint8_t opcode = dis->image[address];
+  uint16_t operand = Disassembler_operand_size(opcode) == 2 ? Disassembler_operand16(dis, address) : 0;
+  uint16_t next = Recompiler_next(rc, address);
+  uint8_t cycles = ADR8_OpTiming_cycles(opcode);
+  bool check = false;
+  const char* reg = NULL;
+  char low[80], high[80], data[32], ptr[32];
+
+  if(Recompiler_is_fallback(opcode)){
+    fprintf(out, "  RECOMPILED_EXIT(0x%04lX);\n", address);
+    return false;
+  }
+
+  switch(opcode){
+    case ADR8_Op_NOP: break;
+    case ADR8_Op_HALT:{
+      fprintf(out, "  cycles += %u;\n  core->halt = true;\n  RECOMPILED_EXIT(0x%04lX);\n", cycles, address);
+      return false;
+    }
+    case ADR8_Op_TRAK: fprintf(out, "  k = a;\n"); break;
+    case ADR8_Op_TRAB: fprintf(out, "  b = a;\n"); break;
+    case ADR8_Op_TRBA: fprintf(out, "  a = b;\n"); break;
+    case ADR8_Op_TRAX: fprintf(out, "  x = a;\n"); break;
+    case ADR8_Op_TRXA: fprintf(out, "  a = x;\n"); break;
+    case ADR8_Op_TRAY: fprintf(out, "  y = a;\n"); break;
+    case ADR8_Op_TRYA: fprintf(out, "  a = y;\n"); break;
+    case ADR8_Op_SETK: fprintf(out, "  k = 0x%04X;\n", operand); break;
+    case ADR8_Op_SETA:
+    case ADR8_Op_SETB:
+    case ADR8_Op_SETX:
+    case ADR8_Op_SETY:
+      fprintf(out, "  %s = 0x%04X;\n", Recompiler_regs[opcode - ADR8_Op_SETA], operand);
+      break;
+    case ADR8_Op_SETV: fprintf(out, "  core->reg.ivt.full = 0x%04X;\n", operand); break;
+    case ADR8_Op_EI:{
+      // the interpreter takes an interrupt that is already raised
+      fprintf(out, "  cycles += %u;\n  core->irq_enabled = true;\n", cycles);
+      fprintf(out, "  if(core->irq_pending) RECOMPILED_EXIT(0x%04X);\n", next);
+      return false;
+    }
+    case ADR8_Op_DI: fprintf(out, "  core->irq_enabled = false;\n"); break;
+
+    case ADR8_Op_LDAL:
+    case ADR8_Op_LDAH:
+    case ADR8_Op_LDBL:
+    case ADR8_Op_LDBH:
+      check = Recompiler_read(low, sizeof(low), NULL, operand, 4);
+      fprintf(out, "  RECOMPILED_SET_%c(%s, %s);\n", opcode & 1 ? 'H' : 'L', Recompiler_regs[(opcode & 0x0F) >> 1], low);
+      break;
+    case ADR8_Op_LXAL:
+    case ADR8_Op_LXAH:
+    case ADR8_Op_LYBL:
+    case ADR8_Op_LYBH:
+      check = Recompiler_read(low, sizeof(low), opcode < ADR8_Op_LYBL ? "x" : "y", -1, 2);
+      fprintf(out, "  RECOMPILED_SET_%c(%s, %s);\n", opcode & 1 ? 'H' : 'L', opcode < ADR8_Op_LYBL ? "a" : "b", low);
+      break;
+    case ADR8_Op_LDA:
+    case ADR8_Op_LDB:
+    case ADR8_Op_LDX:
+    case ADR8_Op_LDY:
+      reg = Recompiler_regs[opcode - ADR8_Op_LDA];
+      check = Recompiler_read(low, sizeof(low), NULL, operand, 4);
+      check |= Recompiler_read(high, sizeof(high), NULL, (uint16_t)(operand + 1), 5);
+      break;
+    case ADR8_Op_LXA:
+    case ADR8_Op_LYB:
+      reg = opcode == ADR8_Op_LXA ? "a" : "b";
+      snprintf(ptr, sizeof(ptr), "%s + 1", opcode == ADR8_Op_LXA ? "x" : "y");
+      check = Recompiler_read(low, sizeof(low), opcode == ADR8_Op_LXA ? "x" : "y", -1, 2);
+      check |= Recompiler_read(high, sizeof(high), ptr, -1, 3);
+      break;
+
+    case ADR8_Op_STAL:
+    case ADR8_Op_STAH:
+    case ADR8_Op_STBL:
+    case ADR8_Op_STBH:
+      snprintf(data, sizeof(data), opcode & 1 ? "%s >> 8" : "%s & 0xFF", Recompiler_regs[(opcode & 0x0F) >> 1]);
+      check = Recompiler_write(rc, NULL, operand, data, 4);
+      break;
+    case ADR8_Op_SXAL:
+    case ADR8_Op_SXAH:
+    case ADR8_Op_SYBL:
+    case ADR8_Op_SYBH:
+      snprintf(data, sizeof(data), opcode & 1 ? "%s >> 8" : "%s & 0xFF", opcode < ADR8_Op_SYBL ? "a" : "b");
+      check = Recompiler_write(rc, opcode < ADR8_Op_SYBL ? "x" : "y", -1, data, 2);
+      break;
+    case ADR8_Op_STA:
+    case ADR8_Op_STB:
+    case ADR8_Op_STX:
+    case ADR8_Op_STY:
+      snprintf(data, sizeof(data), "%s & 0xFF", Recompiler_regs[opcode - ADR8_Op_STA]);
+      check = Recompiler_write(rc, NULL, operand, data, 4);
+      snprintf(data, sizeof(data), "%s >> 8", Recompiler_regs[opcode - ADR8_Op_STA]);
+      check |= Recompiler_write(rc, NULL, (uint16_t)(operand + 1), data, 5);
+      break;
+    case ADR8_Op_SXA:
+    case ADR8_Op_SYB:
+      snprintf(data, sizeof(data), "%s & 0xFF", opcode == ADR8_Op_SXA ? "a" : "b");
+      check = Recompiler_write(rc, opcode == ADR8_Op_SXA ? "x" : "y", -1, data, 2);
+      snprintf(data, sizeof(data), "%s >> 8", opcode == ADR8_Op_SXA ? "a" : "b");
+      snprintf(ptr, sizeof(ptr), "%s + 1", opcode == ADR8_Op_SXA ? "x" : "y");
+      check |= Recompiler_write(rc, ptr, -1, data, 3);
+      break;
+
+    case ADR8_Op_ADD: fprintf(out, "  a += b;\n"); break;
+    case ADR8_Op_SUB: fprintf(out, "  a -= b;\n"); break;
+    case ADR8_Op_MUL: fprintf(out, "  a = (uint32_t)a * b;\n"); break;
+    case ADR8_Op_DIV: fprintf(out, "  a = b ? a / b : 0xFFFF;\n"); break;
+    case ADR8_Op_INC: fprintf(out, "  a++;\n"); break;
+    case ADR8_Op_DEC: fprintf(out, "  a--;\n"); break;
+    case ADR8_Op_INCX: fprintf(out, "  x++;\n"); break;
+    case ADR8_Op_INCY: fprintf(out, "  y++;\n"); break;
+    case ADR8_Op_DECX: fprintf(out, "  x--;\n"); break;
+    case ADR8_Op_DECY: fprintf(out, "  y--;\n"); break;
+
+    case ADR8_Op_JMPR:
+    case ADR8_Op_JEQR:
+    case ADR8_Op_JGTR:
+    case ADR8_Op_JLTR:
+    case ADR8_Op_JMPA:
+    case ADR8_Op_JEQA:
+    case ADR8_Op_JGTA:
+    case ADR8_Op_JLTA:
+    {
+      static const char* conditions[4] = {NULL, "a == b", "a > b", "a < b"};
+      const char* condition = conditions[opcode & 3];
+      uint16_t target = Disassembler_target(dis, address);
+      // taken or not, a branch takes the same cycles
+      fprintf(out, "  cycles += %u;\n", cycles);
+      if(!condition){
+        Recompiler_goto(rc, "  ", target);
+        return false;
+      }
+      fprintf(out, "  if(%s){\n", condition);
+      Recompiler_goto(rc, "    ", target);
+      fprintf(out, "  }\n");
+      Recompiler_goto(rc, "  ", next);
+      return false;
+    }
+    case ADR8_Op_JSR:{
+      // the return address is the last byte of the JSR
+      uint16_t ret = address + 2;
+      snprintf(data, sizeof(data), "0x%02X", ret >> 8);
+      Recompiler_write(rc, "k--", -1, data, 4);
+      snprintf(data, sizeof(data), "0x%02X", ret & 0xFF);
+      Recompiler_write(rc, "k--", -1, data, 5);
+      fprintf(out, "  cycles += %u;\n", cycles);
+      Recompiler_goto(rc, "  ", Disassembler_target(dis, address));
+      return false;
+    }
+    case ADR8_Op_RSR:{
+      // returns one past the popped address like the interpreter
+      Recompiler_read(low, sizeof(low), "++k", -1, 2);
+      Recompiler_read(high, sizeof(high), "++k", -1, 3);
+      fprintf(out, "  t = %s;\n  pc = (%s << 8 | t) + 1;\n", low, high);
+      fprintf(out, "  cycles += %u;\n  goto dispatch;\n", cycles);
+      return false;
+    }
+
+    case ADR8_Op_PUAL:
+    case ADR8_Op_PUAH:
+    case ADR8_Op_PUBL:
+    case ADR8_Op_PUBH:
+      snprintf(data, sizeof(data), opcode & 1 ? "%s >> 8" : "%s & 0xFF", Recompiler_regs[(opcode & 0x0F) >> 1]);
+      check = Recompiler_write(rc, "k--", -1, data, 2);
+      break;
+    case ADR8_Op_PUA:
+    case ADR8_Op_PUB:
+    case ADR8_Op_PUX:
+    case ADR8_Op_PUY:
+      // the high word is pushed first
+      snprintf(data, sizeof(data), "%s >> 8", Recompiler_regs[opcode - ADR8_Op_PUA]);
+      check = Recompiler_write(rc, "k--", -1, data, 2);
+      snprintf(data, sizeof(data), "%s & 0xFF", Recompiler_regs[opcode - ADR8_Op_PUA]);
+      check |= Recompiler_write(rc, "k--", -1, data, 3);
+      break;
+    case ADR8_Op_POAL:
+    case ADR8_Op_POAH:
+    case ADR8_Op_POBL:
+    case ADR8_Op_POBH:
+      check = Recompiler_read(low, sizeof(low), "++k", -1, 2);
+      fprintf(out, "  RECOMPILED_SET_%c(%s, %s);\n", opcode & 1 ? 'H' : 'L', Recompiler_regs[(opcode & 0x0F) >> 1], low);
+      break;
+    case ADR8_Op_POA:
+    case ADR8_Op_POB:
+    case ADR8_Op_POX:
+    case ADR8_Op_POY:
+      reg = Recompiler_regs[opcode - ADR8_Op_POA];
+      check = Recompiler_read(low, sizeof(low), "++k", -1, 2);
+      check |= Recompiler_read(high, sizeof(high), "++k", -1, 3);
+      break;
+  }
+  // dword loads read the low word first
+  if(reg) fprintf(out, "  t = %s;\n  %s = %s << 8 | t;\n", low, reg, high);
+  fprintf(out, "  cycles += %u;\n", cycles);
+  return check;
+}
+
+static void Recompiler_segment(Recompiler* rc, size_t start){
+  Disassembly* dis = rc->dis;
+  FILE* out = rc->out;
+  uint64_t remaining = Recompiler_segment_cycles(rc, start);
+  const char* symbol = Disassembler_symbol_at(dis, start);
+  fprintf(out, "\nS_%04lX:", start);
+  if(symbol) fprintf(out, " // %s", symbol);
+  fprintf(out, "\n  RECOMPILED_CHECK(0x%04lX, %llu);\n", start, (unsigned long long)remaining);
+  for(size_t address = start;; address = Recompiler_next(rc, address)){
+    uint8_t opcode = dis->image[address];
+    fprintf(out, "  //");
+    Disassembler_print_instruction(dis, out, address);
+    bool check = Recompiler_instruction(rc, address);
+    if(!Recompiler_is_fallback(opcode)) remaining -= ADR8_OpTiming_cycles(opcode);
+    if(!Recompiler_continues(rc, address)){
+      if(!Recompiler_ends_segment(opcode)) Recompiler_goto(rc, "  ", Recompiler_next(rc, address));
+      break;
+    }
+    if(check) fprintf(out, "  RECOMPILED_CHECK(0x%04lX, %llu);\n", Recompiler_next(rc, address), (unsigned long long)remaining);
+  }
+}
+
+static void Recompiler_emit(Recompiler* rc, const char* input_file, const uint8_t* binary, size_t binary_size,
+    bool bootstrapped, uint16_t entry){
+  Disassembly* dis = rc->dis;
+  FILE* out = rc->out;
+  fprintf(out, "// translated from %s by the ADR8 recompiler, compile with -I utilities\n", input_file);
+  fprintf(out, "#define ADR8_IMPLEMENTATION\n#include \"recompiler.h\"\n\n");
+
+  fprintf(out, "static const uint8_t image[%zu] = {", binary_size);
+  for(size_t i = 0; i < binary_size; ++i) fprintf(out, "%s0x%02X,", i % 16 ? " " : "\n  ", binary[i]);
+  fprintf(out, "\n};\n\n");
+
+  size_t segment_count = 0;
+  fprintf(out, "static const ADR8_RecompiledSegment segments[] = {\n");
+  for(size_t start = 0; start < dis->size; ++start){
+    if(!Recompiler_is_start(rc, start)) continue;
+    size_t address = start;
+    while(Recompiler_continues(rc, address)) address = Recompiler_next(rc, address);
+    fprintf(out, "  {0x%04lX, 0x%04lX},\n", start, Recompiler_next(rc, address));
+    segment_count++;
+  }
+  if(!segment_count) fprintf(out, "  {0, 0},\n");
+  fprintf(out, "};\n\n");
+
+  fprintf(out, "static void execute(ADR8_Recompiled* rt){\n");
+  fprintf(out, "  ADR8_Core* core = &rt->machine->core;\n");
+  fprintf(out, "  uint8_t* ram = rt->machine->mem.data;\n");
+  fprintf(out, "  uint64_t cycles;\n  uint16_t pc, a, b, x, y, k;\n  uint8_t t;\n  (void)t;\n");
+  fprintf(out, "  RECOMPILED_LOAD();\n\ndispatch:\n  switch(pc){\n");
+  for(size_t start = 0; start < dis->size; ++start){
+    if(Recompiler_is_start(rc, start)) fprintf(out, "    case 0x%04lX: goto S_%04lX;\n", start, start);
+  }
+  fprintf(out, "  }\n\ninterpret:\n  RECOMPILED_STORE();\n  if(!ADR8_Recompiled_interpret(rt)) return;\n");
+  fprintf(out, "  RECOMPILED_LOAD();\n  goto dispatch;\n");
+  for(size_t start = 0; start < dis->size; ++start){
+    if(Recompiler_is_start(rc, start)) Recompiler_segment(rc, start);
+  }
+  fprintf(out, "}\n\n");
+
+  fprintf(out, "const ADR8_RecompiledProgram ADR8_recompiled_program = {\n");
+  fprintf(out, "  .image = image,\n  .size = sizeof(image),\n  .bootstrapped = %s,\n  .entry = 0x%04X,\n",
+      bootstrapped ? "true" : "false", entry);
+  fprintf(out, "  .segments = segments,\n  .segment_count = %zu,\n  .execute = execute,\n};\n", segment_count);
+}
+
+int main(int argc, char** argv){
+  const char* input_file = NULL;
+  const char* output_file = NULL;
+  const char* map_file = NULL;
+  int32_t entry = -1;
+  bool raw = false;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] == '-'){
+      switch (argv[i][1]) {
+        case 'o': if(i+1 < argc) output_file = argv[++i]; break;
+        case 'm': if(i+1 < argc) map_file = argv[++i]; break;
+        case 'e': if(i+1 < argc) entry = strtol(argv[++i], NULL, 16); break;
+        case 'r': raw = true; break;
+        default: break;
+      }
+    }else{
+      input_file = argv[i];
+    }
+  }
+
+  if(!input_file || !output_file){
+    ADR8_ERROR_LOG("Usage: recompiler [-m MAPFILE] [-e ENTRY] [-r] -o OUTFILE INFILE\n");
+    return 1;
+  }
+
+  FILE* file = fopen(input_file, "rb");
+  if(!file){
+    ADR8_ERROR_LOG("couldn't open file '%s'\n",input_file);
+    return 1;
+  }
+  uint8_t* data = calloc(0x10000 + 2, 1);
+  assert(data);
+  size_t size = fread(data, 1, 0x10000 + 2, file);
+  fclose(file);
+
+  // programs assembled with -b are loaded the way the bootstrapper would and
+  // start at the jump to the program
+  bool bootstrapped = !raw && size >= 2 + ADR8_BOOTSTRAPPER_SIZE && (size_t)(data[0] | data[1] << 8) == size - 2
+    && memcmp(data + 2, ADR8_bootstrapper, ADR8_BOOTSTRAPPER_SIZE) == 0;
+  const uint8_t* image = bootstrapped ? data + 2 : data;
+  size_t image_size = bootstrapped ? size - 2 : size;
+  if(entry < 0) entry = bootstrapped ? ADR8_BOOTSTRAPPER_SIZE : 0;
+  if(image_size > ADR8_RECOMPILED_MEMORY_SIZE){
+    ADR8_ERROR_LOG("'%s' doesn't fit in the %u bytes of memory\n", input_file, ADR8_RECOMPILED_MEMORY_SIZE);
+    return 1;
+  }
+
+  Disassembly dis;
+  Disassembly_init(&dis, image, image_size, 1);
+  if(map_file && !Disassembly_load_map(&dis, map_file)){
+    ADR8_ERROR_LOG("couldn't open map file '%s'\n",map_file);
+    return 1;
+  }
+  Disassembly_analyze(&dis, entry);
+
+  Recompiler* rc = calloc(1, sizeof(Recompiler));
+  assert(rc);
+  rc->dis = &dis;
+  Recompiler_find_segments(rc);
+
+  rc->out = fopen(output_file, "w");
+  if(!rc->out){
+    ADR8_ERROR_LOG("couldn't open file '%s'\n",output_file);
+    return 1;
+  }
+  Recompiler_emit(rc, input_file, data, size, bootstrapped, entry);
+  fclose(rc->out);
+
+  free(rc);
+  Disassembly_free(&dis);
+  free(data);
+  return 0;
+}
@@ -0,0 +1,259 @@
+#ifndef ADR8_RECOMPILER_H
+#define ADR8_RECOMPILER_H
+
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "bootstrapper.h"
+
+// Runtime of programs translated to C by the recompiler (recompiler.c). The
+// translated code keeps the registers in locals and reads and writes memory
+// directly, every other address goes through the bus to the same devices as
+// the program loader. Whatever it can't run natively is left to the
+// interpreter until the core reaches the start of a translated segment again:
+// addresses that aren't known segments (computed returns, interrupt handlers),
+// instructions that aren't translated, a segment that would run past the next
+// scheduler event or the cycle limit, and everything after a write changed
+// translated code.
+//
+// Translated code counts the same cycles as the interpreter and accesses
+// devices on the same cycles, interrupts are only taken by the interpreter.
+
+#define ADR8_RECOMPILED_MEMORY_SIZE 0x1000
+#define ADR8_RECOMPILED_SERIAL_POLL_CYCLES 1024
+
+typedef struct ADR8_Recompiled ADR8_Recompiled;
+
+typedef struct{
+  uint16_t start;
+  uint16_t end; // address after the last translated byte
+} ADR8_RecompiledSegment;
+
+typedef struct{
+  const uint8_t* image; // binary as given to the recompiler
+  size_t size;
+  bool bootstrapped;    // assembled with -b, loaded like ADR8_Bootstrapper_load
+  uint16_t entry;       // start of a raw image
+  const ADR8_RecompiledSegment* segments;
+  size_t segment_count;
+  void (*execute)(ADR8_Recompiled* rt);
+} ADR8_RecompiledProgram;
+
+struct ADR8_Recompiled{
+  const ADR8_RecompiledProgram* program;
+  ADR8_Machine* machine;
+  ADR8_SerialBus serial;
+  ADR8_SerialPoll poll;
+  ADR8_Scheduler sched;
+  ADR8_Timer timer;
+  uint64_t cycle_limit; // UINT64_MAX for none
+  uint64_t deadline;    // translated code stops before running past this cycle
+  bool modified;        // translated code was overwritten
+  bool waiting;         // stopped waiting for an interrupt nothing will raise
+  uint8_t code[0x10000]; // 1 for every translated byte, 2 at segment starts
+};
+
+bool ADR8_Recompiled_init(ADR8_Recompiled* rt, const ADR8_RecompiledProgram* program, FILE* in_fp, FILE* out_fp);
+void ADR8_Recompiled_free(ADR8_Recompiled* rt);
+void ADR8_Recompiled_run(ADR8_Recompiled* rt);
+bool ADR8_Recompiled_interpret(ADR8_Recompiled* rt);
+uint8_t ADR8_Recompiled_device_read(ADR8_Recompiled* rt, uint16_t address, uint64_t cycle);
+void ADR8_Recompiled_device_write(ADR8_Recompiled* rt, uint16_t address, uint8_t data, uint64_t cycle);
+void ADR8_Recompiled_modify(ADR8_Recompiled* rt, uint16_t address, uint8_t data);
+
+static inline uint8_t ADR8_Recompiled_read(ADR8_Recompiled* rt, uint8_t* ram, uint16_t address, uint64_t cycle){
+  if(address < ADR8_RECOMPILED_MEMORY_SIZE) return ram[address];
+  return ADR8_Recompiled_device_read(rt, address, cycle);
+}
+
+static inline void ADR8_Recompiled_write(ADR8_Recompiled* rt, uint8_t* ram, uint16_t address, uint8_t data, uint64_t cycle){
+  if(address >= ADR8_RECOMPILED_MEMORY_SIZE){
+    ADR8_Recompiled_device_write(rt, address, data, cycle);
+  }else if(rt->code[address] && ram[address] != data){
+    ADR8_Recompiled_modify(rt, address, data);
+  }else{
+    ram[address] = data;
+  }
+}
+
+// used by the generated code, which declares rt, core, ram, cycles, pc and
+// the registers a, b, x, y and k (the stack pointer)
+#define RECOMPILED_LOAD() do{ \
+  a = core->reg.a.full; b = core->reg.b.full; x = core->reg.x.full; y = core->reg.y.full; \
+  k = core->reg.stk.full; pc = core->reg.pc.full; cycles = core->cycles; \
+}while(0)
+#define RECOMPILED_STORE() do{ \
+  core->reg.a.full = a; core->reg.b.full = b; core->reg.x.full = x; core->reg.y.full = y; \
+  core->reg.stk.full = k; core->reg.pc.full = pc; core->cycles = cycles; \
+}while(0)
+// leaves the translated code at address
+#define RECOMPILED_EXIT(address) do{ pc = (address); goto interpret; }while(0)
+// continues in the interpreter at address if the rest of the segment would run
+// past the deadline, device accesses and changes to the code move it
+#define RECOMPILED_CHECK(address, remaining) do{ \
+  if(cycles + (remaining) > rt->deadline) RECOMPILED_EXIT(address); \
+}while(0)
+// the byte at address, offset is the cycle of the access in the instruction
+#define RECOMPILED_READ(address, offset) ADR8_Recompiled_read(rt, ram, (address), cycles + (offset))
+#define RECOMPILED_WRITE(address, data, offset) ADR8_Recompiled_write(rt, ram, (address), (data), cycles + (offset))
+#define RECOMPILED_SET_L(reg, data) ((reg) = ((reg) & 0xFF00) | (data))
+#define RECOMPILED_SET_H(reg, data) ((reg) = ((reg) & 0x00FF) | (data) << 8)
+
+#ifdef ADR8_IMPLEMENTATION
+
+static void ADR8_Recompiled_update_deadline(ADR8_Recompiled* rt){
+  ADR8_Core* core = &rt->machine->core;
+  uint64_t next = ADR8_Scheduler_next(&rt->sched);
+  rt->deadline = next < rt->cycle_limit ? next : rt->cycle_limit;
+  // a raised interrupt is taken at the next fetch
+  if(rt->modified || (core->irq_enabled && core->irq_pending)) rt->deadline = 0;
+}
+
+bool ADR8_Recompiled_init(ADR8_Recompiled* rt, const ADR8_RecompiledProgram* program, FILE* in_fp, FILE* out_fp){
+  memset(rt, 0, sizeof(ADR8_Recompiled));
+  rt->program = program;
+  rt->cycle_limit = UINT64_MAX;
+  rt->machine = ADR8_Machine_new(ADR8_RECOMPILED_MEMORY_SIZE, 0x0);
+  if(!rt->machine){
+    ADR8_ERROR_LOG("recompiled: unable to allocate the machine\n");
+    return false;
+  }
+  ADR8_Core* core = &rt->machine->core;
+  ADR8_Bus* bus = &rt->machine->bus;
+
+  // the devices of the program loader
+  ADR8_SerialBus_init(&rt->serial, in_fp, out_fp, bus, 0x1000);
+  ADR8_SerialBus_connect_irq(&rt->serial, core, 0);
+  ADR8_Scheduler_init(&rt->sched);
+  ADR8_Timer_init(&rt->timer, bus, &rt->sched, core, 1, 1, 0x1010);
+  rt->poll = (ADR8_SerialPoll){&rt->serial, &rt->sched, core, false};
+  ADR8_Scheduler_add(&rt->sched, ADR8_RECOMPILED_SERIAL_POLL_CYCLES, ADR8_RECOMPILED_SERIAL_POLL_CYCLES,
+      ADR8_SerialPoll_event, &rt->poll);
+
+  if(program->bootstrapped){
+    memcpy(rt->machine->mem.data, ADR8_bootstrapper, ADR8_BOOTSTRAPPER_SIZE);
+    if(!ADR8_Bootstrapper_load(rt->machine, program->image, program->size)){
+      ADR8_ERROR_LOG("recompiled: the program doesn't fit in memory\n");
+      return false;
+    }
+  }else{
+    if(program->size > ADR8_RECOMPILED_MEMORY_SIZE){
+      ADR8_ERROR_LOG("recompiled: the program doesn't fit in memory\n");
+      return false;
+    }
+    memcpy(rt->machine->mem.data, program->image, program->size);
+    core->reg.pc.full = program->entry;
+  }
+
+  for(size_t i = 0; i < program->segment_count; ++i){
+    const ADR8_RecompiledSegment* segment = &program->segments[i];
+    for(uint32_t address = segment->start; address < segment->end; ++address) rt->code[address] = 1;
+  }
+  for(size_t i = 0; i < program->segment_count; ++i) rt->code[program->segments[i].start] = 2;
+  return true;
+}
+
+void ADR8_Recompiled_free(ADR8_Recompiled* rt){
+  ADR8_Scheduler_free(&rt->sched);
+  ADR8_Machine_free(rt->machine);
+}
+
+// the core can continue in translated code
+static bool ADR8_Recompiled_resumable(ADR8_Recompiled* rt){
+  ADR8_Core* core = &rt->machine->core;
+  return core->fetch && !core->stall && !core->halt && !rt->modified
+    && !(core->irq_enabled && core->irq_pending) && rt->code[core->reg.pc.full] == 2;
+}
+
+// runs the core until it can continue in translated code, returns false if
+// it halted, reached the cycle limit or waits for an interrupt nothing will
+// raise instead
+bool ADR8_Recompiled_interpret(ADR8_Recompiled* rt){
+  ADR8_Core* core = &rt->machine->core;
+  ADR8_Scheduler_dispatch(&rt->sched, core->cycles);
+  do{
+    if(core->halt || core->cycles >= rt->cycle_limit) return false;
+    // one cycle at a time to stop at the first instruction boundary, a stall
+    // or wait is skipped at once
+    uint64_t until = core->cycles + 1 + core->stall;
+    if(core->waiting && !core->irq_pending) until = ADR8_Scheduler_next(&rt->sched);
+    if(rt->modified || until > rt->cycle_limit) until = rt->cycle_limit;
+    ADR8_Scheduler_run(&rt->sched, core, until);
+    if(!core->halt && core->cycles < until && core->waiting && !core->irq_pending){
+      rt->waiting = true;
+      return false;
+    }
+  }while(!ADR8_Recompiled_resumable(rt));
+  ADR8_Recompiled_update_deadline(rt);
+  return true;
+}
+
+uint8_t ADR8_Recompiled_device_read(ADR8_Recompiled* rt, uint16_t address, uint64_t cycle){
+  ADR8_Bus* bus = &rt->machine->bus;
+  rt->machine->core.cycles = cycle;
+  ADR8_Bus_read(bus, address);
+  ADR8_Bus_clock(bus);
+  ADR8_Recompiled_update_deadline(rt);
+  return bus->data;
+}
+
+void ADR8_Recompiled_device_write(ADR8_Recompiled* rt, uint16_t address, uint8_t data, uint64_t cycle){
+  ADR8_Bus* bus = &rt->machine->bus;
+  rt->machine->core.cycles = cycle;
+  ADR8_Bus_write(bus, address, data);
+  ADR8_Bus_clock(bus);
+  ADR8_Recompiled_update_deadline(rt);
+}
+
+// translated code was overwritten, the interpreter runs the program from the
+// end of the writing instruction on
+void ADR8_Recompiled_modify(ADR8_Recompiled* rt, uint16_t address, uint8_t data){
+  rt->machine->mem.data[address] = data;
+  if(!rt->modified) ADR8_DEBUG_LOG("recompiled: code at [%04hX] was modified\n", address);
+  rt->modified = true;
+  rt->deadline = 0;
+}
+
+void ADR8_Recompiled_run(ADR8_Recompiled* rt){
+  // starts in the interpreter unless the entry point was translated
+  ADR8_Recompiled_update_deadline(rt);
+  rt->program->execute(rt);
+}
+
+#ifndef ADR8_RECOMPILED_LIBRARY
+extern const ADR8_RecompiledProgram ADR8_recompiled_program;
+
+int main(int argc, char** argv){
+  uint64_t cycle_limit = UINT64_MAX;
+  bool report = false;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] != '-') continue;
+    switch (argv[i][1]) {
+      case 'n': if(i+1 < argc) cycle_limit = atoll(argv[++i]); break;
+      case 'c': report = true; break;
+      default:
+        ADR8_ERROR_LOG("Usage: %s [-n CYCLES] [-c]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  static ADR8_Recompiled rt;
+  if(!ADR8_Recompiled_init(&rt, &ADR8_recompiled_program, stdin, stdout)) return 1;
+  rt.cycle_limit = cycle_limit;
+  ADR8_Recompiled_run(&rt);
+  if(rt.waiting){
+    ADR8_ERROR_LOG("core is waiting for an interrupt but the serial bus reached the end of its input\n");
+  }
+  fflush(stdout);
+  if(report){
+    fprintf(stderr, "cycles: %llu%s\n", (unsigned long long)rt.machine->core.cycles,
+        rt.modified ? " (code was modified, interpreted from then on)" : "");
+  }
+  ADR8_Recompiled_free(&rt);
+  return 0;
+}
+#endif // ADR8_RECOMPILED_LIBRARY
+
+#endif // ADR8_IMPLEMENTATION
+
+#endif // ADR8_RECOMPILER_H
@@ -0,0 +1,240 @@
+#define ADR8_IMPLEMENTATION
+#include "../ADR8.h"
+#include "../devices/serialbus.h"
+#include "../devices/timer.h"
+#include "bootstrapper.h"
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Runs many programs in one process instead of one program_loader per
+// program. Requests are read from stdin or from connections to a UNIX
+// socket, every request runs on the same machine restored from a snapshot
+// taken before the first run.
+//
+// request:  u32 program size, u32 input size, u64 cycle budget,
+//           program (assembled with -b), input
+// response: u8 status, u64 cycles, u32 output size, output
+// all integers are little endian
+
+#define SERVER_MEMORY_SIZE 0x1000
+#define SERVER_DEFAULT_BUDGET 100000000
+#define SERVER_MAX_REQUEST (1 << 24) // bytes of program and input
+
+typedef enum{
+  Server_HALTED = 0,  // the program executed HALT
+  Server_BUDGET = 1,  // the cycle budget ran out
+  Server_WAITING = 2, // waiting for an interrupt nothing will raise, the cycles include the wait
+  Server_INVALID = 3, // the program wasn't assembled with -b or is too large
+} Server_Status;
+
+typedef struct{
+  ADR8_Machine* machine;
+  uint8_t* snapshot; // machine->size bytes
+  ADR8_SerialBus serial;
+  ADR8_Scheduler sched;
+  ADR8_Timer timer;
+  uint64_t max_budget;
+  uint8_t* program;
+  uint32_t program_capacity;
+  uint8_t* input;
+  uint32_t input_capacity;
+  char* output;
+  size_t output_size;
+  FILE* out_fp;
+} Server;
+
+static void Server_init(Server* server, uint64_t max_budget){
+  memset(server, 0, sizeof(Server));
+  server->max_budget = max_budget;
+  server->machine = ADR8_Machine_new(SERVER_MEMORY_SIZE, 0x0);
+  assert(server->machine);
+  server->out_fp = open_memstream(&server->output, &server->output_size);
+  assert(server->out_fp);
+
+  // same devices as the program loader, the serial input is replaced for
+  // every request
+  ADR8_Bus* bus = &server->machine->bus;
+  ADR8_SerialBus_init(&server->serial, NULL, server->out_fp, bus, 0x1000);
+  ADR8_SerialBus_connect_irq(&server->serial, &server->machine->core, 0);
+  ADR8_Scheduler_init(&server->sched);
+  ADR8_Timer_init(&server->timer, bus, &server->sched, &server->machine->core, 1, 1, 0x1010);
+
+  memcpy(server->machine->mem.data, ADR8_bootstrapper, ADR8_BOOTSTRAPPER_SIZE);
+  server->snapshot = malloc(server->machine->size);
+  assert(server->snapshot);
+  memcpy(server->snapshot, server->machine, server->machine->size);
+}
+
+static void Server_free(Server* server){
+  ADR8_Scheduler_free(&server->sched);
+  ADR8_Machine_free(server->machine);
+  fclose(server->out_fp);
+  free(server->output);
+  free(server->snapshot);
+  free(server->program);
+  free(server->input);
+}
+
+// the machine is restored in place, so every pointer into it stays valid
+static void Server_reset(Server* server){
+  memcpy(server->machine, server->snapshot, server->machine->size);
+  server->sched.count = 0;
+  server->sched.seq = 0;
+  server->timer.reload.full = 0;
+  server->timer.control = 0;
+  server->timer.expired = 0;
+  server->serial.ready = false;
+  server->serial.eof = false;
+  fseek(server->out_fp, 0, SEEK_SET);
+}
+
+static Server_Status Server_run(Server* server, uint32_t program_size, uint32_t input_size, uint64_t budget){
+  Server_reset(server);
+  if(!ADR8_Bootstrapper_load(server->machine, server->program, program_size)) return Server_INVALID;
+  // the whole input is buffered, so its interrupt is raised right away and
+  // stays raised until the end of the input is read
+  ADR8_SerialBus_set_input(&server->serial, server->input, input_size);
+  ADR8_SerialBus_poll(&server->serial, 0);
+  if(budget == 0 || budget > server->max_budget) budget = server->max_budget;
+  ADR8_Core* core = &server->machine->core;
+  ADR8_Scheduler_run(&server->sched, core, budget);
+  if(core->halt) return Server_HALTED;
+  // the scheduler skips to the end of the budget in that case
+  if(core->waiting && !core->irq_pending && !server->sched.count) return Server_WAITING;
+  return Server_BUDGET;
+}
+
+static bool Server_read(FILE* fp, void* data, size_t size){
+  return fread(data, 1, size, fp) == size;
+}
+
+static uint64_t Server_get_le(const uint8_t* bytes, size_t n){
+  uint64_t value = 0;
+  for(size_t i = 0; i < n; ++i) value |= (uint64_t)bytes[i] << (8*i);
+  return value;
+}
+
+static void Server_put_le(uint8_t* bytes, uint64_t value, size_t n){
+  for(size_t i = 0; i < n; ++i) bytes[i] = value >> (8*i);
+}
+
+static bool Server_reserve(uint8_t** buffer, uint32_t* capacity, uint32_t size){
+  if(size <= *capacity) return true;
+  uint8_t* grown = realloc(*buffer, size);
+  if(!grown) return false;
+  *buffer = grown;
+  *capacity = size;
+  return true;
+}
+
+// serves requests until the end of in_fp, returns false on a malformed request
+static bool Server_serve(Server* server, FILE* in_fp, FILE* out_fp){
+  uint8_t header[16];
+  while(Server_read(in_fp, header, sizeof(header))){
+    uint32_t program_size = Server_get_le(header, 4);
+    uint32_t input_size = Server_get_le(header + 4, 4);
+    uint64_t budget = Server_get_le(header + 8, 8);
+    if(program_size > SERVER_MAX_REQUEST || input_size > SERVER_MAX_REQUEST){
+      ADR8_ERROR_LOG("server: request of %u + %u bytes is too large\n", program_size, input_size);
+      return false;
+    }
+    if(!Server_reserve(&server->program, &server->program_capacity, program_size)
+        || !Server_reserve(&server->input, &server->input_capacity, input_size)){
+      ADR8_ERROR_LOG("server: unable to allocate %u bytes of input\n", input_size);
+      return false;
+    }
+    if(!Server_read(in_fp, server->program, program_size) || !Server_read(in_fp, server->input, input_size)){
+      ADR8_ERROR_LOG("server: request ended early\n");
+      return false;
+    }
+
+    Server_Status status = Server_run(server, program_size, input_size, budget);
+    fflush(server->out_fp);
+    size_t output_size = ftell(server->out_fp);
+
+    uint8_t response[13];
+    response[0] = status;
+    Server_put_le(response + 1, server->machine->core.cycles, 8);
+    Server_put_le(response + 9, output_size, 4);
+    if(fwrite(response, 1, sizeof(response), out_fp) != sizeof(response)
+        || fwrite(server->output, 1, output_size, out_fp) != output_size
+        || fflush(out_fp) != 0){
+      return false;
+    }
+  }
+  return true;
+}
+
+static int Server_listen(const char* path){
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0) return -1;
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    close(fd);
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0){
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv){
+  const char* socket_path = NULL;
+  uint64_t max_budget = SERVER_DEFAULT_BUDGET;
+  for(int i = 1; i < argc; ++i){
+    if(argv[i][0] == '-' && i+1 < argc){
+      switch (argv[i][1]) {
+        case 'u': socket_path = argv[++i]; break;
+        case 'n': max_budget = atoll(argv[++i]); break;
+        default:
+          ADR8_ERROR_LOG("Usage: server [-u SOCKET] [-n MAX_CYCLES]\n");
+          return 1;
+      }
+    }
+  }
+  if(max_budget == 0) max_budget = SERVER_DEFAULT_BUDGET;
+
+  Server server;
+  Server_init(&server, max_budget);
+
+  if(!socket_path){
+    bool ok = Server_serve(&server, stdin, stdout);
+    Server_free(&server);
+    return ok ? 0 : 1;
+  }
+
+  // a client closing its connection early must not end the server
+  signal(SIGPIPE, SIG_IGN);
+  int listen_fd = Server_listen(socket_path);
+  if(listen_fd < 0){
+    ADR8_ERROR_LOG("server: unable to listen on '%s': %s\n", socket_path, strerror(errno));
+    Server_free(&server);
+    return 1;
+  }
+  // connections are served one after another on the same machine
+  while(true){
+    int fd = accept(listen_fd, NULL, NULL);
+    if(fd < 0){
+      if(errno == EINTR) continue;
+      ADR8_ERROR_LOG("server: accept failed: %s\n", strerror(errno));
+      break;
+    }
+    FILE* in_fp = fdopen(fd, "r");
+    FILE* out_fp = fdopen(dup(fd), "w");
+    if(in_fp && out_fp) Server_serve(&server, in_fp, out_fp);
+    if(in_fp) fclose(in_fp); else close(fd);
+    if(out_fp) fclose(out_fp);
+  }
+  close(listen_fd);
+  unlink(socket_path);
+  Server_free(&server);
+  return 1;
+}